@@ -0,0 +1,99 @@
+#include "arena.h"
+#include "memory.h"
+#include <stdint.h>
+
+#define ARENA_MIN_CHUNK 1024
+#define ARENA_MAX_CHUNK (1024 * 1024)
+
+struct ArenaChunk {
+  ArenaChunk *next;
+  size_t size;
+};
+
+#define ROUND_UP(size) \
+  (((size) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1))
+#define CHUNK_HEADER ROUND_UP(sizeof(ArenaChunk))
+
+void arena_init(Arena *arena) {
+  arena->chunks = NULL;
+  arena->next = NULL;
+  arena->end = NULL;
+  arena->chunk_size = ARENA_MIN_CHUNK;
+}
+
+// Starts a new chunk big enough for size bytes. Whatever was left in the
+// previous chunk is abandoned.
+static void add_chunk(Arena *arena, size_t size) {
+  size_t capacity = arena->chunk_size;
+  if (capacity < size) {
+    capacity = size;
+  }
+  if (arena->chunk_size < ARENA_MAX_CHUNK) {
+    arena->chunk_size *= 2;
+  }
+
+  ArenaChunk *chunk = reallocate(NULL, 0, CHUNK_HEADER + capacity);
+  chunk->next = arena->chunks;
+  chunk->size = CHUNK_HEADER + capacity;
+  arena->chunks = chunk;
+  arena->next = (char *)chunk + CHUNK_HEADER;
+  arena->end = arena->next + capacity;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+  size = ROUND_UP(size);
+  if ((size_t)(arena->end - arena->next) < size) {
+    add_chunk(arena, size);
+  }
+
+  void *result = arena->next;
+  arena->next += size;
+  return result;
+}
+
+void arena_reset(Arena *arena) {
+  ArenaChunk *newest = arena->chunks;
+  if (newest == NULL) {
+    return;
+  }
+
+  ArenaChunk *chunk = newest->next;
+  while (chunk != NULL) {
+    ArenaChunk *next = chunk->next;
+    reallocate(chunk, chunk->size, 0);
+    chunk = next;
+  }
+  newest->next = NULL;
+  arena->next = (char *)newest + CHUNK_HEADER;
+  arena->end = (char *)newest + newest->size;
+}
+
+void arena_adopt(Arena *arena, Arena *other) {
+  if (other->chunks == NULL) {
+    return;
+  }
+  if (arena->chunks == NULL) {
+    *arena = *other;
+    arena_init(other);
+    return;
+  }
+
+  // Behind the newest chunk, so arena_reset() still keeps that one.
+  ArenaChunk *oldest = other->chunks;
+  while (oldest->next != NULL) {
+    oldest = oldest->next;
+  }
+  oldest->next = arena->chunks->next;
+  arena->chunks->next = other->chunks;
+  arena_init(other);
+}
+
+void arena_free(Arena *arena) {
+  ArenaChunk *chunk = arena->chunks;
+  while (chunk != NULL) {
+    ArenaChunk *next = chunk->next;
+    reallocate(chunk, chunk->size, 0);
+    chunk = next;
+  }
+  arena_init(arena);
+}
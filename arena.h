@@ -0,0 +1,38 @@
+#ifndef arena_h
+#define arena_h
+
+#include <stddef.h>
+
+typedef struct ArenaChunk ArenaChunk;
+
+// A bump-pointer allocator: allocations are carved out of large chunks and
+// are never freed one at a time; arena_free() releases every chunk at once.
+// Chunks start small and double, so an arena holding a single statement
+// costs little and one holding a large program needs few chunks.
+typedef struct {
+    ArenaChunk* chunks;
+    char* next;
+    char* end;
+    size_t chunk_size;
+} Arena;
+
+// Every allocation is aligned to this, which suits pointers and 64-bit
+// integers.
+#define ARENA_ALIGNMENT 8
+
+#define ARENA_ALLOCATE(arena, type, count) \
+    (type*)arena_alloc(arena, sizeof(type) * (count))
+
+void arena_init(Arena* arena);
+// Never fails; exits when memory runs out, like reallocate().
+void* arena_alloc(Arena* arena, size_t size);
+// Forgets every allocation but keeps the newest, largest chunk, so an arena
+// reused for one short-lived tree after another stops calling malloc.
+void arena_reset(Arena* arena);
+// Moves every chunk of other into arena, which frees them along with its
+// own from then on; other is left empty. Allocation carries on in arena's
+// current chunk.
+void arena_adopt(Arena* arena, Arena* other);
+void arena_free(Arena* arena);
+
+#endif
@@ -4,6 +4,7 @@
 #include <setjmp.h>
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -13,15 +14,16 @@ static void test_string(void **state) {
   (void)state;
   Node *program_node = new_program_node();
   Program *program = AS_PROGRAM(program_node);
+  Arena *arena = program->arena;
 
   Token myVar_token = make_token(TOKEN_IDENT, "myVar", 5, 0);
-  Node *myVar_node = new_identifier_node(myVar_token);
+  Node *myVar_node = new_identifier_node(arena, myVar_token);
 
   Token anotherVar_token = make_token(TOKEN_IDENT, "anotherVar", 10, 0);
-  Node *anotherVar_node = new_identifier_node(anotherVar_token);
+  Node *anotherVar_node = new_identifier_node(arena, anotherVar_token);
 
   Token let_token = make_token(TOKEN_LET, "let", 3, 0);
-  Node *let_node = new_let_statement_node(let_token);
+  Node *let_node = new_let_statement_node(arena, let_token);
   LetStatement *let_statement = AS_LET_STATEMENT(let_node);
   let_statement->name = AS_IDENTIFIER(myVar_node);
   let_statement->value = anotherVar_node;
@@ -33,11 +35,49 @@ static void test_string(void **state) {
   if (sdscmp(actual, expected)) {
     fail_msg("expected %s, found %s", expected, actual);
   }
+
+  sdsfree(actual);
+  sdsfree(expected);
+  program_free(program_node);
+}
+
+static void test_arena(void **state) {
+  (void)state;
+  Arena arena;
+  arena_init(&arena);
+
+  // Odd sizes must not misalign what follows, and allocations bigger than
+  // a chunk get a chunk of their own.
+  char *previous = NULL;
+  for (size_t size = 1; size < 100000; size = size * 3 + 1) {
+    char *block = arena_alloc(&arena, size);
+    assert_int_equal((uintptr_t)block % ARENA_ALIGNMENT, 0);
+    memset(block, 0xab, size);
+    assert_true(block != previous);
+    previous = block;
+  }
+
+  Node *program_node = new_program_node();
+  Program *program = AS_PROGRAM(program_node);
+  for (int i = 0; i < 10000; i++) {
+    Token token = make_token(TOKEN_IDENT, "x", 1, 0);
+    add_statement(program, new_expression_node(
+                               program->arena, token,
+                               new_identifier_node(program->arena, token)));
+  }
+  assert_int_equal(program->statement_count, 10000);
+  assert_int_equal(program->statements[9999]->type,
+                   NODE_EXPRESSION_STATEMENT);
+
+  program_free(program_node);
+  arena_free(&arena);
+  assert_null(arena.chunks);
 }
 
 int main(void) {
   const struct CMUnitTest tests[] = {
       cmocka_unit_test(test_string),
+      cmocka_unit_test(test_arena),
   };
 
   return cmocka_run_group_tests(tests, NULL, NULL);
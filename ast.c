@@ -1,24 +1,28 @@
 #include "ast.h"
 #include "memory.h"
 #include "sds.h"
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 Node *new_program_node() {
-  Node *node = ALLOCATE(Node, 1);
+  Arena *arena = ALLOCATE(Arena, 1);
+  arena_init(arena);
+  Node *node = ARENA_ALLOCATE(arena, Node, 1);
 
   node->type = NODE_PROGRAM;
   Program *program = AS_PROGRAM(node);
-  program->statements = ALLOCATE(Node *, 8);
+  program->statements = ARENA_ALLOCATE(arena, Node *, 8);
   program->statement_count = 0;
   program->statement_capacity = 8;
+  program->arena = arena;
 
   return node;
 }
 
-Node *new_let_statement_node(Token token) {
-  Node *node = ALLOCATE(Node, 1);
+Node *new_let_statement_node(Arena *arena, Token token) {
+  Node *node = ARENA_ALLOCATE(arena, Node, 1);
 
   node->type = NODE_LET_STATEMENT;
   LetStatement *stmt = AS_LET_STATEMENT(node);
@@ -29,8 +33,8 @@ Node *new_let_statement_node(Token token) {
   return node;
 }
 
-Node *new_return_statement_node(Token token) {
-  Node *node = ALLOCATE(Node, 1);
+Node *new_return_statement_node(Arena *arena, Token token) {
+  Node *node = ARENA_ALLOCATE(arena, Node, 1);
 
   node->type = NODE_RETURN_STATEMENT;
   ReturnStatement *stmt = AS_RETURN_STATEMENT(node);
@@ -40,8 +44,8 @@ Node *new_return_statement_node(Token token) {
   return node;
 }
 
-Node *new_identifier_node(Token token) {
-  Node *node = ALLOCATE(Node, 1);
+Node *new_identifier_node(Arena *arena, Token token) {
+  Node *node = ARENA_ALLOCATE(arena, Node, 1);
 
   node->type = NODE_IDENTIFIER;
   Identifier *ident = AS_IDENTIFIER(node);
@@ -50,8 +54,8 @@ Node *new_identifier_node(Token token) {
   return node;
 }
 
-Node *new_expression_node(Token token, Node *expression) {
-  Node *node = ALLOCATE(Node, 1);
+Node *new_expression_node(Arena *arena, Token token, Node *expression) {
+  Node *node = ARENA_ALLOCATE(arena, Node, 1);
 
   node->type = NODE_EXPRESSION_STATEMENT;
   ExpressionStatement *statement = AS_EXPRESSION_STATEMENT(node);
@@ -61,8 +65,8 @@ Node *new_expression_node(Token token, Node *expression) {
   return node;
 }
 
-Node *new_integer_literal(Token token, uint64_t value) {
-  Node *node = ALLOCATE(Node, 1);
+Node *new_integer_literal(Arena *arena, Token token, uint64_t value) {
+  Node *node = ARENA_ALLOCATE(arena, Node, 1);
 
   node->type = NODE_INTEGER_LITERAL;
   IntegerLiteral *literal = AS_INTEGER_LITERAL(node);
@@ -72,135 +76,504 @@ Node *new_integer_literal(Token token, uint64_t value) {
   return node;
 }
 
-const char *token_type_to_string(TokenType type) {
-  switch (type) {
-  case TOKEN_ILLEGAL:
-    return "ILLEGAL";
-  case TOKEN_EOF:
-    return "EOF";
-  case TOKEN_IDENT:
-    return "IDENT";
-  case TOKEN_INT:
-    return "INT";
-  case TOKEN_STRING:
-    return "STRING";
-  case TOKEN_ASSIGN:
-    return "=";
-  case TOKEN_PLUS:
-    return "+";
-  case TOKEN_MINUS:
-    return "-";
-  case TOKEN_BANG:
-    return "!";
-  case TOKEN_ASTERISK:
-    return "*";
-  case TOKEN_SLASH:
-    return "/";
-  case TOKEN_LT:
-    return "<";
-  case TOKEN_GT:
-    return ">";
-  case TOKEN_EQ:
-    return "==";
-  case TOKEN_NOT_EQ:
-    return "!=";
-  case TOKEN_COMMA:
-    return ",";
-  case TOKEN_SEMICOLON:
-    return ";";
-  case TOKEN_LPAREN:
-    return "(";
-  case TOKEN_RPAREN:
-    return ")";
-  case TOKEN_LBRACE:
-    return "{";
-  case TOKEN_RBRACE:
-    return "}";
-  case TOKEN_LBRACKET:
-    return "[";
-  case TOKEN_RBRACKET:
-    return "]";
-  case TOKEN_FUNCTION:
-    return "FUNCTION";
-  case TOKEN_LET:
-    return "LET";
-  case TOKEN_TRUE:
-    return "TRUE";
-  case TOKEN_FALSE:
-    return "FALSE";
-  case TOKEN_IF:
-    return "IF";
-  case TOKEN_ELSE:
-    return "ELSE";
-  case TOKEN_RETURN:
-    return "RETURN";
-  default:
-    return "UNKNOWN";
+NodeList new_node_list(Arena *arena, int count) {
+  NodeList list;
+  list.items = count > 0 ? ARENA_ALLOCATE(arena, Node *, count) : NULL;
+  list.count = count;
+  return list;
+}
+
+Node *new_block_statement_node(Arena *arena, Token token,
+                               NodeList statements) {
+  Node *node = ARENA_ALLOCATE(arena, Node, 1);
+
+  node->type = NODE_BLOCK_STATEMENT;
+  BlockStatement *block = AS_BLOCK_STATEMENT(node);
+  block->token = token;
+  block->statements = statements;
+  block->unparsed = 0;
+
+  return node;
+}
+
+Node *new_boolean_literal(Arena *arena, Token token) {
+  Node *node = ARENA_ALLOCATE(arena, Node, 1);
+
+  node->type = NODE_BOOLEAN_LITERAL;
+  BooleanLiteral *literal = AS_BOOLEAN_LITERAL(node);
+  literal->token = token;
+  literal->value = token.type == TOKEN_TRUE;
+
+  return node;
+}
+
+Node *new_string_literal(Arena *arena, Token token) {
+  Node *node = ARENA_ALLOCATE(arena, Node, 1);
+
+  node->type = NODE_STRING_LITERAL;
+  AS_STRING_LITERAL(node)->token = token;
+
+  return node;
+}
+
+Node *new_prefix_expression_node(Arena *arena, Token token, Node *right) {
+  Node *node = ARENA_ALLOCATE(arena, Node, 1);
+
+  node->type = NODE_PREFIX_EXPRESSION;
+  PrefixExpression *expression = AS_PREFIX_EXPRESSION(node);
+  expression->token = token;
+  expression->right = right;
+
+  return node;
+}
+
+Node *new_infix_expression_node(Arena *arena, Token token, Node *left,
+                                Node *right) {
+  Node *node = ARENA_ALLOCATE(arena, Node, 1);
+
+  node->type = NODE_INFIX_EXPRESSION;
+  InfixExpression *expression = AS_INFIX_EXPRESSION(node);
+  expression->token = token;
+  expression->left = left;
+  expression->right = right;
+
+  return node;
+}
+
+Node *new_if_expression_node(Arena *arena, Token token, Node *condition,
+                             Node *consequence, Node *alternative) {
+  Node *node = ARENA_ALLOCATE(arena, Node, 1);
+
+  node->type = NODE_IF_EXPRESSION;
+  IfExpression *expression = AS_IF_EXPRESSION(node);
+  expression->token = token;
+  expression->condition = condition;
+  expression->consequence = consequence;
+  expression->alternative = alternative;
+
+  return node;
+}
+
+Node *new_function_literal(Arena *arena, Token token, NodeList parameters,
+                           Node *body) {
+  Node *node = ARENA_ALLOCATE(arena, Node, 1);
+
+  node->type = NODE_FUNCTION_LITERAL;
+  FunctionLiteral *function = AS_FUNCTION_LITERAL(node);
+  function->token = token;
+  function->parameters = parameters;
+  function->body = body;
+
+  return node;
+}
+
+Node *new_call_expression_node(Arena *arena, Token token, Node *function,
+                               NodeList arguments) {
+  Node *node = ARENA_ALLOCATE(arena, Node, 1);
+
+  node->type = NODE_CALL_EXPRESSION;
+  CallExpression *call = AS_CALL_EXPRESSION(node);
+  call->token = token;
+  call->function = function;
+  call->arguments = arguments;
+
+  return node;
+}
+
+Node *new_array_literal(Arena *arena, Token token, NodeList elements) {
+  Node *node = ARENA_ALLOCATE(arena, Node, 1);
+
+  node->type = NODE_ARRAY_LITERAL;
+  ArrayLiteral *array = AS_ARRAY_LITERAL(node);
+  array->token = token;
+  array->elements = elements;
+
+  return node;
+}
+
+Node *new_index_expression_node(Arena *arena, Token token, Node *left,
+                                Node *index) {
+  Node *node = ARENA_ALLOCATE(arena, Node, 1);
+
+  node->type = NODE_INDEX_EXPRESSION;
+  IndexExpression *expression = AS_INDEX_EXPRESSION(node);
+  expression->token = token;
+  expression->left = left;
+  expression->index = index;
+
+  return node;
+}
+
+// node_to_string() and node_visit_tokens() keep their own stacks rather
+// than recursing, so a tree of any height, such as a long chain of infix
+// operators, cannot overflow the C stack.
+
+typedef enum {
+  PRINT_NODE,
+  PRINT_TEXT,
+  PRINT_TOKEN,
+} PrintKind;
+
+// Something left to print: a node, a C string or a token's text.
+typedef struct {
+  PrintKind kind;
+  const void *what;
+} PrintItem;
+
+typedef struct {
+  PrintItem *items;
+  int count;
+  int capacity;
+} PrintStack;
+
+static void push_print(PrintStack *stack, PrintKind kind, const void *what) {
+  if (stack->count >= stack->capacity) {
+    int old_capacity = stack->capacity;
+    stack->capacity = GROW_CAPACITY(old_capacity);
+    stack->items =
+        GROW_ARRAY(PrintItem, stack->items, old_capacity, stack->capacity);
   }
+  stack->items[stack->count].kind = kind;
+  stack->items[stack->count].what = what;
+  stack->count++;
 }
 
-sds node_to_string(Node *node) {
+static void push_node(PrintStack *stack, const Node *node) {
+  if (node != NULL) {
+    push_print(stack, PRINT_NODE, node);
+  }
+}
+
+static void push_text(PrintStack *stack, const char *text) {
+  push_print(stack, PRINT_TEXT, text);
+}
+
+static void push_token(PrintStack *stack, const Token *token) {
+  push_print(stack, PRINT_TOKEN, token);
+}
+
+static void push_list(PrintStack *stack, NodeList list,
+                      const char *separator) {
+  for (int i = 0; i < list.count; i++) {
+    if (i > 0) {
+      push_text(stack, separator);
+    }
+    push_node(stack, list.items[i]);
+  }
+}
+
+// Pushes the parts of node in the order they are printed.
+static void push_parts(PrintStack *stack, Node *node) {
   switch (node->type) {
   case NODE_PROGRAM: {
     Program *program = AS_PROGRAM(node);
-    sds s = sdsnew("");
     for (int i = 0; i < program->statement_count; i++) {
-      Node *node = program->statements[i];
-      s = sdscat(s, node_to_string(node));
+      push_node(stack, program->statements[i]);
     }
-
-    return s;
+    break;
   }
   case NODE_LET_STATEMENT: {
     LetStatement *letStatement = AS_LET_STATEMENT(node);
-    sds s = sdsnew(letStatement->token.literal);
-    s = sdscat(s, " ");
-    s = sdscat(s, letStatement->name->token.literal);
-    s = sdscat(s, " = ");
-    if (letStatement->value != NULL) {
-      s = sdscat(s, node_to_string(letStatement->value));
-    }
-    s = sdscat(s, ";");
-
-    return s;
+    push_token(stack, &letStatement->token);
+    push_text(stack, " ");
+    push_token(stack, &letStatement->name->token);
+    push_text(stack, " = ");
+    push_node(stack, letStatement->value);
+    push_text(stack, ";");
+    break;
   }
   case NODE_RETURN_STATEMENT: {
     ReturnStatement *returnStatement = AS_RETURN_STATEMENT(node);
-    sds s = sdsnew(token_type_to_string(returnStatement->token.type));
-    if (returnStatement->return_value != NULL) {
-      s = sdscat(s, node_to_string(node));
+    push_token(stack, &returnStatement->token);
+    push_text(stack, " ");
+    push_node(stack, returnStatement->return_value);
+    push_text(stack, ";");
+    break;
+  }
+  case NODE_EXPRESSION_STATEMENT:
+    push_node(stack, AS_EXPRESSION_STATEMENT(node)->expression);
+    break;
+  case NODE_BLOCK_STATEMENT: {
+    BlockStatement *block = AS_BLOCK_STATEMENT(node);
+    // All there is of an unparsed block is its source.
+    if (block->unparsed) {
+      push_token(stack, &block->token);
+    } else {
+      push_list(stack, block->statements, "");
     }
-
-    return s;
+    break;
   }
-  case NODE_IDENTIFIER: {
-    Identifier *identifier = AS_IDENTIFIER(node);
-    sds s = sdsnew(identifier->token.literal);
-    return s;
+  case NODE_IDENTIFIER:
+  case NODE_INTEGER_LITERAL:
+  case NODE_BOOLEAN_LITERAL:
+  case NODE_STRING_LITERAL:
+    // Every literal starts with its token.
+    push_token(stack, &AS_IDENTIFIER(node)->token);
+    break;
+  case NODE_PREFIX_EXPRESSION: {
+    PrefixExpression *expression = AS_PREFIX_EXPRESSION(node);
+    push_text(stack, "(");
+    push_token(stack, &expression->token);
+    push_node(stack, expression->right);
+    push_text(stack, ")");
+    break;
   }
-  case NODE_EXPRESSION_STATEMENT: {
-    ExpressionStatement *expressionStatement = AS_EXPRESSION_STATEMENT(node);
-    if (expressionStatement->expression != NULL) {
-      return node_to_string(expressionStatement->expression);
+  case NODE_INFIX_EXPRESSION: {
+    InfixExpression *expression = AS_INFIX_EXPRESSION(node);
+    push_text(stack, "(");
+    push_node(stack, expression->left);
+    push_text(stack, " ");
+    push_token(stack, &expression->token);
+    push_text(stack, " ");
+    push_node(stack, expression->right);
+    push_text(stack, ")");
+    break;
+  }
+  case NODE_IF_EXPRESSION: {
+    IfExpression *expression = AS_IF_EXPRESSION(node);
+    push_text(stack, "if");
+    push_node(stack, expression->condition);
+    push_text(stack, " ");
+    push_node(stack, expression->consequence);
+    if (expression->alternative != NULL) {
+      push_text(stack, "else ");
+      push_node(stack, expression->alternative);
     }
-    return sdsnew("");
+    break;
+  }
+  case NODE_FUNCTION_LITERAL: {
+    FunctionLiteral *function = AS_FUNCTION_LITERAL(node);
+    push_token(stack, &function->token);
+    push_text(stack, "(");
+    push_list(stack, function->parameters, ", ");
+    push_text(stack, ") ");
+    push_node(stack, function->body);
+    break;
+  }
+  case NODE_CALL_EXPRESSION: {
+    CallExpression *call = AS_CALL_EXPRESSION(node);
+    push_node(stack, call->function);
+    push_text(stack, "(");
+    push_list(stack, call->arguments, ", ");
+    push_text(stack, ")");
+    break;
+  }
+  case NODE_ARRAY_LITERAL:
+    push_text(stack, "[");
+    push_list(stack, AS_ARRAY_LITERAL(node)->elements, ", ");
+    push_text(stack, "]");
+    break;
+  case NODE_INDEX_EXPRESSION: {
+    IndexExpression *expression = AS_INDEX_EXPRESSION(node);
+    push_text(stack, "(");
+    push_node(stack, expression->left);
+    push_text(stack, "[");
+    push_node(stack, expression->index);
+    push_text(stack, "])");
+    break;
+  }
   }
-  case NODE_INTEGER_LITERAL: {
-    IntegerLiteral *literal = AS_INTEGER_LITERAL(node);
-    sds s = sdsnew(literal->token.literal);
-    return s;
+}
+
+// Reverses the items from start on, so they pop in the order pushed.
+static void reverse_from(PrintStack *stack, int start) {
+  for (int i = start, j = stack->count - 1; i < j; i++, j--) {
+    PrintItem item = stack->items[i];
+    stack->items[i] = stack->items[j];
+    stack->items[j] = item;
   }
+}
+
+sds node_to_string(Node *node) {
+  sds s = sdsempty();
+  PrintStack stack = {NULL, 0, 0};
+  push_node(&stack, node);
+
+  while (stack.count > 0) {
+    PrintItem item = stack.items[--stack.count];
+    switch (item.kind) {
+    case PRINT_NODE: {
+      int start = stack.count;
+      push_parts(&stack, (Node *)item.what);
+      reverse_from(&stack, start);
+      break;
+    }
+    case PRINT_TEXT:
+      s = sdscat(s, item.what);
+      break;
+    case PRINT_TOKEN: {
+      const Token *token = item.what;
+      s = sdscatlen(s, token->start, token->length);
+      break;
+    }
+    }
   }
+
+  FREE_ARRAY(PrintItem, stack.items, stack.capacity);
+  return s;
 }
 
 void add_statement(Program *program, Node *statement) {
   if (program->statement_count >= program->statement_capacity) {
     int old_capacity = program->statement_capacity;
     program->statement_capacity = GROW_CAPACITY(old_capacity);
-    program->statements = GROW_ARRAY(Node *, program->statements, old_capacity,
-                                     program->statement_capacity);
+    // Arena memory cannot be resized; the old list is left behind.
+    Node **statements =
+        ARENA_ALLOCATE(program->arena, Node *, program->statement_capacity);
+    memcpy(statements, program->statements, sizeof(Node *) * old_capacity);
+    program->statements = statements;
   }
 
   program->statements[program->statement_count] = statement;
   program->statement_count++;
 }
+
+// Identifiers are referenced through their payload, so get back to the
+// Node that holds them.
+static Node *identifier_node(Identifier *identifier) {
+  return (Node *)((char *)identifier - offsetof(Node, as));
+}
+
+typedef struct {
+  Node **nodes;
+  int count;
+  int capacity;
+} VisitStack;
+
+static void push_visit(VisitStack *stack, Node *node) {
+  if (node == NULL) {
+    return;
+  }
+  if (stack->count >= stack->capacity) {
+    int old_capacity = stack->capacity;
+    stack->capacity = GROW_CAPACITY(old_capacity);
+    stack->nodes =
+        GROW_ARRAY(Node *, stack->nodes, old_capacity, stack->capacity);
+  }
+  stack->nodes[stack->count++] = node;
+}
+
+// Pushed last to first, so that the first pops first.
+static void push_visit_list(VisitStack *stack, NodeList list) {
+  for (int i = list.count - 1; i >= 0; i--) {
+    push_visit(stack, list.items[i]);
+  }
+}
+
+// Visits node's own token and pushes its children, last to first.
+static void visit_node(VisitStack *stack, Node *node, TokenVisitor visit,
+                       void *context) {
+  switch (node->type) {
+  case NODE_PROGRAM: {
+    Program *program = AS_PROGRAM(node);
+    for (int i = program->statement_count - 1; i >= 0; i--) {
+      push_visit(stack, program->statements[i]);
+    }
+    break;
+  }
+  case NODE_LET_STATEMENT: {
+    LetStatement *stmt = AS_LET_STATEMENT(node);
+    visit(&stmt->token, context);
+    push_visit(stack, stmt->value);
+    if (stmt->name != NULL) {
+      push_visit(stack, identifier_node(stmt->name));
+    }
+    break;
+  }
+  case NODE_RETURN_STATEMENT: {
+    ReturnStatement *stmt = AS_RETURN_STATEMENT(node);
+    visit(&stmt->token, context);
+    push_visit(stack, stmt->return_value);
+    break;
+  }
+  case NODE_EXPRESSION_STATEMENT: {
+    ExpressionStatement *stmt = AS_EXPRESSION_STATEMENT(node);
+    visit(&stmt->token, context);
+    push_visit(stack, stmt->expression);
+    break;
+  }
+  case NODE_BLOCK_STATEMENT: {
+    BlockStatement *block = AS_BLOCK_STATEMENT(node);
+    visit(&block->token, context);
+    push_visit_list(stack, block->statements);
+    break;
+  }
+  case NODE_IDENTIFIER:
+    visit(&AS_IDENTIFIER(node)->token, context);
+    break;
+  case NODE_INTEGER_LITERAL:
+    visit(&AS_INTEGER_LITERAL(node)->token, context);
+    break;
+  case NODE_BOOLEAN_LITERAL:
+    visit(&AS_BOOLEAN_LITERAL(node)->token, context);
+    break;
+  case NODE_STRING_LITERAL:
+    visit(&AS_STRING_LITERAL(node)->token, context);
+    break;
+  case NODE_PREFIX_EXPRESSION: {
+    PrefixExpression *expression = AS_PREFIX_EXPRESSION(node);
+    visit(&expression->token, context);
+    push_visit(stack, expression->right);
+    break;
+  }
+  case NODE_INFIX_EXPRESSION: {
+    InfixExpression *expression = AS_INFIX_EXPRESSION(node);
+    visit(&expression->token, context);
+    push_visit(stack, expression->right);
+    push_visit(stack, expression->left);
+    break;
+  }
+  case NODE_IF_EXPRESSION: {
+    IfExpression *expression = AS_IF_EXPRESSION(node);
+    visit(&expression->token, context);
+    push_visit(stack, expression->alternative);
+    push_visit(stack, expression->consequence);
+    push_visit(stack, expression->condition);
+    break;
+  }
+  case NODE_FUNCTION_LITERAL: {
+    FunctionLiteral *function = AS_FUNCTION_LITERAL(node);
+    visit(&function->token, context);
+    push_visit(stack, function->body);
+    push_visit_list(stack, function->parameters);
+    break;
+  }
+  case NODE_CALL_EXPRESSION: {
+    CallExpression *call = AS_CALL_EXPRESSION(node);
+    visit(&call->token, context);
+    push_visit_list(stack, call->arguments);
+    push_visit(stack, call->function);
+    break;
+  }
+  case NODE_ARRAY_LITERAL: {
+    ArrayLiteral *array = AS_ARRAY_LITERAL(node);
+    visit(&array->token, context);
+    push_visit_list(stack, array->elements);
+    break;
+  }
+  case NODE_INDEX_EXPRESSION: {
+    IndexExpression *expression = AS_INDEX_EXPRESSION(node);
+    visit(&expression->token, context);
+    push_visit(stack, expression->index);
+    push_visit(stack, expression->left);
+    break;
+  }
+  }
+}
+
+void node_visit_tokens(Node *node, TokenVisitor visit, void *context) {
+  VisitStack stack = {NULL, 0, 0};
+  push_visit(&stack, node);
+  while (stack.count > 0) {
+    Node *next = stack.nodes[--stack.count];
+    visit_node(&stack, next, visit, context);
+  }
+  FREE_ARRAY(Node *, stack.nodes, stack.capacity);
+}
+
+void program_free(Node *program) {
+  // The program node itself lives in the arena, so take the arena first.
+  Arena *arena = AS_PROGRAM(program)->arena;
+  arena_free(arena);
+  FREE(Arena, arena);
+}
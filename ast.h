@@ -2,6 +2,7 @@
 #define ast_h
 
 #include <stdint.h>
+#include "arena.h"
 #include "lexer.h"
 #include "sds.h"
 
@@ -10,8 +11,18 @@ typedef enum {
     NODE_LET_STATEMENT,
     NODE_RETURN_STATEMENT,
     NODE_EXPRESSION_STATEMENT,
+    NODE_BLOCK_STATEMENT,
     NODE_IDENTIFIER,
     NODE_INTEGER_LITERAL,
+    NODE_BOOLEAN_LITERAL,
+    NODE_STRING_LITERAL,
+    NODE_PREFIX_EXPRESSION,
+    NODE_INFIX_EXPRESSION,
+    NODE_IF_EXPRESSION,
+    NODE_FUNCTION_LITERAL,
+    NODE_CALL_EXPRESSION,
+    NODE_ARRAY_LITERAL,
+    NODE_INDEX_EXPRESSION,
 } NodeType;
 
 typedef struct Node Node;
@@ -19,9 +30,28 @@ typedef struct Program Program;
 typedef struct LetStatement LetStatement;
 typedef struct ReturnStatement ReturnStatement;
 typedef struct ExpressionStatement ExpressionStatement;
+typedef struct BlockStatement BlockStatement;
 typedef struct Identifier Identifier;
 typedef struct IntegerLiteral IntegerLiteral;
+typedef struct BooleanLiteral BooleanLiteral;
+typedef struct StringLiteral StringLiteral;
+typedef struct PrefixExpression PrefixExpression;
+typedef struct InfixExpression InfixExpression;
+typedef struct IfExpression IfExpression;
+typedef struct FunctionLiteral FunctionLiteral;
+typedef struct CallExpression CallExpression;
+typedef struct ArrayLiteral ArrayLiteral;
+typedef struct IndexExpression IndexExpression;
 
+// A fixed-length list of child nodes. The parser collects a list's items
+// before creating it, so it is allocated once at its final size.
+typedef struct {
+    Node** items;
+    int count;
+} NodeList;
+
+// token.symbol is the interned name: two identifiers name the same thing
+// exactly when their symbols are equal.
 struct Identifier {
     Token token;
 };
@@ -42,15 +72,84 @@ struct ExpressionStatement {
     Node* expression;
 };
 
+// token is the opening brace. An unparsed block is a function body a lazy
+// parser skipped: its token spans the whole body, braces included, and it
+// has no statements until parser_parse_body() parses it.
+struct BlockStatement {
+    Token token;
+    NodeList statements;
+    int unparsed;
+};
+
 struct IntegerLiteral {
     Token token;
     uint64_t value;
 };
 
+struct BooleanLiteral {
+    Token token;
+    int value;
+};
+
+// The token's text is the contents, without the quotes.
+struct StringLiteral {
+    Token token;
+};
+
+// token is the operator.
+struct PrefixExpression {
+    Token token;
+    Node* right;
+};
+
+struct InfixExpression {
+    Token token;
+    Node* left;
+    Node* right;
+};
+
+// consequence and alternative are block statements; alternative is NULL
+// without an else.
+struct IfExpression {
+    Token token;
+    Node* condition;
+    Node* consequence;
+    Node* alternative;
+};
+
+// parameters are identifiers; body is a block statement.
+struct FunctionLiteral {
+    Token token;
+    NodeList parameters;
+    Node* body;
+};
+
+// token is the opening parenthesis.
+struct CallExpression {
+    Token token;
+    Node* function;
+    NodeList arguments;
+};
+
+struct ArrayLiteral {
+    Token token;
+    NodeList elements;
+};
+
+// token is the opening bracket.
+struct IndexExpression {
+    Token token;
+    Node* left;
+    Node* index;
+};
+
+// A program owns the arena that its statement list and every node in its
+// tree come from, so program_free() releases the whole tree at once.
 struct Program {
     Node** statements;
     int statement_count;
     int statement_capacity;
+    Arena* arena;
 };
 
 struct Node {
@@ -60,8 +159,18 @@ struct Node {
         LetStatement let_statement;
         ReturnStatement return_statement;
         ExpressionStatement expression_statement;
+        BlockStatement block_statement;
         Identifier identifier;
         IntegerLiteral integer_literal;
+        BooleanLiteral boolean_literal;
+        StringLiteral string_literal;
+        PrefixExpression prefix_expression;
+        InfixExpression infix_expression;
+        IfExpression if_expression;
+        FunctionLiteral function_literal;
+        CallExpression call_expression;
+        ArrayLiteral array_literal;
+        IndexExpression index_expression;
     } as;
 };
 
@@ -71,6 +180,16 @@ struct Node {
 #define IS_IDENTIFIER(node) ((node)->type == NODE_IDENTIFIER)
 #define IS_EXPRESSION_STATEMENT(node) ((node)->type == NODE_EXPRESSION_STATEMENT)
 #define IS_INTEGER_LITERAL(node) ((node)->type == NODE_INTEGER_LITERAL)
+#define IS_BLOCK_STATEMENT(node) ((node)->type == NODE_BLOCK_STATEMENT)
+#define IS_BOOLEAN_LITERAL(node) ((node)->type == NODE_BOOLEAN_LITERAL)
+#define IS_STRING_LITERAL(node) ((node)->type == NODE_STRING_LITERAL)
+#define IS_PREFIX_EXPRESSION(node) ((node)->type == NODE_PREFIX_EXPRESSION)
+#define IS_INFIX_EXPRESSION(node) ((node)->type == NODE_INFIX_EXPRESSION)
+#define IS_IF_EXPRESSION(node) ((node)->type == NODE_IF_EXPRESSION)
+#define IS_FUNCTION_LITERAL(node) ((node)->type == NODE_FUNCTION_LITERAL)
+#define IS_CALL_EXPRESSION(node) ((node)->type == NODE_CALL_EXPRESSION)
+#define IS_ARRAY_LITERAL(node) ((node)->type == NODE_ARRAY_LITERAL)
+#define IS_INDEX_EXPRESSION(node) ((node)->type == NODE_INDEX_EXPRESSION)
 
 #define AS_PROGRAM(node) (&(node)->as.program)
 #define AS_LET_STATEMENT(node) (&(node)->as.let_statement)
@@ -78,15 +197,50 @@ struct Node {
 #define AS_EXPRESSION_STATEMENT(node) (&(node)->as.expression_statement)
 #define AS_IDENTIFIER(node) (&(node)->as.identifier)
 #define AS_INTEGER_LITERAL(node) (&(node)->as.integer_literal)
+#define AS_BLOCK_STATEMENT(node) (&(node)->as.block_statement)
+#define AS_BOOLEAN_LITERAL(node) (&(node)->as.boolean_literal)
+#define AS_STRING_LITERAL(node) (&(node)->as.string_literal)
+#define AS_PREFIX_EXPRESSION(node) (&(node)->as.prefix_expression)
+#define AS_INFIX_EXPRESSION(node) (&(node)->as.infix_expression)
+#define AS_IF_EXPRESSION(node) (&(node)->as.if_expression)
+#define AS_FUNCTION_LITERAL(node) (&(node)->as.function_literal)
+#define AS_CALL_EXPRESSION(node) (&(node)->as.call_expression)
+#define AS_ARRAY_LITERAL(node) (&(node)->as.array_literal)
+#define AS_INDEX_EXPRESSION(node) (&(node)->as.index_expression)
 
+// Creates a program with an arena of its own.
 Node* new_program_node();
-Node* new_let_statement_node(Token token);
-Node* new_return_statement_node(Token token);
-Node* new_identifier_node(Token token);
-Node* new_expression_node(Token token, Node *node);
-Node* new_integer_literal(Token token, uint64_t value);
+Node* new_let_statement_node(Arena* arena, Token token);
+Node* new_return_statement_node(Arena* arena, Token token);
+Node* new_identifier_node(Arena* arena, Token token);
+Node* new_expression_node(Arena* arena, Token token, Node *node);
+Node* new_integer_literal(Arena* arena, Token token, uint64_t value);
+// A list of count items, to be filled in by the caller.
+NodeList new_node_list(Arena* arena, int count);
+Node* new_block_statement_node(Arena* arena, Token token,
+                               NodeList statements);
+Node* new_boolean_literal(Arena* arena, Token token);
+Node* new_string_literal(Arena* arena, Token token);
+Node* new_prefix_expression_node(Arena* arena, Token token, Node* right);
+Node* new_infix_expression_node(Arena* arena, Token token, Node* left,
+                                Node* right);
+Node* new_if_expression_node(Arena* arena, Token token, Node* condition,
+                             Node* consequence, Node* alternative);
+Node* new_function_literal(Arena* arena, Token token, NodeList parameters,
+                           Node* body);
+Node* new_call_expression_node(Arena* arena, Token token, Node* function,
+                               NodeList arguments);
+Node* new_array_literal(Arena* arena, Token token, NodeList elements);
+Node* new_index_expression_node(Arena* arena, Token token, Node* left,
+                                Node* index);
 sds node_to_string(Node *node);
-const char *token_type_to_string(TokenType type);
 void add_statement(Program *program, Node* statement);
+// Frees the program's arena, and with it every node allocated from it.
+void program_free(Node* program);
+
+// Calls visit on every Token stored in the tree, parents before children,
+// so callers can move tokens to a new copy of the source.
+typedef void (*TokenVisitor)(Token* token, void* context);
+void node_visit_tokens(Node* node, TokenVisitor visit, void* context);
 
 #endif
@@ -0,0 +1,97 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cache.h"
+#include "parser.h"
+#include "sds.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static sds make_input(size_t size) {
+  sds input = sdsempty();
+  for (int i = 0; sdslen(input) < size; i++) {
+    input = sdscatprintf(input,
+                         "let value_%d = %d;\n"
+                         "return value_%d;\n"
+                         "value_%d;\n",
+                         i % 1000, i, i % 1000, (i + 1) % 1000);
+  }
+  return input;
+}
+
+// What a process start costs with an empty cache (look up, parse, store)
+// and with the entry already there (look up and load).
+static void bench_size(const char *directory, size_t size) {
+  sds input = make_input(size);
+  size_t length = sdslen(input);
+
+  double start = now_ns();
+  Node *program = cache_load(directory, input, length);
+  Parser parser;
+  parser_init(&parser, input, length);
+  program = parser_parse_program(&parser);
+  double parsed = now_ns();
+  cache_store(directory, input, length, program);
+  double cold = now_ns() - start;
+  double parse = parsed - start;
+  program_free(program);
+  parser_free(&parser);
+
+  int rounds = 5;
+  double warm = 0;
+  for (int i = 0; i < rounds; i++) {
+    start = now_ns();
+    program = cache_load(directory, input, length);
+    warm += now_ns() - start;
+    if (program == NULL) {
+      fprintf(stderr, "cache miss after store\n");
+      exit(1);
+    }
+    program_free(program);
+  }
+  warm /= rounds;
+
+  start = now_ns();
+  volatile uint64_t hash = cache_hash(input, length);
+  double hashing = now_ns() - start;
+
+  sds path = sdscatprintf(sdsempty(), "%s/%016llx.ast", directory,
+                          (unsigned long long)hash);
+  struct stat info;
+  stat(path, &info);
+  unlink(path);
+
+  printf("%10zu bytes  parse %7.1f ms  cold %7.1f ms  warm %7.1f ms  "
+         "(hash %5.2f ms)  entry %9lld bytes\n",
+         length, parse / 1e6, cold / 1e6, warm / 1e6, hashing / 1e6,
+         (long long)info.st_size);
+  fflush(stdout);
+
+  sdsfree(path);
+  sdsfree(input);
+}
+
+int main() {
+  char directory[] = "/tmp/monkey-cache-XXXXXX";
+  if (mkdtemp(directory) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  size_t sizes[] = {100000, 1000000, 10000000};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    bench_size(directory, sizes[i]);
+  }
+
+  rmdir(directory);
+  return 0;
+}
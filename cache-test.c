@@ -0,0 +1,227 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cache.h"
+#include "parser.h"
+#include "sds.h"
+#include <dirent.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cmocka.h>
+
+static const char *input = "let x = 5;\n"
+                           "let answer = 42;\n"
+                           "return x;\n"
+                           "foobar;\n"
+                           "18446744073709551615;\n"
+                           "let add = fn(a, b) { return a + b * -2; };\n"
+                           "if (add(1, [2, 3][0]) > 4) { \"yes\" } "
+                           "else { !true };\n";
+
+static void remove_directory(const char *path) {
+  DIR *directory = opendir(path);
+  struct dirent *entry;
+  while ((entry = readdir(directory)) != NULL) {
+    if (entry->d_name[0] != '.') {
+      sds file = sdscatprintf(sdsempty(), "%s/%s", path, entry->d_name);
+      unlink(file);
+      sdsfree(file);
+    }
+  }
+  closedir(directory);
+  rmdir(path);
+}
+
+static sds entry_path(const char *directory, const char *text) {
+  return sdscatprintf(
+      sdsempty(), "%s/%016llx.ast", directory,
+      (unsigned long long)cache_hash(text, strlen(text)));
+}
+
+static Node *parse(const char *text) {
+  Parser parser;
+  parser_init(&parser, text, strlen(text));
+  Node *program = parser_parse_program(&parser);
+  int error_count;
+  parser_get_errors(&parser, &error_count);
+  assert_int_equal(error_count, 0);
+  parser_free(&parser);
+  return program;
+}
+
+static void test_round_trip(void **state) {
+  (void)state;
+  char directory[] = "/tmp/monkey-cache-XXXXXX";
+  assert_non_null(mkdtemp(directory));
+
+  Node *program = parse(input);
+  assert_null(cache_load(directory, input, strlen(input)));
+  assert_int_equal(cache_store(directory, input, strlen(input), program), 0);
+
+  // Load against a copy of the source at another address: the tokens must
+  // point into the copy.
+  sds copy = sdsnew(input);
+  Node *loaded = cache_load(directory, copy, sdslen(copy));
+  assert_non_null(loaded);
+
+  sds expected = node_to_string(program);
+  sds actual = node_to_string(loaded);
+  assert_string_equal(actual, expected);
+
+  Program *before = AS_PROGRAM(program);
+  Program *after = AS_PROGRAM(loaded);
+  assert_int_equal(after->statement_count, before->statement_count);
+  LetStatement *let = AS_LET_STATEMENT(after->statements[1]);
+  assert_ptr_equal(let->token.start, copy + let->token.offset);
+  assert_int_equal(
+      let->name->token.symbol,
+      AS_LET_STATEMENT(before->statements[1])->name->token.symbol);
+  ReturnStatement *ret = AS_RETURN_STATEMENT(after->statements[2]);
+  assert_int_equal(ret->token.offset, strstr(input, "return") - input);
+  Node *number = AS_EXPRESSION_STATEMENT(after->statements[4])->expression;
+  assert_true(AS_INTEGER_LITERAL(number)->value == UINT64_MAX);
+
+  sdsfree(expected);
+  sdsfree(actual);
+  program_free(program);
+  program_free(loaded);
+  sdsfree(copy);
+  remove_directory(directory);
+}
+
+static void test_unparsed_bodies(void **state) {
+  (void)state;
+  char directory[] = "/tmp/monkey-cache-XXXXXX";
+  assert_non_null(mkdtemp(directory));
+
+  Parser parser;
+  parser_init(&parser, input, strlen(input));
+  parser.lazy_bodies = 1;
+  Node *program = parser_parse_program(&parser);
+  assert_int_equal(cache_store(directory, input, strlen(input), program), 0);
+  Node *loaded = cache_load(directory, input, strlen(input));
+  assert_non_null(loaded);
+
+  // A skipped body comes back skipped, and can still be parsed.
+  Node *function = AS_LET_STATEMENT(AS_PROGRAM(loaded)->statements[5])->value;
+  Node *body = AS_FUNCTION_LITERAL(function)->body;
+  assert_true(AS_BLOCK_STATEMENT(body)->unparsed);
+  sds expected = node_to_string(program);
+  sds actual = node_to_string(loaded);
+  assert_string_equal(actual, expected);
+  assert_int_equal(
+      parser_parse_body(&parser, body, AS_PROGRAM(loaded)->arena), 0);
+  assert_int_equal(AS_BLOCK_STATEMENT(body)->statements.count, 1);
+
+  sdsfree(expected);
+  sdsfree(actual);
+  program_free(program);
+  program_free(loaded);
+  parser_free(&parser);
+  remove_directory(directory);
+}
+
+static void test_invalid_entries(void **state) {
+  (void)state;
+  char directory[] = "/tmp/monkey-cache-XXXXXX";
+  assert_non_null(mkdtemp(directory));
+
+  Node *program = parse(input);
+  assert_int_equal(cache_store(directory, input, strlen(input), program), 0);
+  program_free(program);
+
+  // Another source misses.
+  const char *other = "let y = 6;";
+  assert_null(cache_load(directory, other, strlen(other)));
+  assert_null(cache_load("/nonexistent", input, strlen(input)));
+
+  // An entry from another format version is ignored.
+  sds path = entry_path(directory, input);
+  FILE *file = fopen(path, "r+b");
+  assert_non_null(file);
+  uint32_t version = CACHE_FORMAT_VERSION + 1;
+  fseek(file, 8, SEEK_SET);
+  fwrite(&version, sizeof(version), 1, file);
+  fclose(file);
+  assert_null(cache_load(directory, input, strlen(input)));
+
+  // An entry whose hash and length match another source's, as after a
+  // collision, misses for that source.
+  program = parse(input);
+  assert_int_equal(cache_store(directory, input, strlen(input), program), 0);
+  program_free(program);
+  sds colliding = sdsnew(input);
+  colliding[8] = '6';
+  sds colliding_path = entry_path(directory, colliding);
+  assert_int_equal(rename(path, colliding_path), 0);
+  file = fopen(colliding_path, "r+b");
+  assert_non_null(file);
+  uint64_t hash = cache_hash(colliding, sdslen(colliding));
+  fseek(file, 16, SEEK_SET);
+  fwrite(&hash, sizeof(hash), 1, file);
+  fclose(file);
+  assert_null(cache_load(directory, colliding, sdslen(colliding)));
+  sdsfree(colliding_path);
+  sdsfree(colliding);
+
+  // So is one with bytes after its last record, and a truncated one.
+  program = parse(input);
+  assert_int_equal(cache_store(directory, input, strlen(input), program), 0);
+  program_free(program);
+  file = fopen(path, "ab");
+  assert_non_null(file);
+  fputc(0, file);
+  fclose(file);
+  assert_null(cache_load(directory, input, strlen(input)));
+  assert_int_equal(truncate(path, 48), 0);
+  assert_null(cache_load(directory, input, strlen(input)));
+
+  sdsfree(path);
+  remove_directory(directory);
+}
+
+// Entries are written and read without recursion, so a chain far longer
+// than the C stack could hold round-trips.
+static void test_long_chains(void **state) {
+  (void)state;
+  char directory[] = "/tmp/monkey-cache-XXXXXX";
+  assert_non_null(mkdtemp(directory));
+
+  int terms = 300000;
+  sds chain = sdsnew("let x = 1");
+  for (int i = 1; i < terms; i++) {
+    chain = sdscat(chain, " + 1");
+  }
+  chain = sdscat(chain, ";");
+  Node *program = parse(chain);
+  assert_int_equal(cache_store(directory, chain, sdslen(chain), program), 0);
+  Node *loaded = cache_load(directory, chain, sdslen(chain));
+  assert_non_null(loaded);
+
+  sds expected = node_to_string(program);
+  sds actual = node_to_string(loaded);
+  assert_string_equal(actual, expected);
+
+  sdsfree(expected);
+  sdsfree(actual);
+  program_free(program);
+  program_free(loaded);
+  sdsfree(chain);
+  remove_directory(directory);
+}
+
+int main(void) {
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_round_trip),
+      cmocka_unit_test(test_unparsed_bodies),
+      cmocka_unit_test(test_invalid_entries),
+      cmocka_unit_test(test_long_chains),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,692 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cache.h"
+#include "memory.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CACHE_MAGIC "MONKAST"
+
+// An entry is a header followed by one record per node, in pre-order: a
+// node's children come right after it, in the order of the node's fields,
+// so no record holds a pointer. The source itself is not stored: an entry
+// is matched by two independent hashes of it, one of which names the file.
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_count;
+  uint64_t hash;
+  uint64_t check;
+  uint64_t length;
+} CacheHeader;
+
+// A record is packed into bytes:
+//
+//   the node type, with RECORD_FIRST, _SECOND, _THIRD and _UNPARSED above
+//   the token type, with RECORD_OVERFLOW above
+//   the token's offset, less the previous record's, as a zigzag varint
+//   the token's length, as a varint
+//   for nodes with a list, the list's length, and otherwise for integer
+//   tokens, the token's value, as a varint
+//
+// The program's record has an empty token at offset 0. String tokens start
+// one byte past their offset, after the quote; no other token is skipped.
+#define RECORD_FIRST 1
+#define RECORD_SECOND 2
+#define RECORD_THIRD 4
+#define RECORD_UNPARSED 8
+// Node types fit in the low four bits, token types in the low seven.
+#define RECORD_FLAG_SHIFT 4
+#define RECORD_NODE_MASK 15
+#define RECORD_OVERFLOW 128
+// The most bytes a record can take: two type bytes and three varints.
+#define RECORD_MAX_SIZE (2 + 3 * 10)
+
+// A record as read back, less its token.
+typedef struct {
+  uint8_t node;
+  uint8_t flags;
+  uint64_t list_count;
+} CacheRecord;
+
+typedef struct {
+  uint8_t *data;
+  size_t size;
+  size_t capacity;
+  uint32_t count;
+  uint64_t offset;
+  // Nodes whose records are still to be written, the next on top.
+  Node **pending;
+  uint32_t pending_count;
+  uint32_t pending_capacity;
+} Writer;
+
+typedef struct {
+  const uint8_t *data;
+  size_t size;
+  // The next byte to decode, and the previous record's token offset.
+  size_t at;
+  uint64_t offset;
+  uint32_t count;
+  uint32_t next;
+  const char *input;
+  size_t length;
+  SymbolCache symbols;
+  Arena *arena;
+  // Where the nodes still to be read go, the next on top.
+  Node ***pending;
+  uint32_t pending_count;
+  uint32_t pending_capacity;
+  int failed;
+} Reader;
+
+#define PRIME_1 11400714785074694791u
+#define PRIME_2 14029467366897019727u
+
+static uint64_t rotate(uint64_t value, int bits) {
+  return value << bits | value >> (64 - bits);
+}
+
+// Two hashes in one pass: a 64-bit FNV-1a over 8-byte words rather than
+// bytes, folding the high half back down after each multiply so every input
+// bit reaches every output bit, and the check, an xxHash-style multiply and
+// rotate with its own constants. Sources can be megabytes, and this is on
+// the startup path.
+static uint64_t hash_source(const char *input, size_t length,
+                            uint64_t *check) {
+  uint64_t hash = 14695981039346656037u;
+  uint64_t other = PRIME_2 ^ length;
+  size_t i = 0;
+
+  for (; i + 8 <= length; i += 8) {
+    uint64_t word;
+    memcpy(&word, input + i, 8);
+    hash = (hash ^ word) * 1099511628211u;
+    hash ^= hash >> 32;
+    other = rotate(other + word * PRIME_2, 31) * PRIME_1;
+  }
+  for (; i < length; i++) {
+    hash = (hash ^ (uint8_t)input[i]) * 1099511628211u;
+    other = rotate(other ^ (uint8_t)input[i] * PRIME_1, 11) * PRIME_2;
+  }
+
+  other ^= other >> 33;
+  other *= PRIME_2;
+  other ^= other >> 29;
+  *check = other;
+  return hash ^ length;
+}
+
+uint64_t cache_hash(const char *input, size_t length) {
+  uint64_t check;
+  return hash_source(input, length, &check);
+}
+
+static sds entry_path(const char *directory, uint64_t hash) {
+  return sdscatprintf(sdsempty(), "%s/%016llx.ast", directory,
+                      (unsigned long long)hash);
+}
+
+static void put_varint(Writer *writer, uint64_t value) {
+  while (value >= 128) {
+    writer->data[writer->size++] = (uint8_t)(value | 128);
+    value >>= 7;
+  }
+  writer->data[writer->size++] = (uint8_t)value;
+}
+
+static int has_list(NodeType type) {
+  return type == NODE_PROGRAM || type == NODE_BLOCK_STATEMENT ||
+         type == NODE_FUNCTION_LITERAL || type == NODE_CALL_EXPRESSION ||
+         type == NODE_ARRAY_LITERAL;
+}
+
+// Adds a record for a node of type with token, which is NULL for the
+// program; list_count is only written for nodes with a list.
+static void add_record(Writer *writer, NodeType type, const Token *token,
+                       int flags, int list_count) {
+  if (writer->size + RECORD_MAX_SIZE > writer->capacity) {
+    size_t old_capacity = writer->capacity;
+    while (writer->size + RECORD_MAX_SIZE > writer->capacity) {
+      writer->capacity = GROW_CAPACITY(writer->capacity);
+    }
+    writer->data =
+        GROW_ARRAY(uint8_t, writer->data, old_capacity, writer->capacity);
+  }
+  writer->count++;
+
+  Token empty = make_token(TOKEN_ILLEGAL, NULL, 0, 0);
+  if (token == NULL) {
+    token = &empty;
+  }
+  writer->data[writer->size++] =
+      (uint8_t)(type | flags << RECORD_FLAG_SHIFT);
+  writer->data[writer->size++] =
+      (uint8_t)(token->type | (token->overflow ? RECORD_OVERFLOW : 0));
+  uint64_t delta = (uint64_t)token->offset - writer->offset;
+  put_varint(writer, (delta << 1) ^ (0 - (delta >> 63)));
+  writer->offset = token->offset;
+  put_varint(writer, (uint64_t)token->length);
+  if (has_list(type)) {
+    put_varint(writer, (uint64_t)list_count);
+  } else if (token->type == TOKEN_INT) {
+    put_varint(writer, token->value);
+  }
+}
+
+// Adds a record for node's token with flags set for whichever of first,
+// second and third are present.
+static void add_node_record(Writer *writer, Node *node, const Token *token,
+                            Node *first, Node *second, Node *third,
+                            int list_count) {
+  add_record(writer, node->type, token,
+             (first != NULL ? RECORD_FIRST : 0) |
+                 (second != NULL ? RECORD_SECOND : 0) |
+                 (third != NULL ? RECORD_THIRD : 0),
+             list_count);
+}
+
+// Nodes waiting to be written are kept on the writer's stack rather than the
+// C stack, so a long chain of operators cannot overflow it. A node's
+// children are pushed last first, so they come off in field order.
+static void push_node(Writer *writer, Node *node) {
+  if (node == NULL) {
+    return;
+  }
+  if (writer->pending_count >= writer->pending_capacity) {
+    uint32_t old_capacity = writer->pending_capacity;
+    writer->pending_capacity = GROW_CAPACITY(old_capacity);
+    writer->pending = GROW_ARRAY(Node *, writer->pending, old_capacity,
+                                 writer->pending_capacity);
+  }
+  writer->pending[writer->pending_count++] = node;
+}
+
+static void push_children(Writer *writer, Node *first, Node *second,
+                          Node *third) {
+  push_node(writer, third);
+  push_node(writer, second);
+  push_node(writer, first);
+}
+
+static void push_list(Writer *writer, NodeList list) {
+  for (int i = list.count - 1; i >= 0; i--) {
+    push_node(writer, list.items[i]);
+  }
+}
+
+// Adds node's record and pushes its children, to be written right after it.
+static void write_node(Writer *writer, Node *node) {
+  switch (node->type) {
+  case NODE_PROGRAM: {
+    Program *program = AS_PROGRAM(node);
+    add_record(writer, NODE_PROGRAM, NULL, 0, program->statement_count);
+    for (int i = program->statement_count - 1; i >= 0; i--) {
+      push_node(writer, program->statements[i]);
+    }
+    break;
+  }
+  case NODE_LET_STATEMENT: {
+    LetStatement *stmt = AS_LET_STATEMENT(node);
+    add_record(writer, NODE_LET_STATEMENT, &stmt->token,
+               (stmt->name != NULL ? RECORD_FIRST : 0) |
+                   (stmt->value != NULL ? RECORD_SECOND : 0),
+               0);
+    if (stmt->name != NULL) {
+      add_record(writer, NODE_IDENTIFIER, &stmt->name->token, 0, 0);
+    }
+    push_node(writer, stmt->value);
+    break;
+  }
+  case NODE_RETURN_STATEMENT: {
+    ReturnStatement *stmt = AS_RETURN_STATEMENT(node);
+    add_record(writer, NODE_RETURN_STATEMENT, &stmt->token,
+               stmt->return_value != NULL ? RECORD_FIRST : 0, 0);
+    push_node(writer, stmt->return_value);
+    break;
+  }
+  case NODE_EXPRESSION_STATEMENT: {
+    ExpressionStatement *stmt = AS_EXPRESSION_STATEMENT(node);
+    add_record(writer, NODE_EXPRESSION_STATEMENT, &stmt->token,
+               stmt->expression != NULL ? RECORD_FIRST : 0, 0);
+    push_node(writer, stmt->expression);
+    break;
+  }
+  case NODE_IDENTIFIER:
+    add_record(writer, NODE_IDENTIFIER, &AS_IDENTIFIER(node)->token, 0, 0);
+    break;
+  case NODE_INTEGER_LITERAL:
+    add_record(writer, NODE_INTEGER_LITERAL,
+               &AS_INTEGER_LITERAL(node)->token, 0, 0);
+    break;
+  case NODE_BOOLEAN_LITERAL:
+    add_record(writer, NODE_BOOLEAN_LITERAL,
+               &AS_BOOLEAN_LITERAL(node)->token, 0, 0);
+    break;
+  case NODE_STRING_LITERAL:
+    add_record(writer, NODE_STRING_LITERAL, &AS_STRING_LITERAL(node)->token,
+               0, 0);
+    break;
+  case NODE_BLOCK_STATEMENT: {
+    BlockStatement *block = AS_BLOCK_STATEMENT(node);
+    add_record(writer, NODE_BLOCK_STATEMENT, &block->token,
+               block->unparsed ? RECORD_UNPARSED : 0,
+               block->statements.count);
+    push_list(writer, block->statements);
+    break;
+  }
+  case NODE_PREFIX_EXPRESSION: {
+    PrefixExpression *expression = AS_PREFIX_EXPRESSION(node);
+    add_node_record(writer, node, &expression->token, expression->right,
+                    NULL, NULL, 0);
+    push_children(writer, expression->right, NULL, NULL);
+    break;
+  }
+  case NODE_INFIX_EXPRESSION: {
+    InfixExpression *expression = AS_INFIX_EXPRESSION(node);
+    add_node_record(writer, node, &expression->token, expression->left,
+                    expression->right, NULL, 0);
+    push_children(writer, expression->left, expression->right, NULL);
+    break;
+  }
+  case NODE_IF_EXPRESSION: {
+    IfExpression *expression = AS_IF_EXPRESSION(node);
+    add_node_record(writer, node, &expression->token, expression->condition,
+                    expression->consequence, expression->alternative, 0);
+    push_children(writer, expression->condition, expression->consequence,
+                  expression->alternative);
+    break;
+  }
+  case NODE_FUNCTION_LITERAL: {
+    FunctionLiteral *function = AS_FUNCTION_LITERAL(node);
+    add_node_record(writer, node, &function->token, function->body, NULL,
+                    NULL, function->parameters.count);
+    // The parameters come first, so they are pushed last.
+    push_children(writer, function->body, NULL, NULL);
+    push_list(writer, function->parameters);
+    break;
+  }
+  case NODE_CALL_EXPRESSION: {
+    CallExpression *call = AS_CALL_EXPRESSION(node);
+    add_node_record(writer, node, &call->token, call->function, NULL, NULL,
+                    call->arguments.count);
+    push_list(writer, call->arguments);
+    push_children(writer, call->function, NULL, NULL);
+    break;
+  }
+  case NODE_ARRAY_LITERAL: {
+    ArrayLiteral *array = AS_ARRAY_LITERAL(node);
+    add_record(writer, NODE_ARRAY_LITERAL, &array->token, 0,
+               array->elements.count);
+    push_list(writer, array->elements);
+    break;
+  }
+  case NODE_INDEX_EXPRESSION: {
+    IndexExpression *expression = AS_INDEX_EXPRESSION(node);
+    add_node_record(writer, node, &expression->token, expression->left,
+                    expression->index, NULL, 0);
+    push_children(writer, expression->left, expression->index, NULL);
+    break;
+  }
+  }
+}
+
+// Writes the records of program and everything under it, in pre-order.
+static void write_program(Writer *writer, Node *program) {
+  push_node(writer, program);
+  while (writer->pending_count > 0) {
+    write_node(writer, writer->pending[--writer->pending_count]);
+  }
+  FREE_ARRAY(Node *, writer->pending, writer->pending_capacity);
+}
+
+static uint64_t get_varint(Reader *reader) {
+  // Most fields fit in one byte.
+  if (reader->at < reader->size && reader->data[reader->at] < 128) {
+    return reader->data[reader->at++];
+  }
+
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (reader->at >= reader->size) {
+      break;
+    }
+    uint8_t byte = reader->data[reader->at++];
+    value |= (uint64_t)(byte & 127) << shift;
+    if (byte < 128) {
+      return value;
+    }
+  }
+  reader->failed = 1;
+  return 0;
+}
+
+// Decodes the next record into record and token, checking that it exists,
+// is of the expected node type and that its token lies inside the source.
+// Returns 0 and marks the reader failed if not.
+static int next_record(Reader *reader, NodeType type, CacheRecord *record,
+                       Token *token) {
+  if (reader->failed || reader->next >= reader->count ||
+      reader->size - reader->at < 2) {
+    reader->failed = 1;
+    return 0;
+  }
+  reader->next++;
+
+  uint8_t node = reader->data[reader->at++];
+  uint8_t token_byte = reader->data[reader->at++];
+  record->node = node & RECORD_NODE_MASK;
+  record->flags = (uint8_t)(node >> RECORD_FLAG_SHIFT);
+  uint64_t delta = get_varint(reader);
+  uint64_t offset = reader->offset + ((delta >> 1) ^ (0 - (delta & 1)));
+  reader->offset = offset;
+  uint64_t length = get_varint(reader);
+  uint64_t value = 0;
+  TokenType token_type = (TokenType)(token_byte & ~RECORD_OVERFLOW);
+  if (has_list(type)) {
+    record->list_count = get_varint(reader);
+  } else if (token_type == TOKEN_INT) {
+    value = get_varint(reader);
+  }
+  uint64_t skip = token_type == TOKEN_STRING;
+
+  if (reader->failed || record->node != type || token_type >= TOKEN_COUNT ||
+      length > INT_MAX || offset > reader->length ||
+      skip + length > reader->length - offset) {
+    reader->failed = 1;
+    return 0;
+  }
+
+  token->type = token_type;
+  token->start = reader->input + offset + skip;
+  token->length = (int)length;
+  token->offset = (size_t)offset;
+  token->value = value;
+  token->overflow = (token_byte & RECORD_OVERFLOW) != 0;
+  token->symbol = SYMBOL_NONE;
+  if (token_type == TOKEN_IDENT) {
+    token->symbol = symbol_cache_intern(&reader->symbols,
+                                        default_symbol_table(), token->start,
+                                        token->length);
+  }
+  return 1;
+}
+
+// Like the writer, the reader keeps its own stack, so neither a long chain
+// nor a crafted file can overflow the C stack. Each entry is the slot the
+// next node read is stored in.
+static void push_slot(Reader *reader, Node **slot) {
+  *slot = NULL;
+  if (reader->pending_count >= reader->pending_capacity) {
+    uint32_t old_capacity = reader->pending_capacity;
+    reader->pending_capacity = GROW_CAPACITY(old_capacity);
+    reader->pending = GROW_ARRAY(Node **, reader->pending, old_capacity,
+                                 reader->pending_capacity);
+  }
+  reader->pending[reader->pending_count++] = slot;
+}
+
+// Pushes slot if the record flags the child it is for.
+static void push_child(Reader *reader, const CacheRecord *record, int flag,
+                       Node **slot) {
+  if (record->flags & flag) {
+    push_slot(reader, slot);
+  } else {
+    *slot = NULL;
+  }
+}
+
+// Makes a list with the length in record and pushes its items' slots.
+static NodeList push_list_slots(Reader *reader, const CacheRecord *record) {
+  NodeList list = {NULL, 0};
+  // Every item and every slot already pending takes a record of its own,
+  // so a longer list is corrupt; this also bounds the stack.
+  if (record->list_count + reader->pending_count >
+      reader->count - reader->next) {
+    reader->failed = 1;
+    return list;
+  }
+
+  list = new_node_list(reader->arena, (int)record->list_count);
+  for (int i = list.count - 1; i >= 0; i--) {
+    push_slot(reader, &list.items[i]);
+  }
+  return list;
+}
+
+// Reads the next record into a node whose children are still to be read,
+// pushing their slots so that they are filled in field order.
+static Node *read_node(Reader *reader) {
+  if (reader->failed || reader->at >= reader->size) {
+    reader->failed = 1;
+    return NULL;
+  }
+
+  NodeType type = (NodeType)(reader->data[reader->at] & RECORD_NODE_MASK);
+  CacheRecord record;
+  Token token;
+  if (!next_record(reader, type, &record, &token)) {
+    return NULL;
+  }
+
+  switch (type) {
+  case NODE_LET_STATEMENT: {
+    Node *node = new_let_statement_node(reader->arena, token);
+    LetStatement *stmt = AS_LET_STATEMENT(node);
+    if (record.flags & RECORD_FIRST) {
+      CacheRecord name_record;
+      Token name;
+      if (next_record(reader, NODE_IDENTIFIER, &name_record, &name)) {
+        stmt->name = AS_IDENTIFIER(new_identifier_node(reader->arena, name));
+      }
+    }
+    push_child(reader, &record, RECORD_SECOND, &stmt->value);
+    return node;
+  }
+  case NODE_RETURN_STATEMENT: {
+    Node *node = new_return_statement_node(reader->arena, token);
+    push_child(reader, &record, RECORD_FIRST,
+               &AS_RETURN_STATEMENT(node)->return_value);
+    return node;
+  }
+  case NODE_EXPRESSION_STATEMENT: {
+    Node *node = new_expression_node(reader->arena, token, NULL);
+    push_child(reader, &record, RECORD_FIRST,
+               &AS_EXPRESSION_STATEMENT(node)->expression);
+    return node;
+  }
+  case NODE_IDENTIFIER:
+    return new_identifier_node(reader->arena, token);
+  case NODE_INTEGER_LITERAL:
+    return new_integer_literal(reader->arena, token, token.value);
+  case NODE_BOOLEAN_LITERAL:
+    return new_boolean_literal(reader->arena, token);
+  case NODE_STRING_LITERAL:
+    return new_string_literal(reader->arena, token);
+  case NODE_BLOCK_STATEMENT: {
+    Node *node = new_block_statement_node(reader->arena, token,
+                                          push_list_slots(reader, &record));
+    AS_BLOCK_STATEMENT(node)->unparsed =
+        (record.flags & RECORD_UNPARSED) != 0;
+    return node;
+  }
+  case NODE_PREFIX_EXPRESSION: {
+    Node *node = new_prefix_expression_node(reader->arena, token, NULL);
+    push_child(reader, &record, RECORD_FIRST,
+               &AS_PREFIX_EXPRESSION(node)->right);
+    return node;
+  }
+  case NODE_INFIX_EXPRESSION: {
+    Node *node = new_infix_expression_node(reader->arena, token, NULL, NULL);
+    InfixExpression *expression = AS_INFIX_EXPRESSION(node);
+    push_child(reader, &record, RECORD_SECOND, &expression->right);
+    push_child(reader, &record, RECORD_FIRST, &expression->left);
+    return node;
+  }
+  case NODE_IF_EXPRESSION: {
+    Node *node =
+        new_if_expression_node(reader->arena, token, NULL, NULL, NULL);
+    IfExpression *expression = AS_IF_EXPRESSION(node);
+    push_child(reader, &record, RECORD_THIRD, &expression->alternative);
+    push_child(reader, &record, RECORD_SECOND, &expression->consequence);
+    push_child(reader, &record, RECORD_FIRST, &expression->condition);
+    return node;
+  }
+  case NODE_FUNCTION_LITERAL: {
+    Node *node = new_function_literal(reader->arena, token,
+                                      (NodeList){NULL, 0}, NULL);
+    FunctionLiteral *function = AS_FUNCTION_LITERAL(node);
+    push_child(reader, &record, RECORD_FIRST, &function->body);
+    function->parameters = push_list_slots(reader, &record);
+    return node;
+  }
+  case NODE_CALL_EXPRESSION: {
+    Node *node = new_call_expression_node(reader->arena, token, NULL,
+                                          (NodeList){NULL, 0});
+    CallExpression *call = AS_CALL_EXPRESSION(node);
+    call->arguments = push_list_slots(reader, &record);
+    push_child(reader, &record, RECORD_FIRST, &call->function);
+    return node;
+  }
+  case NODE_ARRAY_LITERAL:
+    return new_array_literal(reader->arena, token,
+                             push_list_slots(reader, &record));
+  case NODE_INDEX_EXPRESSION: {
+    Node *node = new_index_expression_node(reader->arena, token, NULL, NULL);
+    IndexExpression *expression = AS_INDEX_EXPRESSION(node);
+    push_child(reader, &record, RECORD_SECOND, &expression->index);
+    push_child(reader, &record, RECORD_FIRST, &expression->left);
+    return node;
+  }
+  default:
+    // Programs only appear at the root; anything else is corrupt.
+    reader->failed = 1;
+    return NULL;
+  }
+}
+
+static Node *read_program(Reader *reader) {
+  CacheRecord record;
+  Token token;
+  if (!next_record(reader, NODE_PROGRAM, &record, &token) ||
+      record.list_count > reader->count) {
+    return NULL;
+  }
+
+  Node *program = new_program_node();
+  reader->arena = AS_PROGRAM(program)->arena;
+  for (uint64_t i = 0; i < record.list_count && !reader->failed; i++) {
+    Node *statement;
+    push_slot(reader, &statement);
+    while (reader->pending_count > 0 && !reader->failed) {
+      Node **slot = reader->pending[--reader->pending_count];
+      *slot = read_node(reader);
+    }
+    reader->pending_count = 0;
+    if (statement != NULL) {
+      add_statement(AS_PROGRAM(program), statement);
+    }
+  }
+  FREE_ARRAY(Node **, reader->pending, reader->pending_capacity);
+
+  if (reader->failed || reader->next != reader->count ||
+      reader->at != reader->size) {
+    program_free(program);
+    return NULL;
+  }
+  return program;
+}
+
+Node *cache_load(const char *directory, const char *input, size_t length) {
+  uint64_t check;
+  uint64_t hash = hash_source(input, length, &check);
+  sds path = entry_path(directory, hash);
+  int fd = open(path, O_RDONLY);
+  sdsfree(path);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(CacheHeader)) {
+    close(fd);
+    return NULL;
+  }
+  size_t size = (size_t)info.st_size;
+  void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return NULL;
+  }
+
+  // The check hash guards against a collision of the file name's hash.
+  const CacheHeader *header = data;
+  Node *program = NULL;
+  if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) == 0 &&
+      header->version == CACHE_FORMAT_VERSION && header->hash == hash &&
+      header->check == check && header->length == length) {
+    Reader reader;
+    reader.data = (const uint8_t *)data + sizeof(CacheHeader);
+    reader.size = size - sizeof(CacheHeader);
+    reader.at = 0;
+    reader.offset = 0;
+    reader.count = header->record_count;
+    reader.next = 0;
+    reader.input = input;
+    reader.length = length;
+    symbol_cache_init(&reader.symbols);
+    reader.pending = NULL;
+    reader.pending_count = 0;
+    reader.pending_capacity = 0;
+    reader.failed = 0;
+    program = read_program(&reader);
+  }
+
+  munmap(data, size);
+  return program;
+}
+
+int cache_store(const char *directory, const char *input, size_t length,
+                Node *program) {
+  Writer writer = {NULL, 0, 0, 0, 0, NULL, 0, 0};
+  write_program(&writer, program);
+
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+  header.version = CACHE_FORMAT_VERSION;
+  header.record_count = writer.count;
+  header.hash = hash_source(input, length, &header.check);
+  header.length = length;
+
+  // Write to a private name and rename into place, so a concurrent loader
+  // sees either the old entry or the complete new one.
+  sds path = entry_path(directory, header.hash);
+  sds temporary = sdscatprintf(sdsdup(path), ".%ld.tmp", (long)getpid());
+  int result = -1;
+  FILE *file = fopen(temporary, "wb");
+  if (file != NULL) {
+    int written =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(writer.data, 1, writer.size, file) == writer.size;
+    if (fclose(file) == 0 && written) {
+      result = rename(temporary, path);
+    }
+    if (result < 0) {
+      int saved_errno = errno;
+      remove(temporary);
+      errno = saved_errno;
+    }
+  }
+
+  sdsfree(temporary);
+  sdsfree(path);
+  FREE_ARRAY(uint8_t, writer.data, writer.capacity);
+  return result;
+}
@@ -0,0 +1,31 @@
+#ifndef cache_h
+#define cache_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+
+// Bump whenever the entry layout or the AST changes: entries written with
+// another version are ignored, and overwritten by the next store.
+#define CACHE_FORMAT_VERSION 5
+
+// Parsed programs kept in a directory, one file per source named after a
+// hash of its bytes, so unchanged scripts skip lexing and parsing at
+// startup. An entry holds each node's token as an offset into the source
+// rather than a pointer, so it can be mapped anywhere, and loading only
+// rebuilds the nodes and re-interns identifiers. Records are packed, with
+// offsets as varint deltas, so an entry is smaller than its source.
+// A second, independent hash of the source is checked on load, so a
+// collision of the first does not return another program. Only programs
+// that parsed without errors should be stored.
+uint64_t cache_hash(const char* input, size_t length);
+// Returns the cached program for input, with tokens pointing into input, or
+// NULL if there is no entry or it is unreadable, stale or from another
+// format version.
+Node* cache_load(const char* directory, const char* input, size_t length);
+// Stores program, parsed from input. Returns 0 on success and -1 on
+// failure, with errno set.
+int cache_store(const char* directory, const char* input, size_t length,
+                Node* program);
+
+#endif
@@ -0,0 +1,201 @@
+#include "corpus.h"
+
+static const char *names[CORPUS_KIND_COUNT] = {
+    [CORPUS_LETS] = "lets",
+    [CORPUS_EXPRESSIONS] = "expressions",
+    [CORPUS_NESTING] = "nesting",
+    [CORPUS_STRINGS] = "strings",
+    [CORPUS_IDENTIFIERS] = "identifiers",
+};
+
+static const char *identifiers[] = {
+    "x",     "y",      "count", "total",  "index", "value",
+    "left",  "right",  "acc",   "result", "item",  "first",
+    "width", "height", "next",  "limit",
+};
+
+#define IDENTIFIER_COUNT (int)(sizeof(identifiers) / sizeof(identifiers[0]))
+
+static const char *operators[] = {" + ", " - ", " * ", " / ",
+                                  " < ", " > ", " == ", " != "};
+
+// xorshift64*: fixed arithmetic, so the corpus does not depend on the C
+// library's rand().
+typedef struct {
+  uint64_t state;
+} Random;
+
+static uint64_t next_random(Random *random) {
+  random->state ^= random->state >> 12;
+  random->state ^= random->state << 25;
+  random->state ^= random->state >> 27;
+  return random->state * 2685821657736338717u;
+}
+
+// A number in [0, n).
+static int below(Random *random, int n) {
+  return (int)(next_random(random) >> 33) % n;
+}
+
+static sds cat_identifier(sds s, Random *random) {
+  return sdscat(s, identifiers[below(random, IDENTIFIER_COUNT)]);
+}
+
+static sds cat_expression(sds s, Random *random, int depth);
+
+// A comma-separated list of up to four expressions.
+static sds cat_list(sds s, Random *random, int depth) {
+  int count = below(random, 5);
+  for (int i = 0; i < count; i++) {
+    if (i > 0) {
+      s = sdscat(s, ", ");
+    }
+    s = cat_expression(s, random, depth);
+  }
+  return s;
+}
+
+static sds cat_operand(sds s, Random *random) {
+  switch (below(random, 6)) {
+  case 0:
+    return sdscatprintf(s, "%d", below(random, 100000));
+  case 1:
+    return sdscat(s, below(random, 2) ? "true" : "false");
+  case 2:
+    return sdscat(s, "\"text\"");
+  default:
+    return cat_identifier(s, random);
+  }
+}
+
+// An expression at most depth operators deep.
+static sds cat_expression(sds s, Random *random, int depth) {
+  if (depth == 0 || below(random, 4) == 0) {
+    return cat_operand(s, random);
+  }
+
+  switch (below(random, 8)) {
+  case 0:
+    s = sdscat(s, below(random, 2) ? "-" : "!");
+    return cat_expression(s, random, depth - 1);
+  case 1:
+    s = cat_identifier(s, random);
+    s = sdscat(s, "(");
+    s = cat_list(s, random, depth - 1);
+    return sdscat(s, ")");
+  case 2:
+    s = sdscat(s, "[");
+    s = cat_list(s, random, depth - 1);
+    return sdscat(s, "]");
+  case 3:
+    s = cat_identifier(s, random);
+    s = sdscat(s, "[");
+    s = cat_expression(s, random, depth - 1);
+    return sdscat(s, "]");
+  case 4:
+    s = sdscat(s, "(");
+    s = cat_expression(s, random, depth - 1);
+    return sdscat(s, ")");
+  default:
+    s = cat_expression(s, random, depth - 1);
+    s = sdscat(s, operators[below(random, 8)]);
+    return cat_expression(s, random, depth - 1);
+  }
+}
+
+static sds cat_let(sds s, Random *random) {
+  s = sdscat(s, "let ");
+  s = cat_identifier(s, random);
+  s = sdscat(s, " = ");
+  s = cat_expression(s, random, 2);
+  return sdscat(s, ";\n");
+}
+
+// A function whose body nests depth more functions and ifs.
+static sds cat_nested(sds s, Random *random, int depth) {
+  if (depth == 0) {
+    return cat_expression(s, random, 2);
+  }
+
+  if (below(random, 2)) {
+    s = sdscat(s, "fn(");
+    s = cat_identifier(s, random);
+    s = sdscat(s, ") { ");
+    s = cat_nested(s, random, depth - 1);
+    return sdscat(s, " }");
+  }
+  s = sdscat(s, "if (");
+  s = cat_expression(s, random, 1);
+  s = sdscat(s, ") { ");
+  s = cat_nested(s, random, depth - 1);
+  s = sdscat(s, " } else { ");
+  s = cat_identifier(s, random);
+  return sdscat(s, " }");
+}
+
+static sds cat_string(sds s, Random *random) {
+  static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz"
+                                 "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
+                                 " .,:;!?-+*/(){}[]";
+  int length = 64 + below(random, 4096 - 64);
+
+  s = sdscat(s, "let ");
+  s = cat_identifier(s, random);
+  s = sdscat(s, " = \"");
+  for (int i = 0; i < length; i++) {
+    char c = alphabet[below(random, (int)sizeof(alphabet) - 1)];
+    s = sdscatlen(s, &c, 1);
+  }
+  return sdscat(s, "\";\n");
+}
+
+// Names are numbered, so each is new; the number is spelled out in
+// letters so that names differ from their first bytes.
+static sds cat_unique_name(sds s, uint64_t number) {
+  char name[16];
+  int length = 0;
+  do {
+    name[length++] = (char)('a' + number % 26);
+    number /= 26;
+  } while (number > 0);
+  return sdscatlen(sdscat(s, "n_"), name, (size_t)length);
+}
+
+const char *corpus_name(CorpusKind kind) { return names[kind]; }
+
+sds corpus_generate(CorpusKind kind, size_t size, uint64_t seed) {
+  Random random = {seed * 2 + 1};
+  sds s = sdsempty();
+  uint64_t statement = 0;
+
+  while (sdslen(s) < size) {
+    switch (kind) {
+    case CORPUS_LETS:
+      s = cat_let(s, &random);
+      break;
+    case CORPUS_EXPRESSIONS:
+      s = cat_expression(s, &random, 8);
+      s = sdscat(s, ";\n");
+      break;
+    case CORPUS_NESTING:
+      s = sdscat(s, "let f = ");
+      s = cat_nested(s, &random, 32 + below(&random, 32));
+      s = sdscat(s, ";\n");
+      break;
+    case CORPUS_STRINGS:
+      s = cat_string(s, &random);
+      break;
+    case CORPUS_IDENTIFIERS:
+      s = sdscat(s, "let ");
+      s = cat_unique_name(s, statement);
+      s = sdscat(s, " = ");
+      s = cat_unique_name(s, statement / 2);
+      s = sdscat(s, " + 1;\n");
+      break;
+    case CORPUS_KIND_COUNT:
+      return s;
+    }
+    statement++;
+  }
+  return s;
+}
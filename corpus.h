@@ -0,0 +1,30 @@
+#ifndef corpus_h
+#define corpus_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sds.h"
+
+// Shapes of synthetic Monkey source, each stressing a different part of
+// the front end.
+typedef enum {
+    // Short let statements over a small set of names.
+    CORPUS_LETS,
+    // Long expressions mixing operators, calls, arrays and indexing.
+    CORPUS_EXPRESSIONS,
+    // Functions and ifs nested dozens of levels deep.
+    CORPUS_NESTING,
+    // Few tokens, most bytes inside string literals of up to 4 KB.
+    CORPUS_STRINGS,
+    // Every name distinct, so the symbol table keeps growing.
+    CORPUS_IDENTIFIERS,
+    CORPUS_KIND_COUNT,
+} CorpusKind;
+
+const char* corpus_name(CorpusKind kind);
+// Returns about size bytes of kind, made of whole statements that parse
+// without errors. The same kind, size and seed always give the same bytes,
+// on any platform, so results can be compared between commits.
+sds corpus_generate(CorpusKind kind, size_t size, uint64_t seed);
+
+#endif
@@ -0,0 +1,100 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "document.h"
+#include "parser.h"
+#include "sds.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *snippet = "let counter = 10;\n"
+                             "let total = counter;\n"
+                             "return total;\n"
+                             "counter;\n";
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static sds make_input(size_t size) {
+  sds input = sdsempty();
+  while (sdslen(input) < size) {
+    input = sdscat(input, snippet);
+  }
+  return input;
+}
+
+// Time to parse the whole text from scratch, which is what every
+// keystroke costs without a Document.
+static double full_parse(const char *text, size_t length) {
+  double start = now_ns();
+  Parser parser;
+  parser_init(&parser, text, length);
+  Node *program = parser_parse_program(&parser);
+  double elapsed = now_ns() - start;
+
+  program_free(program);
+  parser_free(&parser);
+  return elapsed;
+}
+
+// Jumps to an identifier somewhere in the file and types a few characters
+// into it, then deletes them again, like someone editing in several
+// places. The first edit at a site pays for moving the document's gap
+// there; the keystrokes after it are what typing costs.
+static void bench_size(size_t size) {
+  sds input = make_input(size);
+  Document document;
+  document_init(&document, input, sdslen(input));
+
+  int sites = 50;
+  int keystrokes = 40;
+  double jumps = 0;
+  double typing = 0;
+  unsigned seed = 1;
+  for (int i = 0; i < sites; i++) {
+    seed = seed * 1103515245 + 12345;
+    size_t offset = (seed >> 4) % sdslen(input);
+    char *name = strstr(input + offset, "counter");
+    if (name == NULL) {
+      name = strstr(input, "counter");
+    }
+    size_t at = (size_t)(name - input) + 3;
+
+    double start = now_ns();
+    document_edit(&document, at, at, "x", 1);
+    jumps += now_ns() - start;
+
+    start = now_ns();
+    for (int j = 1; j < keystrokes / 2; j++) {
+      document_edit(&document, at + j, at + j, "x", 1);
+    }
+    for (int j = keystrokes / 2; j > 0; j--) {
+      document_edit(&document, at + j - 1, at + j, "", 0);
+    }
+    typing += now_ns() - start;
+  }
+  double keystroke = typing / (sites * (keystrokes - 1));
+  double full = full_parse(input, sdslen(input));
+
+  printf("%10zu bytes  keystroke %8.0f ns  jump %10.0f ns  "
+         "full parse %12.0f ns\n",
+         sdslen(input), keystroke, jumps / sites, full);
+  fflush(stdout);
+
+  document_free(&document);
+  sdsfree(input);
+}
+
+int main() {
+  size_t sizes[] = {10000, 100000, 1000000, 10000000};
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    bench_size(sizes[i]);
+  }
+
+  return 0;
+}
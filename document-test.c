@@ -0,0 +1,207 @@
+#include "document.h"
+#include "lexer.h"
+#include "parser.h"
+#include "sds.h"
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cmocka.h>
+
+// Lexes and parses the document's text from scratch and checks that the
+// incremental result is the same: tokens, program and errors.
+static void assert_matches_full_parse(Document *document) {
+  sds text = document_text(document);
+  size_t length = sdslen(text);
+
+  Lexer lexer;
+  lexer_init(&lexer, text, length);
+  for (size_t i = 0;; i++) {
+    Token expected = lexer_next_token(&lexer);
+    assert_true(i < document_token_count(document));
+    Token actual = document_token(document, i);
+
+    assert_int_equal(actual.type, expected.type);
+    assert_int_equal(actual.offset, expected.offset);
+    assert_int_equal(actual.length, expected.length);
+    assert_memory_equal(actual.start, expected.start, expected.length);
+    assert_int_equal(actual.symbol, expected.symbol);
+    assert_true(actual.value == expected.value);
+
+    if (expected.type == TOKEN_EOF) {
+      assert_int_equal(i + 1, document_token_count(document));
+      break;
+    }
+  }
+
+  Parser parser;
+  parser_init(&parser, text, length);
+  Node *program = parser_parse_program(&parser);
+
+  sds expected = node_to_string(program);
+  sds actual = node_to_string(document_program(document));
+  assert_string_equal(actual, expected);
+  sdsfree(expected);
+  sdsfree(actual);
+
+  int expected_count;
+  int actual_count;
+  ParseError *expected_errors = parser_get_errors(&parser, &expected_count);
+  ParseError *actual_errors = document_errors(document, &actual_count);
+  assert_int_equal(actual_count, expected_count);
+  for (int i = 0; i < expected_count; i++) {
+    assert_int_equal(actual_errors[i].code, expected_errors[i].code);
+    assert_int_equal(actual_errors[i].expected, expected_errors[i].expected);
+    assert_int_equal(actual_errors[i].got, expected_errors[i].got);
+    assert_int_equal(actual_errors[i].offset, expected_errors[i].offset);
+  }
+
+  program_free(program);
+  parser_free(&parser);
+  sdsfree(text);
+}
+
+static void edit(Document *document, size_t start, size_t end,
+                 const char *replacement) {
+  document_edit(document, start, end, replacement, strlen(replacement));
+  assert_matches_full_parse(document);
+}
+
+static void test_edits_match_full_parse(void **state) {
+  (void)state;
+
+  const char *input = "let x = 5;\n"
+                      "let y = 10;\n"
+                      "foobar;\n"
+                      "return 7;\n"
+                      "42;\n";
+  Document document;
+  document_init(&document, input, strlen(input));
+  assert_matches_full_parse(&document);
+
+  // Rename x, then insert and delete whole statements.
+  edit(&document, 4, 5, "answer");
+  edit(&document, 0, 0, "let first = 1;\n");
+  edit(&document, strlen("let first = 1;\n"), strlen("let first = 1;\n"),
+       "baz;\n");
+  edit(&document, 0, strlen("let first = 1;\n"), "");
+
+  // Opening a string swallows everything after it; closing it again
+  // brings the old tokens back.
+  edit(&document, 0, 0, "\"");
+  edit(&document, 0, 1, "");
+
+  // Errors appear and disappear.
+  edit(&document, 4, 4, "=");
+  edit(&document, 4, 5, "");
+
+  // Edits at the very end, and replacing everything.
+  size_t length = document_length(&document);
+  edit(&document, length, length, "x");
+  edit(&document, length + 1, length + 1, "y;");
+  edit(&document, 0, document_length(&document), "let z = 1; z;");
+  edit(&document, 0, document_length(&document), "");
+  edit(&document, 0, 0, "1;2;3;");
+
+  document_free(&document);
+}
+
+static void test_random_edits_match_full_parse(void **state) {
+  (void)state;
+
+  // Fragments chosen to split and merge tokens, open strings and cause
+  // parse errors.
+  const char *fragments[] = {
+      "let ", "x",    "=", "5",  ";",   "\"", " ",  "\n",         "!",
+      "foo",  "1234", "",  "==", "a b", "return ",  "let x = 1;\n",
+  };
+  int fragment_count = sizeof(fragments) / sizeof(fragments[0]);
+
+  const char *input = "let a = 1;\nlet b = 2;\nc;\nreturn d;\n\"s\";\n";
+  Document document;
+  document_init(&document, input, strlen(input));
+
+  unsigned seed = 12345;
+  for (int i = 0; i < 2000; i++) {
+    seed = seed * 1103515245 + 12345;
+    size_t length = document_length(&document);
+    size_t start = (seed >> 8) % (length + 1);
+    seed = seed * 1103515245 + 12345;
+    size_t end = start + (seed >> 8) % 4;
+    seed = seed * 1103515245 + 12345;
+    const char *fragment = fragments[(seed >> 8) % fragment_count];
+
+    // Keep the text from growing without bound.
+    if (length > 400) {
+      end = start + 40;
+      fragment = "";
+    }
+    edit(&document, start, end, fragment);
+  }
+
+  document_free(&document);
+}
+
+static void test_edit_reuses_statements(void **state) {
+  (void)state;
+
+  sds input = sdsempty();
+  for (int i = 0; i < 1000; i++) {
+    input = sdscatprintf(input, "let value_%d = %d;\n", i, i);
+  }
+
+  Document document;
+  document_init(&document, input, sdslen(input));
+  Program *program = AS_PROGRAM(document_program(&document));
+  assert_int_equal(program->statement_count, 1000);
+  Node *before = program->statements[100];
+  Node *after = program->statements[900];
+
+  // Rename one variable in the middle of the file.
+  size_t offset = (size_t)(strstr(input, "value_500") - input);
+  document_edit(&document, offset, offset + 5, "v", 1);
+  assert_matches_full_parse(&document);
+  program = AS_PROGRAM(document_program(&document));
+
+  assert_true(document.relexed_tokens <= 3);
+  assert_true(document.reparsed_statements <= 2);
+  assert_ptr_equal(program->statements[100], before);
+  assert_ptr_equal(program->statements[900], after);
+
+  // Reused statements still point at their text, and their offsets map to
+  // the edited text.
+  Token name = AS_LET_STATEMENT(after)->name->token;
+  assert_true(token_literal_equals(name, "value_900"));
+  sds text = document_text(&document);
+  size_t expected = (size_t)(strstr(text, "value_900") - text);
+  assert_int_equal(document_offset(&document, name.offset), expected);
+
+  // Typing further along only moves what lies between the two edits.
+  offset = expected;
+  document_edit(&document, offset, offset, "x", 1);
+  assert_matches_full_parse(&document);
+  assert_true(document.relexed_tokens <= 3);
+  assert_true(document.reparsed_statements <= 2);
+  program = AS_PROGRAM(document_program(&document));
+  assert_ptr_equal(program->statements[100], before);
+
+  Position position = document_position(&document, offset);
+  assert_int_equal(position.line, 901);
+  assert_int_equal(position.column, 5);
+
+  document_free(&document);
+  sdsfree(text);
+  sdsfree(input);
+}
+
+int main(void) {
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_edits_match_full_parse),
+      cmocka_unit_test(test_random_edits_match_full_parse),
+      cmocka_unit_test(test_edit_reuses_statements),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
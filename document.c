@@ -0,0 +1,612 @@
+#include "document.h"
+#include "memory.h"
+#include "tokenize.h"
+#include <limits.h>
+#include <string.h>
+
+// A statement before an edit is only reused if the parser cannot have
+// looked at a changed token while parsing it. Statements look at most one
+// token past their own; the second is a safety margin.
+#define REPARSE_LOOKAHEAD 2
+
+// Moves tokens by delta bytes in the text buffer, and from old_text to
+// new_text when the buffer itself was reallocated.
+typedef struct {
+  const char *old_text;
+  const char *new_text;
+  ptrdiff_t delta;
+} Rebase;
+
+static void rebase_token(Token *token, void *context) {
+  Rebase *rebase = context;
+  token->start =
+      rebase->new_text + (token->start - rebase->old_text) + rebase->delta;
+  token->offset = (size_t)((ptrdiff_t)token->offset + rebase->delta);
+}
+
+static void free_statement(DocumentStatement *statement) {
+  if (--statement->arena->statements == 0) {
+    arena_free(&statement->arena->arena);
+    FREE(DocumentArena, statement->arena);
+  }
+  FREE_ARRAY(ParseError, statement->errors, statement->error_count);
+}
+
+static size_t text_gap(const Document *document) {
+  return document->gap_end - document->gap_start;
+}
+
+static size_t token_gap(const Document *document) {
+  return document->token_gap_end - document->token_gap_start;
+}
+
+static size_t statement_gap(const Document *document) {
+  return document->statement_gap_end - document->statement_gap_start;
+}
+
+size_t document_length(const Document *document) {
+  return document->text_capacity - text_gap(document);
+}
+
+size_t document_offset(const Document *document, size_t position) {
+  return position < document->gap_start ? position
+                                        : position - text_gap(document);
+}
+
+static size_t text_position(const Document *document, size_t offset) {
+  return offset < document->gap_start ? offset : offset + text_gap(document);
+}
+
+size_t document_token_count(const Document *document) {
+  return document->token_capacity - token_gap(document);
+}
+
+static Token *token_at(const Document *document, size_t index) {
+  if (index >= document->token_gap_start) {
+    index += token_gap(document);
+  }
+  return &document->tokens[index];
+}
+
+Token document_token(const Document *document, size_t index) {
+  Token token = *token_at(document, index);
+  token.offset = document_offset(document, token.offset);
+  return token;
+}
+
+static size_t statement_count(const Document *document) {
+  return document->statement_capacity - statement_gap(document);
+}
+
+static DocumentStatement *statement_at(const Document *document,
+                                       size_t index) {
+  if (index >= document->statement_gap_start) {
+    index += statement_gap(document);
+  }
+  return &document->statements[index];
+}
+
+// Index of the statement's first token; past the last statement, the index
+// of TOKEN_EOF.
+static size_t statement_token(const Document *document, size_t index) {
+  if (index >= statement_count(document)) {
+    return document_token_count(document) - 1;
+  }
+  size_t position = statement_at(document, index)->first_token;
+  return position < document->token_gap_start ? position
+                                              : position - token_gap(document);
+}
+
+// Text offset where the lexer stopped reading for a token, including a
+// string's closing quote. A string's text cannot contain a quote, so if it
+// stops short of the end of the text it was closed.
+static size_t token_end(const Document *document, size_t index) {
+  const Token *token = token_at(document, index);
+  size_t position = (size_t)(token->start - document->text);
+  size_t end = document_offset(document, position) + (size_t)token->length;
+  if (token->type == TOKEN_STRING && end < document_length(document)) {
+    end++;
+  }
+  return end;
+}
+
+// Index of the first token at or after a text offset.
+static size_t first_token_at(const Document *document, size_t offset) {
+  size_t low = 0;
+  size_t high = document_token_count(document);
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (document_offset(document, token_at(document, middle)->offset) <
+        offset) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+// Index of the first statement at or after from whose token range, plus
+// lookahead, reaches token.
+static size_t first_statement_reaching(const Document *document, size_t from,
+                                       size_t token) {
+  size_t low = from;
+  size_t high = statement_count(document);
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (statement_token(document, middle + 1) + REPARSE_LOOKAHEAD <= token) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+// Index of the first statement at or after from that starts at or after
+// token.
+static size_t first_statement_from(const Document *document, size_t from,
+                                   size_t token) {
+  size_t low = from;
+  size_t high = statement_count(document);
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (statement_token(document, middle) < token) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+// Moves the gap of an array of size-byte elements to just before element
+// at.
+static void move_gap(void *data, size_t size, size_t *gap_start,
+                     size_t *gap_end, size_t at) {
+  char *bytes = data;
+  if (at < *gap_start) {
+    size_t count = *gap_start - at;
+    memmove(bytes + (*gap_end - count) * size, bytes + at * size,
+            count * size);
+    *gap_start -= count;
+    *gap_end -= count;
+  } else if (at > *gap_start) {
+    size_t count = at - *gap_start;
+    memmove(bytes + *gap_start * size, bytes + *gap_end * size, count * size);
+    *gap_start += count;
+    *gap_end += count;
+  }
+}
+
+// Returns a copy of an array of size-byte elements whose gap holds at least
+// needed elements; the elements after the gap go to the end of the copy.
+// The caller frees the old array once nothing points into it.
+static void *grow_gap(const void *data, size_t size, size_t *capacity,
+                      size_t gap_start, size_t *gap_end, size_t needed) {
+  size_t used = *capacity - (*gap_end - gap_start);
+  size_t after = *capacity - *gap_end;
+  size_t new_capacity = *capacity;
+  while (new_capacity - used < needed) {
+    new_capacity = GROW_CAPACITY(new_capacity);
+  }
+
+  char *grown = reallocate(NULL, 0, size * new_capacity);
+  if (gap_start > 0) {
+    memcpy(grown, data, size * gap_start);
+  }
+  if (after > 0) {
+    memcpy(grown + size * (new_capacity - after),
+           (const char *)data + size * *gap_end, size * after);
+  }
+  *capacity = new_capacity;
+  *gap_end = new_capacity - after;
+  return grown;
+}
+
+static void ensure_text_gap(Document *document, size_t needed) {
+  if (text_gap(document) >= needed) {
+    return;
+  }
+
+  char *old = document->text;
+  size_t old_capacity = document->text_capacity;
+  size_t old_end = document->gap_end;
+  document->text = grow_gap(old, 1, &document->text_capacity,
+                            document->gap_start, &document->gap_end, needed);
+
+  // Every token now points into the new buffer, and those after the gap
+  // have moved further along it.
+  Rebase before = {old, document->text, 0};
+  Rebase after = {old, document->text,
+                  (ptrdiff_t)(document->gap_end - old_end)};
+  size_t tokens = document_token_count(document);
+  for (size_t i = 0; i < tokens; i++) {
+    Token *token = token_at(document, i);
+    rebase_token(token,
+                 token->offset < document->gap_start ? &before : &after);
+  }
+  size_t statements = statement_count(document);
+  for (size_t i = 0; i < statements; i++) {
+    node_visit_tokens(statement_at(document, i)->node, rebase_token,
+                      i < document->statement_gap_start ? &before : &after);
+  }
+
+  FREE_ARRAY(char, old, old_capacity);
+}
+
+static void ensure_token_gap(Document *document, size_t needed) {
+  if (token_gap(document) >= needed) {
+    return;
+  }
+
+  Token *old = document->tokens;
+  size_t old_capacity = document->token_capacity;
+  size_t old_end = document->token_gap_end;
+  document->tokens =
+      grow_gap(old, sizeof(Token), &document->token_capacity,
+               document->token_gap_start, &document->token_gap_end, needed);
+
+  size_t moved = document->token_gap_end - old_end;
+  size_t statements = statement_count(document);
+  for (size_t i = document->statement_gap_start; i < statements; i++) {
+    statement_at(document, i)->first_token += moved;
+  }
+
+  FREE_ARRAY(Token, old, old_capacity);
+}
+
+static void ensure_statement_gap(Document *document, size_t needed) {
+  if (statement_gap(document) >= needed) {
+    return;
+  }
+
+  DocumentStatement *old = document->statements;
+  size_t old_capacity = document->statement_capacity;
+  document->statements = grow_gap(
+      old, sizeof(DocumentStatement), &document->statement_capacity,
+      document->statement_gap_start, &document->statement_gap_end, needed);
+  FREE_ARRAY(DocumentStatement, old, old_capacity);
+}
+
+// Moves all three gaps to just before a statement: the statement gap, the
+// token gap before its first token and the text gap after the previous
+// statement's last token. The statements in between, with their tokens
+// and text, move across the gaps.
+static void move_gaps(Document *document, size_t statement) {
+  size_t token = statement_token(document, statement);
+  size_t offset = token > 0 ? token_end(document, token - 1) : 0;
+
+  size_t from;
+  size_t to;
+  ptrdiff_t text_delta;
+  ptrdiff_t token_delta;
+  if (statement < document->statement_gap_start) {
+    from = statement;
+    to = document->statement_gap_start;
+    text_delta = (ptrdiff_t)text_gap(document);
+    token_delta = (ptrdiff_t)token_gap(document);
+  } else {
+    from = document->statement_gap_start;
+    to = statement;
+    text_delta = -(ptrdiff_t)text_gap(document);
+    token_delta = -(ptrdiff_t)token_gap(document);
+  }
+
+  Rebase rebase = {document->text, document->text, text_delta};
+  size_t last = statement_token(document, to);
+  for (size_t i = statement_token(document, from); i < last; i++) {
+    rebase_token(token_at(document, i), &rebase);
+  }
+  for (size_t i = from; i < to; i++) {
+    DocumentStatement *moved = statement_at(document, i);
+    node_visit_tokens(moved->node, rebase_token, &rebase);
+    moved->first_token =
+        (size_t)((ptrdiff_t)moved->first_token + token_delta);
+  }
+
+  move_gap(document->text, 1, &document->gap_start, &document->gap_end,
+           offset);
+  move_gap(document->tokens, sizeof(Token), &document->token_gap_start,
+           &document->token_gap_end, token);
+  move_gap(document->statements, sizeof(DocumentStatement),
+           &document->statement_gap_start, &document->statement_gap_end,
+           statement);
+}
+
+// Rebuilds the program's statement list and the flat error list from the
+// statements.
+static void collect(Document *document) {
+  if (document->collected) {
+    return;
+  }
+
+  Program *program = AS_PROGRAM(document->program);
+  program->statement_count = 0;
+  document->error_count = 0;
+
+  size_t count = statement_count(document);
+  for (size_t i = 0; i < count; i++) {
+    DocumentStatement *statement = statement_at(document, i);
+    if (statement->node != NULL) {
+      add_statement(program, statement->node);
+    }
+    size_t first = token_at(document, statement_token(document, i))->offset;
+    size_t offset = document_offset(document, first);
+
+    for (int j = 0; j < statement->error_count; j++) {
+      if (document->error_count >= document->error_capacity) {
+        int old_capacity = document->error_capacity;
+        document->error_capacity = GROW_CAPACITY(old_capacity);
+        document->errors =
+            GROW_ARRAY(ParseError, document->errors, old_capacity,
+                       document->error_capacity);
+      }
+      ParseError error = statement->errors[j];
+      error.offset += offset;
+      document->errors[document->error_count++] = error;
+    }
+  }
+
+  document->collected = 1;
+}
+
+void document_init(Document *document, const char *text, size_t length) {
+  // Start from an empty text, lexed to a lone EOF, and insert everything.
+  document->text_capacity = GROW_CAPACITY(0);
+  document->text = ALLOCATE(char, document->text_capacity);
+  document->gap_start = 0;
+  document->gap_end = document->text_capacity;
+
+  document->token_capacity = GROW_CAPACITY(0);
+  document->tokens = ALLOCATE(Token, document->token_capacity);
+  document->token_gap_start = 0;
+  document->token_gap_end = document->token_capacity - 1;
+  Lexer lexer;
+  lexer_init(&lexer, document->text + document->gap_end, 0);
+  lexer.base = document->gap_end;
+  document->tokens[document->token_gap_end] = lexer_next_token(&lexer);
+
+  document->statements = NULL;
+  document->statement_capacity = 0;
+  document->statement_gap_start = 0;
+  document->statement_gap_end = 0;
+
+  document->program = new_program_node();
+  document->errors = NULL;
+  document->error_count = 0;
+  document->error_capacity = 0;
+  document->collected = 0;
+  line_map_init(&document->lines, NULL, 0);
+
+  document_edit(document, 0, 0, text, length);
+}
+
+void document_edit(Document *document, size_t start, size_t end,
+                   const char *replacement, size_t length) {
+  size_t old_length = document_length(document);
+  if (end > old_length) {
+    end = old_length;
+  }
+  if (start > end) {
+    start = end;
+  }
+  ptrdiff_t delta = (ptrdiff_t)length - (ptrdiff_t)(end - start);
+
+  // Tokens that end before the edit cannot change. Lexing resumes where
+  // the last of them ended, and stops as soon as a new token starts where
+  // an old one after the edit did: from there on the lexer would see the
+  // same bytes from the same state.
+  size_t kept = first_token_at(document, start);
+  while (kept > 0 && token_end(document, kept - 1) >= start) {
+    kept--;
+  }
+  size_t resume = kept > 0 ? token_end(document, kept - 1) : 0;
+  size_t sync = first_token_at(document, end);
+
+  // Statements whose tokens, plus lookahead, all come before the first
+  // re-lexed token are kept as they are.
+  size_t reused = first_statement_reaching(document, 0, kept);
+
+  // With the gaps in front of the first statement to re-parse, the text
+  // from there to the edit moves up against the replacement, which ends
+  // where the bytes after the edit already are; those stay put.
+  move_gaps(document, reused);
+  size_t first = document->token_gap_start;
+  if (delta > 0) {
+    ensure_text_gap(document, (size_t)delta);
+  }
+  size_t boundary = document->gap_start;
+  size_t right = (size_t)((ptrdiff_t)document->gap_end - delta);
+  memmove(document->text + right, document->text + document->gap_end,
+          start - boundary);
+  if (length > 0) {
+    memcpy(document->text + right + (start - boundary), replacement, length);
+  }
+  Rebase shift = {document->text, document->text, -delta};
+  for (size_t i = first; i < kept; i++) {
+    rebase_token(token_at(document, i), &shift);
+  }
+  document->gap_end = right;
+
+  Lexer lexer;
+  size_t from = right + (resume - boundary);
+  lexer_init(&lexer, document->text + from, document->text_capacity - from);
+  lexer.base = from;
+  size_t edited = right + (start - boundary) + length;
+  size_t old_count = document_token_count(document);
+  TokenArray tokens;
+  token_array_init(&tokens);
+  while (1) {
+    Token token = lexer_next_token(&lexer);
+    if (token.offset >= edited) {
+      while (sync < old_count &&
+             token_at(document, sync)->offset < token.offset) {
+        sync++;
+      }
+      if (sync < old_count &&
+          token_at(document, sync)->offset == token.offset) {
+        break;
+      }
+    }
+
+    token_array_push(&tokens, token);
+    if (token.type == TOKEN_EOF) {
+      sync = old_count;
+      break;
+    }
+  }
+  document->relexed_tokens = tokens.count;
+
+  // Old statements that start at or after the resync point can be picked
+  // up again once parsing reaches their first token.
+  size_t candidate = first_statement_from(document, reused, sync);
+
+  // The kept tokens and the new ones go right before the old tokens from
+  // the resync point on.
+  size_t moved = kept - first;
+  size_t needed = moved + tokens.count;
+  if (needed > sync - first) {
+    ensure_token_gap(document, needed - (sync - first));
+  }
+  size_t at = sync + token_gap(document) - needed;
+  memmove(document->tokens + at, document->tokens + document->token_gap_end,
+          sizeof(Token) * moved);
+  if (tokens.count > 0) {
+    memcpy(document->tokens + at + moved, tokens.tokens,
+           sizeof(Token) * tokens.count);
+  }
+  document->token_gap_end = at;
+  token_array_free(&tokens);
+
+  Parser parser;
+  parser_init_tokens(&parser, document->tokens + document->token_gap_end,
+                     document->token_capacity - document->token_gap_end,
+                     document->text, document->text_capacity);
+  DocumentArena *generation = ALLOCATE(DocumentArena, 1);
+  arena_init(&generation->arena);
+  generation->statements = 0;
+  parser.arena = &generation->arena;
+  // Statements keep their own errors, which have to survive being reparsed
+  // in later edits, so none can be dropped.
+  parser.max_errors = INT_MAX;
+  size_t old_statements = statement_count(document);
+  DocumentStatement *parsed = NULL;
+  int parsed_count = 0;
+  int parsed_capacity = 0;
+
+  while (parser_peek(&parser, 0)->type != TOKEN_EOF) {
+    size_t index = document->token_gap_end + parser_token_index(&parser);
+    while (candidate < old_statements &&
+           statement_at(document, candidate)->first_token < index) {
+      candidate++;
+    }
+    if (candidate < old_statements &&
+        statement_at(document, candidate)->first_token == index) {
+      break;
+    }
+
+    int error_start = parser.error_count;
+    DocumentStatement statement;
+    statement.node = parser_parse_statement(&parser);
+    statement.arena = generation;
+    generation->statements++;
+    statement.first_token = index;
+    statement.error_count = parser.error_count - error_start;
+    statement.errors = NULL;
+    if (statement.error_count > 0) {
+      statement.errors = ALLOCATE(ParseError, statement.error_count);
+      size_t first_offset = document->tokens[index].offset;
+      for (int i = 0; i < statement.error_count; i++) {
+        statement.errors[i] = parser.errors[error_start + i];
+        statement.errors[i].offset -= first_offset;
+      }
+    }
+
+    if (parsed_count >= parsed_capacity) {
+      int old_capacity = parsed_capacity;
+      parsed_capacity = GROW_CAPACITY(old_capacity);
+      parsed = GROW_ARRAY(DocumentStatement, parsed, old_capacity,
+                          parsed_capacity);
+    }
+    parsed[parsed_count++] = statement;
+  }
+  document->reparsed_statements = parsed_count;
+
+  // Parsing stopped at an old statement, or at the end: everything from
+  // there on is kept where it is, and the new statements replace the rest.
+  if (parser_peek(&parser, 0)->type == TOKEN_EOF) {
+    candidate = old_statements;
+  }
+  parser_free(&parser);
+  if (generation->statements == 0) {
+    arena_free(&generation->arena);
+    FREE(DocumentArena, generation);
+  }
+  for (size_t i = reused; i < candidate; i++) {
+    free_statement(statement_at(document, i));
+  }
+  size_t replaced = candidate - reused;
+  if ((size_t)parsed_count > replaced) {
+    ensure_statement_gap(document, (size_t)parsed_count - replaced);
+  }
+  at = candidate + statement_gap(document) - (size_t)parsed_count;
+  if (parsed_count > 0) {
+    memcpy(document->statements + at, parsed,
+           sizeof(DocumentStatement) * (size_t)parsed_count);
+  }
+  document->statement_gap_end = at;
+  FREE_ARRAY(DocumentStatement, parsed, parsed_capacity);
+
+  line_map_truncate(&document->lines, start);
+  document->collected = 0;
+}
+
+sds document_text(const Document *document) {
+  sds text = sdsnewlen(document->text, document->gap_start);
+  return sdscatlen(text, document->text + document->gap_end,
+                   document->text_capacity - document->gap_end);
+}
+
+Node *document_program(Document *document) {
+  collect(document);
+  return document->program;
+}
+
+ParseError *document_errors(Document *document, int *count) {
+  collect(document);
+  *count = document->error_count;
+  return document->errors;
+}
+
+Position document_position(Document *document, size_t offset) {
+  // Index the lines up to offset, a side of the gap at a time.
+  size_t length = document_length(document);
+  size_t to = offset < length ? offset + 1 : length;
+  while (document->lines.indexed < to) {
+    size_t at = document->lines.indexed;
+    size_t stop = to;
+    if (at < document->gap_start && stop > document->gap_start) {
+      stop = document->gap_start;
+    }
+    line_map_feed(&document->lines,
+                  document->text + text_position(document, at), stop - at);
+  }
+  return line_map_position(&document->lines, offset);
+}
+
+void document_free(Document *document) {
+  size_t count = statement_count(document);
+  for (size_t i = 0; i < count; i++) {
+    free_statement(statement_at(document, i));
+  }
+  FREE_ARRAY(DocumentStatement, document->statements,
+             document->statement_capacity);
+  // The program's arena only holds its statement list; the nodes it lists
+  // are in the statements' arenas, released above.
+  program_free(document->program);
+  FREE_ARRAY(ParseError, document->errors, document->error_capacity);
+  FREE_ARRAY(Token, document->tokens, document->token_capacity);
+  FREE_ARRAY(char, document->text, document->text_capacity);
+  line_map_free(&document->lines);
+}
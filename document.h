@@ -0,0 +1,89 @@
+#ifndef document_h
+#define document_h
+
+#include <stddef.h>
+#include "ast.h"
+#include "linemap.h"
+#include "parser.h"
+#include "sds.h"
+
+// The nodes of the statements parsed by one edit. It is released when the
+// last of them is replaced.
+typedef struct {
+    Arena arena;
+    size_t statements;
+} DocumentArena;
+
+// One top-level statement and the errors parsing it produced. node is NULL
+// when the statement could not be parsed.
+typedef struct {
+    Node* node;
+    DocumentArena* arena;
+    // Position in the document's token buffer of the statement's first
+    // token.
+    size_t first_token;
+    // Error offsets are relative to the statement's first token, so they
+    // hold wherever the statement moves.
+    ParseError* errors;
+    int error_count;
+} DocumentStatement;
+
+// A source buffer that is kept lexed and parsed across edits, for editors
+// and checkers that re-parse on every keystroke. An edit re-lexes from the
+// last token that ends before it until the token stream lines up with the
+// old one again, and re-parses only the top-level statements whose tokens
+// changed; every other statement node is kept.
+//
+// The text, tokens and statements are gap buffers whose gaps sit at the
+// statement boundary before the last edit. Bytes after the gap do not move
+// when the text before them changes length, so tokens and nodes that point
+// at them stay valid; only what lies between two edits moves, and typing in
+// one place costs the same however long the text is. Token offsets are
+// positions in the buffer: document_offset() turns them into text offsets.
+typedef struct {
+    char* text;
+    size_t text_capacity;
+    size_t gap_start;
+    size_t gap_end;
+    Token* tokens;
+    size_t token_capacity;
+    size_t token_gap_start;
+    size_t token_gap_end;
+    DocumentStatement* statements;
+    size_t statement_capacity;
+    size_t statement_gap_start;
+    size_t statement_gap_end;
+    // Built from the statements when first asked for after an edit.
+    Node* program;
+    ParseError* errors;
+    int error_count;
+    int error_capacity;
+    int collected;
+    LineMap lines;
+    // What the last edit had to redo; for tests and benchmarks.
+    size_t relexed_tokens;
+    int reparsed_statements;
+} Document;
+
+void document_init(Document* document, const char* text, size_t length);
+// Replaces bytes [start, end) of the text with replacement.
+void document_edit(Document* document, size_t start, size_t end,
+                   const char* replacement, size_t length);
+size_t document_length(const Document* document);
+// Copies the text out of the buffer.
+sds document_text(const Document* document);
+// Converts a position in the text buffer, such as a token's offset, to an
+// offset in the text.
+size_t document_offset(const Document* document, size_t position);
+size_t document_token_count(const Document* document);
+// The index-th token, with its offset converted to a text offset.
+Token document_token(const Document* document, size_t index);
+// The statements that parsed, in order. The program is owned by the
+// document and changes with every edit.
+Node* document_program(Document* document);
+// Every statement's errors, in order, with text offsets.
+ParseError* document_errors(Document* document, int* count);
+Position document_position(Document* document, size_t offset);
+void document_free(Document* document);
+
+#endif
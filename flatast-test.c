@@ -0,0 +1,195 @@
+#include "flatast.h"
+#include "lexer.h"
+#include "parser.h"
+#include "sds.h"
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cmocka.h>
+
+static void parse_flat(FlatAst *ast, const char *input) {
+  Parser parser;
+  parser_init(&parser, input, strlen(input));
+  flat_ast_init(ast, input);
+  flat_ast_parse(ast, &parser);
+
+  int error_count;
+  parser_get_errors(&parser, &error_count);
+  assert_int_equal(error_count, 0);
+  parser_free(&parser);
+}
+
+static void test_statements(void **state) {
+  (void)state;
+
+  const char *input = "let x = 5;\n"
+                      "let foobar = 838383;\n"
+                      "return 5;\n"
+                      "foobar;\n"
+                      "18446744073709551615;";
+  FlatAst ast;
+  parse_flat(&ast, input);
+  assert_int_equal(ast.statement_count, 5);
+
+  const char *names[] = {"x", "foobar"};
+  for (int i = 0; i < 2; i++) {
+    FlatNode let = ast.statements[i];
+    assert_int_equal(ast.kinds[let], NODE_LET_STATEMENT);
+    FlatNode name = ast.lhs[let];
+    assert_int_equal(ast.kinds[name], NODE_IDENTIFIER);
+    assert_int_equal(ast.lhs[name],
+                     intern(names[i], (int)strlen(names[i])));
+    assert_true(token_literal_equals(flat_token(&ast, name), names[i]));
+  }
+
+  assert_int_equal(ast.kinds[ast.statements[2]], NODE_RETURN_STATEMENT);
+
+  FlatNode identifier = ast.lhs[ast.statements[3]];
+  assert_int_equal(ast.kinds[ast.statements[3]], NODE_EXPRESSION_STATEMENT);
+  assert_int_equal(ast.kinds[identifier], NODE_IDENTIFIER);
+  Token token = flat_token(&ast, identifier);
+  assert_int_equal(token.type, TOKEN_IDENT);
+  assert_int_equal(token.offset, strstr(input, "foobar;") - input);
+  assert_int_equal(token.symbol, intern("foobar", 6));
+
+  FlatNode integer = ast.lhs[ast.statements[4]];
+  assert_int_equal(ast.kinds[integer], NODE_INTEGER_LITERAL);
+  assert_true(flat_integer_value(&ast, integer) == UINT64_MAX);
+  assert_true(flat_token(&ast, integer).value == UINT64_MAX);
+
+  flat_ast_free(&ast);
+}
+
+// The flat tree of an input prints the same as its pointer tree, and the
+// parser reports the same errors either way.
+static void test_matches_tree(void **state) {
+  (void)state;
+
+  const char *input = "let x = 5;\n"
+                      "let = 10;\n"
+                      "return x;\n"
+                      "foobar;\n"
+                      "18446744073709551616;\n"
+                      "let y 7;\n"
+                      "let add = fn(a, b) { return a + b * -2; };\n"
+                      "if (add(1, [2, 3][0]) > 4) { \"yes\" }\n"
+                      "else { !true; };\n"
+                      "fn() { if (x) { } }();\n"
+                      "12; z";
+  Parser parser;
+  parser_init(&parser, input, strlen(input));
+  Node *program = parser_parse_program(&parser);
+  int tree_errors;
+  parser_get_errors(&parser, &tree_errors);
+  parser_free(&parser);
+
+  FlatAst ast;
+  flat_ast_init(&ast, input);
+  parser_init(&parser, input, strlen(input));
+  flat_ast_parse(&ast, &parser);
+  int flat_errors;
+  parser_get_errors(&parser, &flat_errors);
+  assert_int_equal(flat_errors, tree_errors);
+  assert_null(parser.arena);
+  parser_free(&parser);
+
+  sds expected = node_to_string(program);
+  sds actual = flat_ast_to_string(&ast);
+  assert_string_equal(actual, expected);
+  assert_int_equal(ast.statement_count,
+                   AS_PROGRAM(program)->statement_count);
+
+  sdsfree(expected);
+  sdsfree(actual);
+  flat_ast_free(&ast);
+  program_free(program);
+}
+
+static void test_unparsed_bodies(void **state) {
+  (void)state;
+
+  const char *input = "let f = fn(x) { fn() { x } };";
+  Parser parser;
+  parser_init(&parser, input, strlen(input));
+  parser.lazy_bodies = 1;
+  FlatAst ast;
+  flat_ast_init(&ast, input);
+  flat_ast_parse(&ast, &parser);
+  parser_free(&parser);
+
+  FlatNode function = ast.rhs[ast.statements[0]];
+  FlatNode body = ast.rhs[function];
+  assert_int_equal(ast.kinds[body], NODE_BLOCK_STATEMENT);
+  assert_int_equal(ast.lhs[body], FLAT_NONE);
+  sds text = flat_ast_to_string(&ast);
+  assert_string_equal(text, "let f = fn(x) { fn() { x } };");
+
+  sdsfree(text);
+  flat_ast_free(&ast);
+}
+
+static void test_memory(void **state) {
+  (void)state;
+
+  sds input = sdsempty();
+  for (int i = 0; i < 10000; i++) {
+    input = sdscatprintf(input, "let v%d = %d;\nv%d;\n%d;\n", i, i, i, i);
+  }
+
+  FlatAst ast;
+  parse_flat(&ast, input);
+  assert_int_equal(ast.statement_count, 30000);
+
+  // Every node of the pointer tree is a whole Node, and every statement
+  // also has a pointer in the program.
+  size_t tree = ast.count * sizeof(Node) + ast.statement_count * sizeof(Node *);
+  assert_true(flat_ast_memory(&ast) * 2 < tree);
+
+  flat_ast_free(&ast);
+  sdsfree(input);
+}
+
+// Chains far longer than the C stack could hold are copied and printed.
+static void test_long_chains(void **state) {
+  (void)state;
+
+  int terms = 300000;
+  sds input = sdsnew("let x = 1");
+  for (int i = 1; i < terms; i++) {
+    input = sdscat(input, " + 1");
+  }
+  input = sdscat(input, ";");
+
+  FlatAst ast;
+  parse_flat(&ast, input);
+  assert_int_equal(ast.count, 2 + 2 * terms - 1);
+  // Nodes are in pre-order, so the left spine comes first.
+  assert_int_equal(ast.lhs[2], 3);
+  assert_int_equal(ast.kinds[terms], NODE_INFIX_EXPRESSION);
+  assert_int_equal(ast.kinds[terms + 1], NODE_INTEGER_LITERAL);
+
+  sds text = flat_ast_to_string(&ast);
+  assert_int_equal(sdslen(text), 9 + terms + 5 * (terms - 1));
+  assert_memory_equal(text, "let x = ((((", 12);
+  assert_memory_equal(text + sdslen(text) - 6, " + 1);", 6);
+
+  sdsfree(text);
+  flat_ast_free(&ast);
+  sdsfree(input);
+}
+
+int main(void) {
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_statements),
+      cmocka_unit_test(test_matches_tree),
+      cmocka_unit_test(test_unparsed_bodies),
+      cmocka_unit_test(test_memory),
+      cmocka_unit_test(test_long_chains),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
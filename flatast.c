@@ -0,0 +1,531 @@
+#include "flatast.h"
+#include "memory.h"
+
+void flat_ast_init(FlatAst *ast, const char *input) {
+  ast->input = input;
+  ast->kinds = NULL;
+  ast->token_types = NULL;
+  ast->offsets = NULL;
+  ast->lengths = NULL;
+  ast->lhs = NULL;
+  ast->rhs = NULL;
+  ast->count = 0;
+  ast->capacity = 0;
+  ast->extra = NULL;
+  ast->extra_count = 0;
+  ast->extra_capacity = 0;
+  ast->statements = NULL;
+  ast->statement_count = 0;
+  ast->statement_capacity = 0;
+}
+
+// Appends a node with token's fields and no children yet. The columns may
+// move, so finish adding a child before storing its index.
+static FlatNode add_node(FlatAst *ast, NodeType kind, const Token *token) {
+  if (ast->count >= ast->capacity) {
+    uint32_t old_capacity = ast->capacity;
+    ast->capacity = GROW_CAPACITY(old_capacity);
+    ast->kinds = GROW_ARRAY(uint8_t, ast->kinds, old_capacity, ast->capacity);
+    ast->token_types =
+        GROW_ARRAY(uint8_t, ast->token_types, old_capacity, ast->capacity);
+    ast->offsets =
+        GROW_ARRAY(uint32_t, ast->offsets, old_capacity, ast->capacity);
+    ast->lengths =
+        GROW_ARRAY(uint32_t, ast->lengths, old_capacity, ast->capacity);
+    ast->lhs = GROW_ARRAY(FlatNode, ast->lhs, old_capacity, ast->capacity);
+    ast->rhs = GROW_ARRAY(FlatNode, ast->rhs, old_capacity, ast->capacity);
+  }
+
+  FlatNode node = ast->count++;
+  ast->kinds[node] = (uint8_t)kind;
+  ast->token_types[node] = (uint8_t)token->type;
+  ast->offsets[node] = (uint32_t)token->offset;
+  ast->lengths[node] = (uint32_t)token->length;
+  ast->lhs[node] = FLAT_NONE;
+  ast->rhs[node] = FLAT_NONE;
+  return node;
+}
+
+// Reserves count slots at the end of extra and returns the first.
+static uint32_t add_extra(FlatAst *ast, uint32_t count) {
+  if (ast->extra_count + count > ast->extra_capacity) {
+    uint32_t old_capacity = ast->extra_capacity;
+    while (ast->extra_count + count > ast->extra_capacity) {
+      ast->extra_capacity = GROW_CAPACITY(ast->extra_capacity);
+    }
+    ast->extra = GROW_ARRAY(uint32_t, ast->extra, old_capacity,
+                            ast->extra_capacity);
+  }
+
+  uint32_t index = ast->extra_count;
+  ast->extra_count += count;
+  return index;
+}
+
+// A tree still to be added, and where its index goes once it is: the
+// column is named by the field that holds it, since it may move as the
+// columns grow.
+typedef struct {
+  Node *tree;
+  uint32_t **column;
+  uint32_t index;
+} PendingTree;
+
+// Trees are added from an explicit stack rather than by recursion, so a
+// long chain of operators cannot overflow the C stack.
+typedef struct {
+  PendingTree *items;
+  uint32_t count;
+  uint32_t capacity;
+} BuildStack;
+
+// Pushes tree, to be added after the trees pushed before it are popped;
+// a missing tree leaves the slot FLAT_NONE.
+static void push_tree(BuildStack *stack, Node *tree, uint32_t **column,
+                      uint32_t index) {
+  if (tree == NULL) {
+    return;
+  }
+  if (stack->count >= stack->capacity) {
+    uint32_t old_capacity = stack->capacity;
+    stack->capacity = GROW_CAPACITY(old_capacity);
+    stack->items =
+        GROW_ARRAY(PendingTree, stack->items, old_capacity, stack->capacity);
+  }
+  PendingTree *pending = &stack->items[stack->count++];
+  pending->tree = tree;
+  pending->column = column;
+  pending->index = index;
+}
+
+// Reserves list in extra and pushes its items, last first.
+static uint32_t add_list(FlatAst *ast, BuildStack *stack, NodeList list) {
+  uint32_t index = add_extra(ast, 1 + (uint32_t)list.count);
+  ast->extra[index] = (uint32_t)list.count;
+  for (int i = list.count - 1; i >= 0; i--) {
+    ast->extra[index + 1 + i] = FLAT_NONE;
+    push_tree(stack, list.items[i], &ast->extra, index + 1 + (uint32_t)i);
+  }
+  return index;
+}
+
+// Adds a node whose children go in lhs and rhs.
+static FlatNode add_binary(FlatAst *ast, BuildStack *stack, Node *tree,
+                           const Token *token, Node *left, Node *right) {
+  FlatNode node = add_node(ast, tree->type, token);
+  push_tree(stack, right, &ast->rhs, node);
+  push_tree(stack, left, &ast->lhs, node);
+  return node;
+}
+
+// Adds tree's own node and pushes its children, which are added next, in
+// field order, so a tree's nodes stay in pre-order.
+static FlatNode add_tree(FlatAst *ast, BuildStack *stack, Node *tree) {
+  switch (tree->type) {
+  case NODE_LET_STATEMENT: {
+    LetStatement *stmt = AS_LET_STATEMENT(tree);
+    FlatNode node = add_node(ast, NODE_LET_STATEMENT, &stmt->token);
+    if (stmt->name != NULL) {
+      FlatNode name = add_node(ast, NODE_IDENTIFIER, &stmt->name->token);
+      ast->lhs[name] = stmt->name->token.symbol;
+      ast->lhs[node] = name;
+    }
+    push_tree(stack, stmt->value, &ast->rhs, node);
+    return node;
+  }
+  case NODE_RETURN_STATEMENT: {
+    ReturnStatement *stmt = AS_RETURN_STATEMENT(tree);
+    FlatNode node = add_node(ast, NODE_RETURN_STATEMENT, &stmt->token);
+    push_tree(stack, stmt->return_value, &ast->lhs, node);
+    return node;
+  }
+  case NODE_EXPRESSION_STATEMENT: {
+    ExpressionStatement *stmt = AS_EXPRESSION_STATEMENT(tree);
+    FlatNode node = add_node(ast, NODE_EXPRESSION_STATEMENT, &stmt->token);
+    push_tree(stack, stmt->expression, &ast->lhs, node);
+    return node;
+  }
+  case NODE_IDENTIFIER: {
+    Identifier *identifier = AS_IDENTIFIER(tree);
+    FlatNode node = add_node(ast, NODE_IDENTIFIER, &identifier->token);
+    ast->lhs[node] = identifier->token.symbol;
+    return node;
+  }
+  case NODE_INTEGER_LITERAL: {
+    IntegerLiteral *literal = AS_INTEGER_LITERAL(tree);
+    FlatNode node = add_node(ast, NODE_INTEGER_LITERAL, &literal->token);
+    ast->lhs[node] = (uint32_t)literal->value;
+    ast->rhs[node] = (uint32_t)(literal->value >> 32);
+    return node;
+  }
+  case NODE_BOOLEAN_LITERAL: {
+    BooleanLiteral *literal = AS_BOOLEAN_LITERAL(tree);
+    FlatNode node = add_node(ast, NODE_BOOLEAN_LITERAL, &literal->token);
+    ast->lhs[node] = (uint32_t)literal->value;
+    return node;
+  }
+  case NODE_STRING_LITERAL:
+    return add_node(ast, NODE_STRING_LITERAL,
+                    &AS_STRING_LITERAL(tree)->token);
+  case NODE_BLOCK_STATEMENT: {
+    BlockStatement *block = AS_BLOCK_STATEMENT(tree);
+    FlatNode node = add_node(ast, NODE_BLOCK_STATEMENT, &block->token);
+    if (!block->unparsed) {
+      uint32_t statements = add_list(ast, stack, block->statements);
+      ast->lhs[node] = statements;
+    }
+    return node;
+  }
+  case NODE_PREFIX_EXPRESSION: {
+    PrefixExpression *expression = AS_PREFIX_EXPRESSION(tree);
+    return add_binary(ast, stack, tree, &expression->token,
+                      expression->right, NULL);
+  }
+  case NODE_INFIX_EXPRESSION: {
+    InfixExpression *expression = AS_INFIX_EXPRESSION(tree);
+    return add_binary(ast, stack, tree, &expression->token, expression->left,
+                      expression->right);
+  }
+  case NODE_INDEX_EXPRESSION: {
+    IndexExpression *expression = AS_INDEX_EXPRESSION(tree);
+    return add_binary(ast, stack, tree, &expression->token, expression->left,
+                      expression->index);
+  }
+  case NODE_IF_EXPRESSION: {
+    IfExpression *expression = AS_IF_EXPRESSION(tree);
+    FlatNode node = add_node(ast, NODE_IF_EXPRESSION, &expression->token);
+    uint32_t branches = add_extra(ast, 2);
+    ast->rhs[node] = branches;
+    ast->extra[branches] = FLAT_NONE;
+    ast->extra[branches + 1] = FLAT_NONE;
+    push_tree(stack, expression->alternative, &ast->extra, branches + 1);
+    push_tree(stack, expression->consequence, &ast->extra, branches);
+    push_tree(stack, expression->condition, &ast->lhs, node);
+    return node;
+  }
+  case NODE_FUNCTION_LITERAL: {
+    FunctionLiteral *function = AS_FUNCTION_LITERAL(tree);
+    FlatNode node = add_node(ast, NODE_FUNCTION_LITERAL, &function->token);
+    // The parameters come first, so they are pushed last.
+    push_tree(stack, function->body, &ast->rhs, node);
+    uint32_t parameters = add_list(ast, stack, function->parameters);
+    ast->lhs[node] = parameters;
+    return node;
+  }
+  case NODE_CALL_EXPRESSION: {
+    CallExpression *call = AS_CALL_EXPRESSION(tree);
+    FlatNode node = add_node(ast, NODE_CALL_EXPRESSION, &call->token);
+    uint32_t arguments = add_list(ast, stack, call->arguments);
+    ast->rhs[node] = arguments;
+    push_tree(stack, call->function, &ast->lhs, node);
+    return node;
+  }
+  case NODE_ARRAY_LITERAL: {
+    ArrayLiteral *array = AS_ARRAY_LITERAL(tree);
+    FlatNode node = add_node(ast, NODE_ARRAY_LITERAL, &array->token);
+    uint32_t elements = add_list(ast, stack, array->elements);
+    ast->lhs[node] = elements;
+    return node;
+  }
+  case NODE_PROGRAM:
+    break;
+  }
+  // Programs do not nest.
+  return FLAT_NONE;
+}
+
+void flat_ast_add_statement(FlatAst *ast, Node *statement) {
+  FlatNode node = FLAT_NONE;
+  FlatNode *root = &node;
+  BuildStack stack = {NULL, 0, 0};
+  push_tree(&stack, statement, &root, 0);
+  while (stack.count > 0) {
+    PendingTree pending = stack.items[--stack.count];
+    FlatNode added = add_tree(ast, &stack, pending.tree);
+    (*pending.column)[pending.index] = added;
+  }
+  FREE_ARRAY(PendingTree, stack.items, stack.capacity);
+  if (node == FLAT_NONE) {
+    return;
+  }
+
+  if (ast->statement_count >= ast->statement_capacity) {
+    uint32_t old_capacity = ast->statement_capacity;
+    ast->statement_capacity = GROW_CAPACITY(old_capacity);
+    ast->statements = GROW_ARRAY(FlatNode, ast->statements, old_capacity,
+                                 ast->statement_capacity);
+  }
+  ast->statements[ast->statement_count++] = node;
+}
+
+void flat_ast_parse(FlatAst *ast, Parser *parser) {
+  Arena scratch;
+  arena_init(&scratch);
+  parser->arena = &scratch;
+
+  while (parser_peek(parser, 0)->type != TOKEN_EOF) {
+    Node *statement = parser_parse_statement(parser);
+    if (statement != NULL) {
+      flat_ast_add_statement(ast, statement);
+    }
+    arena_reset(&scratch);
+  }
+
+  parser->arena = NULL;
+  arena_free(&scratch);
+}
+
+// A string's text starts after its opening quote.
+static const char *token_start(const FlatAst *ast, FlatNode node) {
+  return ast->input + ast->offsets[node] +
+         (ast->token_types[node] == TOKEN_STRING);
+}
+
+Token flat_token(const FlatAst *ast, FlatNode node) {
+  Token token = make_token((TokenType)ast->token_types[node],
+                           token_start(ast, node), (int)ast->lengths[node],
+                           ast->offsets[node]);
+  if (ast->kinds[node] == NODE_IDENTIFIER) {
+    token.symbol = ast->lhs[node];
+  } else if (ast->kinds[node] == NODE_INTEGER_LITERAL) {
+    token.value = flat_integer_value(ast, node);
+  }
+  return token;
+}
+
+uint64_t flat_integer_value(const FlatAst *ast, FlatNode node) {
+  return (uint64_t)ast->rhs[node] << 32 | ast->lhs[node];
+}
+
+uint32_t flat_list_count(const FlatAst *ast, uint32_t list) {
+  return ast->extra[list];
+}
+
+FlatNode flat_list_item(const FlatAst *ast, uint32_t list, uint32_t i) {
+  return ast->extra[list + 1 + i];
+}
+
+typedef enum {
+  PRINT_NODE,
+  PRINT_TEXT,
+  PRINT_TOKEN,
+} PrintKind;
+
+// Something left to print: a node, a C string or a node's token.
+typedef struct {
+  PrintKind kind;
+  FlatNode node;
+  const char *text;
+} PrintItem;
+
+// Like node_to_string(), printing keeps its own stack rather than
+// recursing.
+typedef struct {
+  PrintItem *items;
+  uint32_t count;
+  uint32_t capacity;
+} PrintStack;
+
+static void push_print(PrintStack *stack, PrintKind kind, FlatNode node,
+                       const char *text) {
+  if (stack->count >= stack->capacity) {
+    uint32_t old_capacity = stack->capacity;
+    stack->capacity = GROW_CAPACITY(old_capacity);
+    stack->items =
+        GROW_ARRAY(PrintItem, stack->items, old_capacity, stack->capacity);
+  }
+  PrintItem *item = &stack->items[stack->count++];
+  item->kind = kind;
+  item->node = node;
+  item->text = text;
+}
+
+// FLAT_NONE prints nothing.
+static void push_node(PrintStack *stack, FlatNode node) {
+  if (node != FLAT_NONE) {
+    push_print(stack, PRINT_NODE, node, NULL);
+  }
+}
+
+static void push_text(PrintStack *stack, const char *text) {
+  push_print(stack, PRINT_TEXT, FLAT_NONE, text);
+}
+
+static void push_token(PrintStack *stack, FlatNode node) {
+  push_print(stack, PRINT_TOKEN, node, NULL);
+}
+
+static void push_list(PrintStack *stack, const FlatAst *ast, uint32_t list,
+                      const char *separator) {
+  uint32_t count = flat_list_count(ast, list);
+  for (uint32_t i = 0; i < count; i++) {
+    if (i > 0) {
+      push_text(stack, separator);
+    }
+    push_node(stack, flat_list_item(ast, list, i));
+  }
+}
+
+// Pushes the parts of node in the order they are printed, mirroring
+// node_to_string() case by case.
+static void push_parts(PrintStack *stack, const FlatAst *ast, FlatNode node) {
+  FlatNode lhs = ast->lhs[node];
+  FlatNode rhs = ast->rhs[node];
+
+  switch (ast->kinds[node]) {
+  case NODE_LET_STATEMENT:
+    push_token(stack, node);
+    push_text(stack, " ");
+    if (lhs != FLAT_NONE) {
+      push_token(stack, lhs);
+    }
+    push_text(stack, " = ");
+    push_node(stack, rhs);
+    push_text(stack, ";");
+    break;
+  case NODE_RETURN_STATEMENT:
+    push_token(stack, node);
+    push_text(stack, " ");
+    push_node(stack, lhs);
+    push_text(stack, ";");
+    break;
+  case NODE_EXPRESSION_STATEMENT:
+    push_node(stack, lhs);
+    break;
+  case NODE_BLOCK_STATEMENT:
+    if (lhs == FLAT_NONE) {
+      push_token(stack, node);
+    } else {
+      push_list(stack, ast, lhs, "");
+    }
+    break;
+  case NODE_IDENTIFIER:
+  case NODE_INTEGER_LITERAL:
+  case NODE_BOOLEAN_LITERAL:
+  case NODE_STRING_LITERAL:
+    push_token(stack, node);
+    break;
+  case NODE_PREFIX_EXPRESSION:
+    push_text(stack, "(");
+    push_token(stack, node);
+    push_node(stack, lhs);
+    push_text(stack, ")");
+    break;
+  case NODE_INFIX_EXPRESSION:
+    push_text(stack, "(");
+    push_node(stack, lhs);
+    push_text(stack, " ");
+    push_token(stack, node);
+    push_text(stack, " ");
+    push_node(stack, rhs);
+    push_text(stack, ")");
+    break;
+  case NODE_IF_EXPRESSION:
+    push_text(stack, "if");
+    push_node(stack, lhs);
+    push_text(stack, " ");
+    push_node(stack, ast->extra[rhs]);
+    if (ast->extra[rhs + 1] != FLAT_NONE) {
+      push_text(stack, "else ");
+      push_node(stack, ast->extra[rhs + 1]);
+    }
+    break;
+  case NODE_FUNCTION_LITERAL:
+    push_token(stack, node);
+    push_text(stack, "(");
+    push_list(stack, ast, lhs, ", ");
+    push_text(stack, ") ");
+    push_node(stack, rhs);
+    break;
+  case NODE_CALL_EXPRESSION:
+    push_node(stack, lhs);
+    push_text(stack, "(");
+    push_list(stack, ast, rhs, ", ");
+    push_text(stack, ")");
+    break;
+  case NODE_ARRAY_LITERAL:
+    push_text(stack, "[");
+    push_list(stack, ast, lhs, ", ");
+    push_text(stack, "]");
+    break;
+  case NODE_INDEX_EXPRESSION:
+    push_text(stack, "(");
+    push_node(stack, lhs);
+    push_text(stack, "[");
+    push_node(stack, rhs);
+    push_text(stack, "])");
+    break;
+  }
+}
+
+// Reverses the items from start on, so they pop in the order pushed.
+static void reverse_from(PrintStack *stack, uint32_t start) {
+  if (stack->count == 0) {
+    return;
+  }
+  for (uint32_t i = start, j = stack->count - 1; i < j; i++, j--) {
+    PrintItem item = stack->items[i];
+    stack->items[i] = stack->items[j];
+    stack->items[j] = item;
+  }
+}
+
+// Appends node's text to s, using stack, which is left empty.
+static sds cat_node(sds s, const FlatAst *ast, PrintStack *stack,
+                    FlatNode node) {
+  push_node(stack, node);
+  while (stack->count > 0) {
+    PrintItem item = stack->items[--stack->count];
+    switch (item.kind) {
+    case PRINT_NODE: {
+      uint32_t start = stack->count;
+      push_parts(stack, ast, item.node);
+      reverse_from(stack, start);
+      break;
+    }
+    case PRINT_TEXT:
+      s = sdscat(s, item.text);
+      break;
+    case PRINT_TOKEN:
+      s = sdscatlen(s, token_start(ast, item.node), ast->lengths[item.node]);
+      break;
+    }
+  }
+  return s;
+}
+
+sds flat_node_to_string(const FlatAst *ast, FlatNode node) {
+  PrintStack stack = {NULL, 0, 0};
+  sds s = cat_node(sdsempty(), ast, &stack, node);
+  FREE_ARRAY(PrintItem, stack.items, stack.capacity);
+  return s;
+}
+
+sds flat_ast_to_string(const FlatAst *ast) {
+  PrintStack stack = {NULL, 0, 0};
+  sds s = sdsnew("");
+  for (uint32_t i = 0; i < ast->statement_count; i++) {
+    s = cat_node(s, ast, &stack, ast->statements[i]);
+  }
+  FREE_ARRAY(PrintItem, stack.items, stack.capacity);
+  return s;
+}
+
+size_t flat_ast_memory(const FlatAst *ast) {
+  size_t node = 2 * sizeof(uint8_t) + 2 * sizeof(uint32_t) +
+                2 * sizeof(FlatNode);
+  return node * ast->capacity + sizeof(uint32_t) * ast->extra_capacity +
+         sizeof(FlatNode) * ast->statement_capacity;
+}
+
+void flat_ast_free(FlatAst *ast) {
+  FREE_ARRAY(uint8_t, ast->kinds, ast->capacity);
+  FREE_ARRAY(uint8_t, ast->token_types, ast->capacity);
+  FREE_ARRAY(uint32_t, ast->offsets, ast->capacity);
+  FREE_ARRAY(uint32_t, ast->lengths, ast->capacity);
+  FREE_ARRAY(FlatNode, ast->lhs, ast->capacity);
+  FREE_ARRAY(FlatNode, ast->rhs, ast->capacity);
+  FREE_ARRAY(uint32_t, ast->extra, ast->extra_capacity);
+  FREE_ARRAY(FlatNode, ast->statements, ast->statement_capacity);
+  flat_ast_init(ast, ast->input);
+}
@@ -0,0 +1,86 @@
+#ifndef flatast_h
+#define flatast_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+#include "parser.h"
+#include "sds.h"
+
+// A node of a FlatAst: its index in the node columns.
+typedef uint32_t FlatNode;
+
+#define FLAT_NONE UINT32_MAX
+
+// The same tree as a Program, stored as columns of plain integers instead
+// of Nodes linked by pointers. Node i is kinds[i], token_types[i], ... and
+// its children are other indices, so a traversal walks a few dense arrays
+// and a node costs 18 bytes against 72 for a Node on 64-bit targets.
+//
+// What lhs and rhs hold depends on the kind:
+//
+//   NODE_LET_STATEMENT         lhs: name, rhs: value
+//   NODE_RETURN_STATEMENT      lhs: return value
+//   NODE_EXPRESSION_STATEMENT  lhs: expression
+//   NODE_BLOCK_STATEMENT       lhs: statement list, or FLAT_NONE if the
+//                              block is unparsed
+//   NODE_IDENTIFIER            lhs: symbol
+//   NODE_INTEGER_LITERAL       lhs, rhs: low and high 32 bits of the value
+//   NODE_BOOLEAN_LITERAL       lhs: 1 for true, 0 for false
+//   NODE_PREFIX_EXPRESSION     lhs: operand
+//   NODE_INFIX_EXPRESSION      lhs: left, rhs: right
+//   NODE_IF_EXPRESSION         lhs: condition, rhs: extra[rhs] is the
+//                              consequence and extra[rhs + 1] the
+//                              alternative
+//   NODE_FUNCTION_LITERAL      lhs: parameter list, rhs: body
+//   NODE_CALL_EXPRESSION       lhs: function, rhs: argument list
+//   NODE_ARRAY_LITERAL         lhs: element list
+//   NODE_INDEX_EXPRESSION      lhs: left, rhs: index
+//
+// A list is an index into extra, which holds its length followed by its
+// items. Missing children are FLAT_NONE. A node's token is kept as its
+// type, offset and length, the text starting one byte later for strings.
+// Tokens are views into input, which must outlive the tree and be shorter
+// than 4 GB. There is no program node: statements lists the top-level
+// statements in order.
+typedef struct {
+    const char* input;
+    uint8_t* kinds;
+    uint8_t* token_types;
+    uint32_t* offsets;
+    uint32_t* lengths;
+    FlatNode* lhs;
+    FlatNode* rhs;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t* extra;
+    uint32_t extra_count;
+    uint32_t extra_capacity;
+    FlatNode* statements;
+    uint32_t statement_count;
+    uint32_t statement_capacity;
+} FlatAst;
+
+void flat_ast_init(FlatAst* ast, const char* input);
+// Copies statement, a tree of Nodes whose tokens point into ast->input, and
+// appends it to the top-level statements.
+void flat_ast_add_statement(FlatAst* ast, Node* statement);
+// Parses the rest of parser's input into ast. Each statement is parsed into
+// a scratch arena, copied and dropped, so the pointer tree never exists for
+// more than one statement at a time. Errors are left on the parser.
+void flat_ast_parse(FlatAst* ast, Parser* parser);
+// The node's token, rebuilt with its symbol or value.
+Token flat_token(const FlatAst* ast, FlatNode node);
+uint64_t flat_integer_value(const FlatAst* ast, FlatNode node);
+// The same text node_to_string() gives for the equivalent Node.
+sds flat_node_to_string(const FlatAst* ast, FlatNode node);
+// All the statements, like node_to_string() on the program.
+sds flat_ast_to_string(const FlatAst* ast);
+// The length of the list at index, and its i-th item.
+uint32_t flat_list_count(const FlatAst* ast, uint32_t list);
+FlatNode flat_list_item(const FlatAst* ast, uint32_t list, uint32_t i);
+// Bytes held by the columns, extra and the statement list.
+size_t flat_ast_memory(const FlatAst* ast);
+void flat_ast_free(FlatAst* ast);
+
+#endif
@@ -0,0 +1,208 @@
+#include "intern.h"
+#include "memory.h"
+#include <string.h>
+
+// Spellings are packed into blocks of at least this many bytes.
+#define SYMBOL_BLOCK_SIZE (16 * 1024)
+
+struct SymbolBlock {
+  SymbolBlock *next;
+  size_t used;
+  size_t size;
+  char data[];
+};
+
+// Zero-initialized, so its arrays are allocated on first use.
+static SymbolTable default_table = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+void symbol_table_init(SymbolTable *table) {
+  table->slots = NULL;
+  table->slot_capacity = 0;
+  table->names = NULL;
+  table->count = 0;
+  table->name_capacity = 0;
+  table->blocks = NULL;
+  pthread_mutex_init(&table->lock, NULL);
+}
+
+void symbol_table_free(SymbolTable *table) {
+  SymbolBlock *block = table->blocks;
+  while (block != NULL) {
+    SymbolBlock *next = block->next;
+    reallocate(block, sizeof(SymbolBlock) + block->size, 0);
+    block = next;
+  }
+
+  FREE_ARRAY(SymbolSlot, table->slots, table->slot_capacity);
+  FREE_ARRAY(SymbolName, table->names, table->name_capacity);
+  pthread_mutex_destroy(&table->lock);
+}
+
+// 32-bit FNV-1a. Identifiers are short, so a byte loop is as fast as
+// anything wider once the setup cost is counted.
+static uint32_t hash_name(const char *name, int length) {
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < length; i++) {
+    hash ^= (unsigned char)name[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static const char *copy_name(SymbolTable *table, const char *name,
+                             int length) {
+  size_t needed = (size_t)length + 1;
+  SymbolBlock *block = table->blocks;
+
+  if (block == NULL || block->size - block->used < needed) {
+    size_t size = needed > SYMBOL_BLOCK_SIZE ? needed : SYMBOL_BLOCK_SIZE;
+    block = reallocate(NULL, 0, sizeof(SymbolBlock) + size);
+    block->next = table->blocks;
+    block->used = 0;
+    block->size = size;
+    table->blocks = block;
+  }
+
+  char *copy = block->data + block->used;
+  memcpy(copy, name, (size_t)length);
+  copy[length] = '\0';
+  block->used += needed;
+  return copy;
+}
+
+// Capacities are powers of two, so a slot index is hash & (capacity - 1).
+static void grow_slots(SymbolTable *table) {
+  uint32_t old_capacity = table->slot_capacity;
+  SymbolSlot *old_slots = table->slots;
+
+  table->slot_capacity = old_capacity < 64 ? 64 : old_capacity * 2;
+  table->slots = ALLOCATE(SymbolSlot, table->slot_capacity);
+  memset(table->slots, 0, sizeof(SymbolSlot) * table->slot_capacity);
+
+  uint32_t mask = table->slot_capacity - 1;
+  for (uint32_t i = 0; i < old_capacity; i++) {
+    if (old_slots[i].symbol == SYMBOL_NONE) {
+      continue;
+    }
+    uint32_t index = old_slots[i].hash & mask;
+    while (table->slots[index].symbol != SYMBOL_NONE) {
+      index = (index + 1) & mask;
+    }
+    table->slots[index] = old_slots[i];
+  }
+
+  FREE_ARRAY(SymbolSlot, old_slots, old_capacity);
+}
+
+static Symbol add_name(SymbolTable *table, const char *name, int length) {
+  // Slot 0 of names is never used, so it counts towards the capacity.
+  if (table->count + 2 > table->name_capacity) {
+    uint32_t old_capacity = table->name_capacity;
+    table->name_capacity = GROW_CAPACITY(old_capacity);
+    table->names = GROW_ARRAY(SymbolName, table->names, old_capacity,
+                              table->name_capacity);
+  }
+
+  Symbol symbol = ++table->count;
+  table->names[symbol].name = copy_name(table, name, length);
+  table->names[symbol].length = length;
+  return symbol;
+}
+
+static Symbol intern_hashed(SymbolTable *table, const char *name, int length,
+                           uint32_t hash, SymbolName *spelling) {
+  pthread_mutex_lock(&table->lock);
+
+  // Keep the load factor at or below 1/2 so probe runs stay short.
+  if ((table->count + 1) * 2 > table->slot_capacity) {
+    grow_slots(table);
+  }
+
+  uint32_t mask = table->slot_capacity - 1;
+  uint32_t index = hash & mask;
+  Symbol symbol;
+
+  while (1) {
+    SymbolSlot *slot = &table->slots[index];
+    if (slot->symbol == SYMBOL_NONE) {
+      symbol = add_name(table, name, length);
+      slot->hash = hash;
+      slot->symbol = symbol;
+      break;
+    }
+
+    SymbolName *existing = &table->names[slot->symbol];
+    if (slot->hash == hash && existing->length == length &&
+        memcmp(existing->name, name, (size_t)length) == 0) {
+      symbol = slot->symbol;
+      break;
+    }
+    index = (index + 1) & mask;
+  }
+
+  if (spelling != NULL) {
+    *spelling = table->names[symbol];
+  }
+  pthread_mutex_unlock(&table->lock);
+  return symbol;
+}
+
+Symbol symbol_table_intern(SymbolTable *table, const char *name, int length) {
+  return intern_hashed(table, name, length, hash_name(name, length), NULL);
+}
+
+void symbol_cache_init(SymbolCache *cache) {
+  cache->table = NULL;
+  memset(cache->symbols, 0, sizeof(cache->symbols));
+}
+
+Symbol symbol_cache_intern(SymbolCache *cache, SymbolTable *table,
+                           const char *name, int length) {
+  if (cache->table != table) {
+    symbol_cache_init(cache);
+    cache->table = table;
+  }
+
+  uint32_t hash = hash_name(name, length);
+  uint32_t index = hash & (SYMBOL_CACHE_SIZE - 1);
+  SymbolName *cached = &cache->names[index];
+
+  if (cache->symbols[index] != SYMBOL_NONE && cache->hashes[index] == hash &&
+      cached->length == length &&
+      memcmp(cached->name, name, (size_t)length) == 0) {
+    return cache->symbols[index];
+  }
+
+  Symbol symbol = intern_hashed(table, name, length, hash, cached);
+  cache->hashes[index] = hash;
+  cache->symbols[index] = symbol;
+  return symbol;
+}
+
+const char *symbol_table_name(SymbolTable *table, Symbol symbol,
+                              int *length) {
+  const char *name = NULL;
+  int name_length = 0;
+
+  pthread_mutex_lock(&table->lock);
+  if (symbol != SYMBOL_NONE && symbol <= table->count) {
+    name = table->names[symbol].name;
+    name_length = table->names[symbol].length;
+  }
+  pthread_mutex_unlock(&table->lock);
+
+  if (length != NULL) {
+    *length = name_length;
+  }
+  return name;
+}
+
+SymbolTable *default_symbol_table() { return &default_table; }
+
+Symbol intern(const char *name, int length) {
+  return symbol_table_intern(&default_table, name, length);
+}
+
+const char *symbol_name(Symbol symbol) {
+  return symbol_table_name(&default_table, symbol, NULL);
+}
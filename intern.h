@@ -0,0 +1,74 @@
+#ifndef intern_h
+#define intern_h
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A Symbol names one distinct identifier spelling. Two identifiers are the
+// same name exactly when their symbols are equal, so name comparisons and
+// environment lookups never need to look at the text. Symbols are numbered
+// from 1 in the order they are first interned; 0 means "no symbol".
+typedef uint32_t Symbol;
+
+#define SYMBOL_NONE 0
+
+typedef struct {
+    uint32_t hash;
+    Symbol symbol;
+} SymbolSlot;
+
+typedef struct {
+    const char* name;
+    int length;
+} SymbolName;
+
+typedef struct SymbolBlock SymbolBlock;
+
+// Open-addressing hash table from spelling to Symbol. Spellings are copied
+// into arena blocks that are only freed with the table, so the text behind
+// a symbol never moves and does not depend on the source buffer.
+typedef struct {
+    SymbolSlot* slots;
+    uint32_t slot_capacity;
+    // names[symbol] for every symbol handed out; names[0] is unused.
+    SymbolName* names;
+    uint32_t count;
+    uint32_t name_capacity;
+    SymbolBlock* blocks;
+    pthread_mutex_t lock;
+} SymbolTable;
+
+// A small direct-mapped cache in front of a table, owned by one thread.
+// Hits are answered without taking the table's lock; spellings in the
+// table never move, so a cached entry can be compared in place.
+#define SYMBOL_CACHE_SIZE 64
+
+typedef struct {
+    SymbolTable* table;
+    uint32_t hashes[SYMBOL_CACHE_SIZE];
+    Symbol symbols[SYMBOL_CACHE_SIZE];
+    SymbolName names[SYMBOL_CACHE_SIZE];
+} SymbolCache;
+
+// Every function takes the table's lock, so lexers on different threads can
+// share one table.
+void symbol_table_init(SymbolTable* table);
+void symbol_table_free(SymbolTable* table);
+Symbol symbol_table_intern(SymbolTable* table, const char* name, int length);
+// Returns the NUL-terminated spelling of symbol, or NULL for SYMBOL_NONE and
+// unknown symbols. If length is not NULL it receives the spelling's length.
+const char* symbol_table_name(SymbolTable* table, Symbol symbol, int* length);
+
+// Interns through cache, which is emptied whenever it is used with a
+// different table than last time.
+void symbol_cache_init(SymbolCache* cache);
+Symbol symbol_cache_intern(SymbolCache* cache, SymbolTable* table,
+                           const char* name, int length);
+
+// The process-wide table that lexers intern into by default.
+SymbolTable* default_symbol_table();
+Symbol intern(const char* name, int length);
+const char* symbol_name(Symbol symbol);
+
+#endif
@@ -0,0 +1,96 @@
+// Build-time generator for keywords.h: searches for a hash over the KEYWORDS
+// list in lexer.h that gives every keyword its own slot, and prints the
+// resulting table. The build fails if no perfect hash is found.
+
+#include "lexer.h"
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_TABLE_SIZE 256
+#define MAX_MULTIPLIER 64
+
+typedef struct {
+  const char *name;
+  const char *type;
+} KeywordEntry;
+
+#define KEYWORD_ENTRY(name, type) {name, #type},
+static const KeywordEntry keywords[] = {KEYWORDS(KEYWORD_ENTRY)};
+#undef KEYWORD_ENTRY
+
+static const int keyword_count = sizeof(keywords) / sizeof(keywords[0]);
+
+static unsigned hash(const char *name, unsigned a, unsigned b, unsigned c,
+                     unsigned mask) {
+  size_t length = strlen(name);
+  return ((unsigned)length * a + (unsigned char)name[0] * b +
+          (unsigned char)name[length - 1] * c) &
+         mask;
+}
+
+static int is_perfect(unsigned a, unsigned b, unsigned c, unsigned size) {
+  char used[MAX_TABLE_SIZE] = {0};
+  for (int i = 0; i < keyword_count; i++) {
+    unsigned slot = hash(keywords[i].name, a, b, c, size - 1);
+    if (used[slot]) {
+      return 0;
+    }
+    used[slot] = 1;
+  }
+  return 1;
+}
+
+static void print_table(unsigned a, unsigned b, unsigned c, unsigned size) {
+  printf("// Generated by keywords-gen from KEYWORDS in lexer.h. Do not edit.\n"
+         "#ifndef keywords_h\n"
+         "#define keywords_h\n"
+         "\n"
+         "#include \"lexer.h\"\n"
+         "\n"
+         "typedef struct {\n"
+         "    const char* name;\n"
+         "    int length;\n"
+         "    TokenType type;\n"
+         "} Keyword;\n"
+         "\n"
+         "#define KEYWORD_HASH(start, length) \\\n"
+         "    (((unsigned)(length) * %uu + "
+         "(unsigned char)(start)[0] * %uu + \\\n"
+         "      (unsigned char)(start)[(length) - 1] * %uu) & %uu)\n"
+         "\n"
+         "static const Keyword keyword_table[%u] = {\n",
+         a, b, c, size - 1, size);
+
+  for (int i = 0; i < keyword_count; i++) {
+    printf("    [%u] = {\"%s\", %d, %s},\n",
+           hash(keywords[i].name, a, b, c, size - 1), keywords[i].name,
+           (int)strlen(keywords[i].name), keywords[i].type);
+  }
+
+  printf("};\n"
+         "\n"
+         "#endif\n");
+}
+
+int main() {
+  // Prefer the smallest table, then the smallest multipliers.
+  for (unsigned size = 1; size <= MAX_TABLE_SIZE; size *= 2) {
+    if (size < (unsigned)keyword_count) {
+      continue;
+    }
+    for (unsigned a = 0; a < MAX_MULTIPLIER; a++) {
+      for (unsigned b = 0; b < MAX_MULTIPLIER; b++) {
+        for (unsigned c = 0; c < MAX_MULTIPLIER; c++) {
+          if (is_perfect(a, b, c, size)) {
+            print_table(a, b, c, size);
+            return 0;
+          }
+        }
+      }
+    }
+  }
+
+  fprintf(stderr, "keywords-gen: no perfect hash for %d keywords\n",
+          keyword_count);
+  return 1;
+}
@@ -0,0 +1,309 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "lexer.h"
+#include "scan.h"
+#include "tokenize.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *whitespace_snippet =
+    "let a = 1;\n"
+    "                                                                \n"
+    "\t\t\t\t\t\t\t\t\r\n"
+    "                                        x;\n";
+
+static const char *identifier_snippet =
+    "let customer_account_balance_after_interest = "
+    "previous_customer_account_balance_before_interest_was_applied;\n";
+
+static const char *number_snippet =
+    "let table = [1, 42, 65535, 4294967296, 9007199254740993, 0, 7];\n"
+    "let big = 12345678901234567890 - 98765432109876 * 31415926;\n";
+
+static const char *snippet =
+    "let add = fn(x, y) {\n"
+    "  return x + y;\n"
+    "};\n"
+    "let result = add(five, 10) * 2 != 9;\n"
+    "if (result < 100) { \"small\" } else { [1, 2]; }\n";
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static char *make_input(const char *snippet, size_t size) {
+  size_t snippet_length = strlen(snippet);
+  char *input = malloc(size + 1);
+  if (input == NULL) {
+    return NULL;
+  }
+
+  size_t filled = 0;
+  while (filled + snippet_length <= size) {
+    memcpy(input + filled, snippet, snippet_length);
+    filled += snippet_length;
+  }
+  memset(input + filled, ' ', size - filled);
+  input[size] = '\0';
+
+  return input;
+}
+
+static double lex_all(const char *input, size_t size, int rounds,
+                      long *tokens) {
+  double start = now_ns();
+  for (int round = 0; round < rounds; round++) {
+    init_lexer_len(input, size);
+    while (1) {
+      Token token = next_token();
+      (*tokens)++;
+      if (token.type == TOKEN_EOF) {
+        break;
+      }
+    }
+  }
+  return now_ns() - start;
+}
+
+static void bench_size(size_t size) {
+  char *input = make_input(snippet, size);
+  if (input == NULL) {
+    fprintf(stderr, "could not allocate %zu bytes\n", size);
+    return;
+  }
+
+  // Repeat small inputs so every size measures roughly the same amount of
+  // work and timer resolution does not dominate.
+  int rounds = size >= 10000000 ? 1 : (int)(100000000 / size);
+  long tokens = 0;
+  double elapsed = lex_all(input, size, rounds, &tokens);
+
+  printf("%12zu bytes  %10ld tokens  %8.3f bytes/ns\n", size, tokens,
+         (double)size * rounds / elapsed);
+
+  free(input);
+}
+
+static void bench_scanners(const char *name, const char *snippet) {
+  const char *level_names[] = {"scalar", "sse2", "avx2"};
+  size_t size = 10000000;
+  char *input = make_input(snippet, size);
+  if (input == NULL) {
+    fprintf(stderr, "could not allocate %zu bytes\n", size);
+    return;
+  }
+
+  ScanLevel best = scan_level();
+  for (int level = SCAN_SCALAR; level <= SCAN_AVX2; level++) {
+    if (!scan_select((ScanLevel)level)) {
+      continue;
+    }
+
+    long tokens = 0;
+    double elapsed = lex_all(input, size, 5, &tokens);
+    printf("%-12s %-8s %8.3f bytes/ns\n", name, level_names[level],
+           (double)size * 5 / elapsed);
+  }
+  scan_select(best);
+
+  free(input);
+}
+
+// Lexing throughput on numeric-heavy source, followed by the cost of
+// decoding the same literals with scan_decimal() and with a plain
+// digit-at-a-time loop.
+static void bench_numbers() {
+  size_t size = 10000000;
+  char *input = make_input(number_snippet, size);
+  if (input == NULL) {
+    fprintf(stderr, "could not allocate %zu bytes\n", size);
+    return;
+  }
+
+  long tokens = 0;
+  double elapsed = lex_all(input, size, 5, &tokens);
+  printf("numbers      lex      %8.3f bytes/ns\n",
+         (double)size * 5 / elapsed);
+
+  // Decode from a cache-sized sample so memory traffic does not hide the
+  // difference between the two loops.
+  TokenArray numbers;
+  token_array_init(&numbers);
+  Lexer lexer;
+  lexer_init(&lexer, input, 64 * 1024);
+  for (Token token = lexer_next_token(&lexer); token.type != TOKEN_EOF;
+       token = lexer_next_token(&lexer)) {
+    if (token.type == TOKEN_INT) {
+      token_array_push(&numbers, token);
+    }
+  }
+
+  // Sum the values so the decoding cannot be optimized away.
+  int rounds = 200;
+  uint64_t sum = 0;
+  double start = now_ns();
+  for (int round = 0; round < rounds; round++) {
+    for (size_t i = 0; i < numbers.count; i++) {
+      uint64_t value = 0;
+      scan_decimal(numbers.tokens[i].start,
+                   (size_t)numbers.tokens[i].length, &value);
+      sum += value;
+    }
+  }
+  double swar = (now_ns() - start) / rounds;
+
+  start = now_ns();
+  for (int round = 0; round < rounds; round++) {
+    for (size_t i = 0; i < numbers.count; i++) {
+      uint64_t value = 0;
+      for (int j = 0; j < numbers.tokens[i].length; j++) {
+        value = value * 10 + (uint64_t)(numbers.tokens[i].start[j] - '0');
+      }
+      sum -= value;
+    }
+  }
+  double loop = (now_ns() - start) / rounds;
+
+  printf("numbers      swar     %8.3f ns/literal\n", swar / numbers.count);
+  printf("numbers      loop     %8.3f ns/literal  (check %llu)\n",
+         loop / numbers.count, (unsigned long long)sum);
+
+  token_array_free(&numbers);
+  free(input);
+}
+
+// Lexes a file through the streaming lexer. Peak RSS should stay flat no
+// matter how large the file is.
+static void bench_stream(size_t size) {
+  FILE *file = tmpfile();
+  if (file == NULL) {
+    fprintf(stderr, "could not create a temporary file\n");
+    return;
+  }
+
+  size_t snippet_length = strlen(snippet);
+  size_t written = 0;
+  while (written + snippet_length <= size) {
+    fwrite(snippet, 1, snippet_length, file);
+    written += snippet_length;
+  }
+  fflush(file);
+
+  int fd = fileno(file);
+  lseek(fd, 0, SEEK_SET);
+
+  Lexer lexer;
+  lexer_init_fd(&lexer, fd, LEXER_STREAM_BUFFER);
+
+  long tokens = 0;
+  double start = now_ns();
+  while (lexer_next_token(&lexer).type != TOKEN_EOF) {
+    tokens++;
+  }
+  double elapsed = now_ns() - start;
+  lexer_free(&lexer);
+  fclose(file);
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("stream %12zu bytes  %10ld tokens  %8.3f bytes/ns  peak rss %ld KB\n",
+         written, tokens, (double)written / elapsed, usage.ru_maxrss);
+}
+
+// Compares one call per token with batches of the size the parser uses.
+static void bench_batch() {
+  size_t size = 10000000;
+  char *input = make_input(snippet, size);
+  if (input == NULL) {
+    fprintf(stderr, "could not allocate %zu bytes\n", size);
+    return;
+  }
+
+  long tokens = 0;
+  double single = lex_all(input, size, 5, &tokens);
+
+  Token batch[64];
+  double start = now_ns();
+  for (int round = 0; round < 5; round++) {
+    Lexer lexer;
+    lexer_init(&lexer, input, size);
+    while (1) {
+      int count = lexer_next_token_batch(&lexer, batch, 64);
+      if (batch[count - 1].type == TOKEN_EOF) {
+        break;
+      }
+    }
+  }
+  double batched = now_ns() - start;
+
+  printf("single       %8.3f bytes/ns\n", (double)size * 5 / single);
+  printf("batch of 64  %8.3f bytes/ns\n", (double)size * 5 / batched);
+
+  free(input);
+}
+
+// Scaling of tokenize_parallel() from one thread up to at least eight, or
+// one per CPU on larger machines.
+static void bench_parallel() {
+  size_t size = 100000000;
+  char *input = make_input(snippet, size);
+  if (input == NULL) {
+    fprintf(stderr, "could not allocate %zu bytes\n", size);
+    return;
+  }
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int max_threads = cpus > 8 ? (int)cpus : 8;
+  double single = 0;
+
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    TokenArray tokens;
+    double start = now_ns();
+    tokenize_parallel(input, size, threads, &tokens);
+    double elapsed = now_ns() - start;
+
+    if (threads == 1) {
+      single = elapsed;
+    }
+    printf("%2d threads  %8.3f bytes/ns  %5.2fx  (%zu tokens)\n", threads,
+           (double)size / elapsed, single / elapsed, tokens.count);
+    token_array_free(&tokens);
+  }
+
+  free(input);
+}
+
+int main() {
+  size_t sizes[] = {1000, 10000, 100000, 1000000, 10000000, 100000000};
+
+  // Run before the in-memory sizes so peak RSS reflects streaming alone.
+  bench_stream(10000000);
+  bench_stream(100000000);
+  printf("\n");
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    bench_size(sizes[i]);
+  }
+
+  printf("\n");
+  bench_scanners("mixed", snippet);
+  bench_scanners("whitespace", whitespace_snippet);
+  bench_scanners("identifier", identifier_snippet);
+
+  printf("\n");
+  bench_numbers();
+
+  printf("\n");
+  bench_batch();
+
+  printf("\n");
+  bench_parallel();
+
+  return 0;
+}
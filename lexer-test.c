@@ -1,9 +1,17 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "lexer.h"
+#include "scan.h"
+#include "tokenize.h"
+#include "sds.h"
+#include <ctype.h>
 #include <setjmp.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <cmocka.h>
 
@@ -13,6 +21,12 @@ typedef struct {
   int expected_line;
 } ExpectedToken;
 
+static void assert_literal_equal(Token token, const char *expected) {
+  sds literal = token_literal_materialize(token);
+  assert_string_equal(literal, expected);
+  sdsfree(literal);
+}
+
 static void test_next_token(void **state) {
   (void)state;
 
@@ -84,20 +98,517 @@ static void test_next_token(void **state) {
   };
 
   init_lexer(input);
+  LineMap lines;
+  line_map_init(&lines, input, strlen(input));
+
+  int num_tests = sizeof(tests) / sizeof(tests[0]);
+  for (int i = 0; i < num_tests; i++) {
+    Token token = next_token();
+
+    assert_int_equal(token.type, tests[i].expected_type);
+    assert_int_equal(line_map_position(&lines, token.offset).line,
+                     tests[i].expected_line);
+    assert_literal_equal(token, tests[i].expected_literal);
+  }
+
+  line_map_free(&lines);
+}
+
+static void test_next_token_length_bounded(void **state) {
+  (void)state;
+
+  // Only the first 9 bytes belong to the program; the rest must be ignored.
+  const char input[] = {'l', 'e', 't', ' ', 'x', ' ', '=', ' ', '5',
+                        '0', '0', ';'};
+
+  ExpectedToken tests[] = {
+      {TOKEN_LET, "let", 1},  {TOKEN_IDENT, "x", 1}, {TOKEN_ASSIGN, "=", 1},
+      {TOKEN_INT, "5", 1},    {TOKEN_EOF, "", 1},
+  };
+
+  init_lexer_len(input, 9);
+  LineMap lines;
+  line_map_init(&lines, input, 9);
 
   int num_tests = sizeof(tests) / sizeof(tests[0]);
   for (int i = 0; i < num_tests; i++) {
     Token token = next_token();
 
     assert_int_equal(token.type, tests[i].expected_type);
-    assert_int_equal(token.line, tests[i].expected_line);
-    assert_string_equal(token.literal, tests[i].expected_literal);
+    assert_int_equal(line_map_position(&lines, token.offset).line,
+                     tests[i].expected_line);
+    assert_literal_equal(token, tests[i].expected_literal);
+  }
+
+  line_map_free(&lines);
+}
+
+static void test_operators_and_names(void **state) {
+  (void)state;
+
+  const char *input = "==!=!@=";
+  TokenType expected[] = {TOKEN_EQ,      TOKEN_NOT_EQ, TOKEN_BANG,
+                          TOKEN_ILLEGAL, TOKEN_ASSIGN, TOKEN_EOF};
+  const char *names[] = {"==", "!=", "!", "ILLEGAL", "=", "EOF"};
+
+  init_lexer(input);
+
+  for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+    Token token = next_token();
+    assert_int_equal(token.type, expected[i]);
+    assert_string_equal(token_type_to_string(token.type), names[i]);
+  }
+}
+
+static void test_next_token_batch(void **state) {
+  (void)state;
+
+  const char *input = "let x = 5; x";
+  TokenType expected[] = {TOKEN_LET, TOKEN_IDENT, TOKEN_ASSIGN, TOKEN_INT,
+                          TOKEN_SEMICOLON, TOKEN_IDENT, TOKEN_EOF};
+  Token tokens[4];
+
+  init_lexer(input);
+
+  assert_int_equal(next_token_batch(tokens, 4), 4);
+  for (int i = 0; i < 4; i++) {
+    assert_int_equal(tokens[i].type, expected[i]);
+  }
+
+  // The second batch stops after EOF even though there is room for more.
+  assert_int_equal(next_token_batch(tokens, 4), 3);
+  for (int i = 0; i < 3; i++) {
+    assert_int_equal(tokens[i].type, expected[4 + i]);
+  }
+
+  assert_int_equal(next_token_batch(tokens, 4), 1);
+  assert_int_equal(tokens[0].type, TOKEN_EOF);
+}
+
+static void test_independent_lexers(void **state) {
+  (void)state;
+
+  Lexer first;
+  Lexer second;
+  lexer_init(&first, "let a", 5);
+  lexer_init(&second, "5 == 6", 6);
+
+  assert_int_equal(lexer_next_token(&first).type, TOKEN_LET);
+  assert_int_equal(lexer_next_token(&second).type, TOKEN_INT);
+  assert_int_equal(lexer_next_token(&first).type, TOKEN_IDENT);
+  assert_int_equal(lexer_next_token(&second).type, TOKEN_EQ);
+  assert_int_equal(lexer_next_token(&first).type, TOKEN_EOF);
+  assert_int_equal(lexer_next_token(&second).type, TOKEN_INT);
+  assert_int_equal(lexer_next_token(&second).type, TOKEN_EOF);
+}
+
+static void test_streaming_matches_in_memory(void **state) {
+  (void)state;
+
+  // Long identifiers, numbers, strings and whitespace runs, plus two-char
+  // operators, so that small buffers split every kind of token.
+  const char *input = "let a_rather_long_identifier = 1234567890123;\n"
+                      "\"a string\nspanning lines\" != \"\";\n"
+                      "                                \n"
+                      "if (x == 10) { return !y; } @\n"
+                      "\"unterminated";
+  size_t length = strlen(input);
+
+  FILE *file = tmpfile();
+  assert_non_null(file);
+  fwrite(input, 1, length, file);
+  fflush(file);
+  int fd = fileno(file);
+
+  size_t buffer_sizes[] = {1, 2, 3, 5, 8, 16, 64, LEXER_STREAM_BUFFER};
+  for (size_t i = 0; i < sizeof(buffer_sizes) / sizeof(buffer_sizes[0]); i++) {
+    lseek(fd, 0, SEEK_SET);
+
+    // The streaming lexer's bytes are gone by the time a position is
+    // asked for, so its map is fed as the input is read.
+    Lexer memory;
+    Lexer stream;
+    LineMap memory_lines;
+    LineMap stream_lines;
+    lexer_init(&memory, input, length);
+    line_map_init(&memory_lines, input, length);
+    line_map_init(&stream_lines, NULL, 0);
+    lexer_init_fd(&stream, fd, buffer_sizes[i]);
+    lexer_set_line_map(&stream, &stream_lines);
+
+    while (1) {
+      Token expected = lexer_next_token(&memory);
+      Token actual = lexer_next_token(&stream);
+
+      assert_int_equal(actual.type, expected.type);
+      assert_int_equal(actual.offset, expected.offset);
+      assert_int_equal(actual.length, expected.length);
+      assert_memory_equal(actual.start, expected.start, expected.length);
+
+      Position expected_position =
+          line_map_position(&memory_lines, expected.offset);
+      Position actual_position =
+          line_map_position(&stream_lines, actual.offset);
+      assert_int_equal(actual_position.line, expected_position.line);
+      assert_int_equal(actual_position.column, expected_position.column);
+
+      if (expected.type == TOKEN_EOF) {
+        break;
+      }
+    }
+
+    line_map_free(&memory_lines);
+    line_map_free(&stream_lines);
+    lexer_free(&stream);
+  }
+
+  fclose(file);
+}
+
+// A batch from a streaming lexer spans refills of a small buffer, and every
+// token in it must still read correctly once the batch is returned.
+static void test_streaming_batches(void **state) {
+  (void)state;
+
+  const char *input = "let numbers = [1, 22, 333, 4444];\n"
+                      "let name = \"some text\"; numbers[2] == name;\n"
+                      "fn(a, b) { a + b }(10, 20);";
+  size_t length = strlen(input);
+
+  FILE *file = tmpfile();
+  assert_non_null(file);
+  fwrite(input, 1, length, file);
+  fflush(file);
+  int fd = fileno(file);
+
+  int batch_sizes[] = {1, 3, 8, 64};
+  for (size_t i = 0; i < sizeof(batch_sizes) / sizeof(batch_sizes[0]); i++) {
+    lseek(fd, 0, SEEK_SET);
+    Lexer memory;
+    Lexer stream;
+    lexer_init(&memory, input, length);
+    lexer_init_fd(&stream, fd, 4);
+
+    Token batch[64];
+    int count;
+    do {
+      count = lexer_next_token_batch(&stream, batch, batch_sizes[i]);
+      for (int j = 0; j < count; j++) {
+        Token expected = lexer_next_token(&memory);
+        assert_int_equal(batch[j].type, expected.type);
+        assert_int_equal(batch[j].offset, expected.offset);
+        assert_int_equal(batch[j].length, expected.length);
+        assert_memory_equal(batch[j].start, expected.start, expected.length);
+      }
+    } while (batch[count - 1].type != TOKEN_EOF);
+    assert_int_equal(lexer_next_token(&memory).type, TOKEN_EOF);
+
+    lexer_free(&stream);
+  }
+
+  fclose(file);
+}
+
+static void test_parallel_matches_sequential(void **state) {
+  (void)state;
+
+  // Strings full of whitespace make most split points land inside a
+  // literal, so many chunks are mispredicted and have to be lexed again.
+  const char *input = "let s = \"a b c d e f g h i j k l m n o p\";\n"
+                      "let t = \"\n \n \n \n\"; let u = s + t;\n"
+                      "if (x != 10) { return \"  \" } else { [1, 2] }\n"
+                      "\"unterminated string with spaces to the end";
+  size_t length = strlen(input);
+
+  Lexer lexer;
+  lexer_init(&lexer, input, length);
+  TokenArray expected;
+  token_array_init(&expected);
+  while (1) {
+    Token token = lexer_next_token(&lexer);
+    token_array_push(&expected, token);
+    if (token.type == TOKEN_EOF) {
+      break;
+    }
+  }
+
+  for (int threads = 0; threads <= 40; threads++) {
+    TokenArray actual;
+    tokenize_parallel(input, length, threads, &actual);
+
+    assert_int_equal(actual.count, expected.count);
+    for (size_t i = 0; i < expected.count; i++) {
+      assert_int_equal(actual.tokens[i].type, expected.tokens[i].type);
+      assert_ptr_equal(actual.tokens[i].start, expected.tokens[i].start);
+      assert_int_equal(actual.tokens[i].length, expected.tokens[i].length);
+      assert_int_equal(actual.tokens[i].offset, expected.tokens[i].offset);
+      assert_int_equal(actual.tokens[i].symbol, expected.tokens[i].symbol);
+    }
+
+    token_array_free(&actual);
+  }
+
+  token_array_free(&expected);
+}
+
+static void test_line_map(void **state) {
+  (void)state;
+
+  const char *input = "let a = 1;\n"
+                      "\n"
+                      "  \"two\nlines\" @\n"
+                      "x";
+  size_t length = strlen(input);
+
+  LineMap lines;
+  line_map_init(&lines, input, length);
+
+  struct {
+    size_t offset;
+    int line;
+    int column;
+  } tests[] = {
+      {0, 1, 1},  {4, 1, 5},  {10, 1, 11}, {11, 2, 1}, {14, 3, 3},
+      {18, 3, 7}, {19, 4, 1}, {26, 4, 8},  {28, 5, 1}, {29, 5, 2},
+  };
+
+  // Nothing is indexed until a position is asked for, and then only as
+  // far as that position.
+  assert_int_equal(lines.indexed, 0);
+  Position first = line_map_position(&lines, 4);
+  assert_int_equal(first.line, 1);
+  assert_true(lines.indexed < length);
+
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+    Position position = line_map_position(&lines, tests[i].offset);
+    assert_int_equal(position.line, tests[i].line);
+    assert_int_equal(position.column, tests[i].column);
+  }
+
+  // Lookups out of order are answered from the index built so far.
+  Position again = line_map_position(&lines, 11);
+  assert_int_equal(again.line, 2);
+  assert_int_equal(again.column, 1);
+
+  line_map_free(&lines);
+
+  // Token offsets point at the first byte of the token, which for a
+  // string is its opening quote.
+  Lexer lexer;
+  lexer_init(&lexer, input, length);
+  size_t expected_offsets[] = {0, 4, 6, 8, 9, 14, 26, 28, 29};
+  for (size_t i = 0; i < sizeof(expected_offsets) / sizeof(size_t); i++) {
+    assert_int_equal(lexer_next_token(&lexer).offset, expected_offsets[i]);
+  }
+}
+
+static void test_integer_values(void **state) {
+  (void)state;
+
+  struct {
+    const char *input;
+    uint64_t value;
+    int overflow;
+  } tests[] = {
+      {"0", 0, 0},
+      {"7", 7, 0},
+      {"1234567", 1234567, 0},
+      {"12345678", 12345678, 0},
+      {"123456789", 123456789, 0},
+      {"9876543210987654", 9876543210987654ull, 0},
+      {"18446744073709551615", UINT64_MAX, 0},
+      {"18446744073709551616", 0, 1},
+      {"99999999999999999999", 0, 1},
+      {"123456789012345678901234567890", 0, 1},
+      {"0000000000000000000000000000042", 42, 0},
+  };
+
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+    Lexer lexer;
+    lexer_init(&lexer, tests[i].input, strlen(tests[i].input));
+    Token token = lexer_next_token(&lexer);
+
+    assert_int_equal(token.type, TOKEN_INT);
+    assert_int_equal(token.length, (int)strlen(tests[i].input));
+    assert_int_equal(token.overflow, tests[i].overflow);
+    assert_true(token.value == tests[i].value);
+  }
+
+  // Every prefix length of a long number, checked against a digit loop,
+  // so each mix of eight-digit chunks and leftover digits is covered.
+  const char *digits = "31415926535897932384";
+  for (int length = 1; length <= 19; length++) {
+    uint64_t expected = 0;
+    for (int i = 0; i < length; i++) {
+      expected = expected * 10 + (uint64_t)(digits[i] - '0');
+    }
+
+    uint64_t value;
+    assert_true(scan_decimal(digits, (size_t)length, &value));
+    assert_true(value == expected);
+  }
+
+  // Non-integer tokens carry no value.
+  Lexer lexer;
+  lexer_init(&lexer, "x", 1);
+  Token token = lexer_next_token(&lexer);
+  assert_true(token.value == 0);
+  assert_int_equal(token.overflow, 0);
+}
+
+static void test_identifier_symbols(void **state) {
+  (void)state;
+
+  const char *input = "let foo = bar + foo; let bar = \"foo\"; fn(foobar)";
+  Lexer lexer;
+  lexer_init(&lexer, input, strlen(input));
+
+  Symbol foo = intern("foo", 3);
+  Symbol bar = intern("bar", 3);
+  Symbol foobar = intern("foobar", 6);
+  assert_int_not_equal(foo, SYMBOL_NONE);
+  assert_int_not_equal(foo, bar);
+  assert_int_not_equal(foo, foobar);
+  assert_string_equal(symbol_name(foobar), "foobar");
+  assert_null(symbol_name(SYMBOL_NONE));
+
+  // The string "foo" and the keywords are not identifiers.
+  Symbol expected[] = {
+      SYMBOL_NONE, foo,         SYMBOL_NONE, bar,         SYMBOL_NONE,
+      foo,         SYMBOL_NONE, SYMBOL_NONE, bar,         SYMBOL_NONE,
+      SYMBOL_NONE, SYMBOL_NONE, SYMBOL_NONE, SYMBOL_NONE, foobar,
+      SYMBOL_NONE, SYMBOL_NONE,
+  };
+  for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+    Token token = lexer_next_token(&lexer);
+    assert_int_equal(token.symbol, expected[i]);
+  }
+
+  // A lexer without a table leaves identifiers uninterned.
+  lexer_init(&lexer, "foo", 3);
+  lexer.symbols = NULL;
+  assert_int_equal(lexer_next_token(&lexer).symbol, SYMBOL_NONE);
+}
+
+static void test_symbol_table(void **state) {
+  (void)state;
+
+  SymbolTable table;
+  symbol_table_init(&table);
+
+  // Enough names to grow the slots and names arrays several times.
+  char name[32];
+  for (int i = 0; i < 5000; i++) {
+    snprintf(name, sizeof(name), "name_%d", i);
+    assert_int_equal(symbol_table_intern(&table, name, (int)strlen(name)),
+                     (Symbol)(i + 1));
+  }
+  for (int i = 0; i < 5000; i++) {
+    snprintf(name, sizeof(name), "name_%d", i);
+    int length;
+    assert_int_equal(symbol_table_intern(&table, name, (int)strlen(name)),
+                     (Symbol)(i + 1));
+    assert_string_equal(symbol_table_name(&table, (Symbol)(i + 1), &length),
+                        name);
+    assert_int_equal(length, (int)strlen(name));
+  }
+
+  // A spelling longer than an arena block gets a block of its own.
+  int long_length = 64 * 1024;
+  char *long_name = malloc((size_t)long_length);
+  memset(long_name, 'x', (size_t)long_length);
+  Symbol long_symbol = symbol_table_intern(&table, long_name, long_length);
+  assert_int_equal(long_symbol, 5001);
+  assert_int_equal(symbol_table_intern(&table, long_name, long_length),
+                   long_symbol);
+  assert_null(symbol_table_name(&table, 5002, NULL));
+  free(long_name);
+
+  symbol_table_free(&table);
+}
+
+static void test_scan_levels(void **state) {
+  (void)state;
+
+  // Runs long enough to cross 16- and 32-byte blocks, ending on bytes that
+  // only differ from a match in a single bit.
+  const char *input = "  \t\n\r \n                        \n      \n   x"
+                      "a_very_long_identifier_with_Digits_0123456789_end@"
+                      "12345678901234567890123456789012345678901234567890/"
+                      "\xe2\x80\x9c";
+  size_t length = strlen(input);
+
+  ScanLevel best = scan_level();
+  ScanLevel levels[] = {SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2};
+
+  for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+    if (!scan_select(levels[i])) {
+      continue;
+    }
+
+    for (size_t from = 0; from <= length; from++) {
+      size_t end = scan_whitespace(input, from, length);
+      size_t expected = from;
+      while (expected < length && strchr(" \t\r\n", input[expected])) {
+        expected++;
+      }
+      assert_int_equal(end, expected);
+
+      expected = from;
+      while (expected < length &&
+             (isalnum((unsigned char)input[expected]) ||
+              input[expected] == '_')) {
+        expected++;
+      }
+      assert_int_equal(scan_identifier(input, from, length), expected);
+
+      expected = from;
+      while (expected < length && isdigit((unsigned char)input[expected])) {
+        expected++;
+      }
+      assert_int_equal(scan_digits(input, from, length), expected);
+    }
+  }
+
+  scan_select(best);
+}
+
+static void test_keywords(void **state) {
+  (void)state;
+
+  const char *input = "fn let true false if else return "
+                      "f fnn le lett tru false_ iff els returns Return _";
+
+  TokenType expected[] = {
+      TOKEN_FUNCTION, TOKEN_LET,   TOKEN_TRUE,  TOKEN_FALSE, TOKEN_IF,
+      TOKEN_ELSE,     TOKEN_RETURN, TOKEN_IDENT, TOKEN_IDENT, TOKEN_IDENT,
+      TOKEN_IDENT,    TOKEN_IDENT, TOKEN_IDENT, TOKEN_IDENT, TOKEN_IDENT,
+      TOKEN_IDENT,    TOKEN_IDENT, TOKEN_IDENT, TOKEN_EOF,
+  };
+
+  init_lexer(input);
+
+  for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+    assert_int_equal(next_token().type, expected[i]);
   }
 }
 
 int main(void) {
   const struct CMUnitTest tests[] = {
       cmocka_unit_test(test_next_token),
+      cmocka_unit_test(test_next_token_length_bounded),
+      cmocka_unit_test(test_keywords),
+      cmocka_unit_test(test_operators_and_names),
+      cmocka_unit_test(test_next_token_batch),
+      cmocka_unit_test(test_independent_lexers),
+      cmocka_unit_test(test_streaming_matches_in_memory),
+      cmocka_unit_test(test_streaming_batches),
+      cmocka_unit_test(test_parallel_matches_sequential),
+      cmocka_unit_test(test_line_map),
+      cmocka_unit_test(test_integer_values),
+      cmocka_unit_test(test_identifier_symbols),
+      cmocka_unit_test(test_symbol_table),
+      cmocka_unit_test(test_scan_levels),
   };
 
   return cmocka_run_group_tests(tests, NULL, NULL);
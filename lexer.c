@@ -1,226 +1,440 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "lexer.h"
+#include "keywords.h"
+#include "memory.h"
+#include "scan.h"
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+typedef enum {
+  CHAR_OTHER,
+  CHAR_END,
+  CHAR_WHITESPACE,
+  CHAR_LETTER,
+  CHAR_DIGIT,
+  CHAR_QUOTE,
+  CHAR_OPERATOR,
+} CharClass;
+
+// All tables below are indexed by the unsigned value of a character and
+// are filled in at compile time from OPERATORS in lexer.h.
+#define OPERATOR_CLASS(first, type, second, two_char_type)                    \
+  [(unsigned char)(first)] = CHAR_OPERATOR,
+#define OPERATOR_ONE_CHAR(first, type, second, two_char_type)                 \
+  [(unsigned char)(first)] = type,
+#define OPERATOR_SECOND(first, type, second, two_char_type)                   \
+  [(unsigned char)(first)] = second,
+#define OPERATOR_TWO_CHAR(first, type, second, two_char_type)                 \
+  [(unsigned char)(first)] = two_char_type,
+
+// Standard C has no range designators, so letters and digits are listed.
+#define LETTERS(X)                                                             \
+  X('a') X('b') X('c') X('d') X('e') X('f') X('g') X('h') X('i') X('j')        \
+  X('k') X('l') X('m') X('n') X('o') X('p') X('q') X('r') X('s') X('t')        \
+  X('u') X('v') X('w') X('x') X('y') X('z')                                    \
+  X('A') X('B') X('C') X('D') X('E') X('F') X('G') X('H') X('I') X('J')        \
+  X('K') X('L') X('M') X('N') X('O') X('P') X('Q') X('R') X('S') X('T')        \
+  X('U') X('V') X('W') X('X') X('Y') X('Z')
+#define DIGITS(X)                                                              \
+  X('0') X('1') X('2') X('3') X('4') X('5') X('6') X('7') X('8') X('9')
+#define LETTER_CLASS(c) [c] = CHAR_LETTER,
+#define DIGIT_CLASS(c) [c] = CHAR_DIGIT,
+
+static const unsigned char char_class[256] = {
+    [0] = CHAR_END,
+    [' '] = CHAR_WHITESPACE,
+    ['\t'] = CHAR_WHITESPACE,
+    ['\n'] = CHAR_WHITESPACE,
+    ['\r'] = CHAR_WHITESPACE,
+    LETTERS(LETTER_CLASS)
+    ['_'] = CHAR_LETTER,
+    DIGITS(DIGIT_CLASS)
+    ['"'] = CHAR_QUOTE,
+    OPERATORS(OPERATOR_CLASS)};
 
-static void read_char();
-static Lexer lexer;
+static const TokenType one_char_token[256] = {OPERATORS(OPERATOR_ONE_CHAR)};
+static const char two_char_second[256] = {OPERATORS(OPERATOR_SECOND)};
+static const TokenType two_char_token[256] = {OPERATORS(OPERATOR_TWO_CHAR)};
+
+#undef LETTERS
+#undef DIGITS
+#undef LETTER_CLASS
+#undef DIGIT_CLASS
+#undef OPERATOR_CLASS
+#undef OPERATOR_ONE_CHAR
+#undef OPERATOR_SECOND
+#undef OPERATOR_TWO_CHAR
+
+#define TOKEN_NAME(type, name) [type] = name,
+static const char *token_names[TOKEN_COUNT] = {TOKEN_TYPES(TOKEN_NAME)};
+#undef TOKEN_NAME
+
+static void read_char(Lexer *lexer);
+static Lexer default_lexer;
 
 void init_lexer(const char *input) {
-  lexer.input = input;
-  lexer.position = 0;
-  lexer.read_position = 0;
-  lexer.ch = 0;
-  lexer.line = 1;
+  lexer_free(&default_lexer);
+  lexer_init(&default_lexer, input, strlen(input));
+}
+
+void init_lexer_len(const char *input, size_t length) {
+  lexer_free(&default_lexer);
+  lexer_init(&default_lexer, input, length);
+}
+
+void init_lexer_fd(int fd) {
+  lexer_free(&default_lexer);
+  lexer_init_fd(&default_lexer, fd, LEXER_STREAM_BUFFER);
+}
+
+Token next_token() { return lexer_next_token(&default_lexer); }
+
+int next_token_batch(Token *out, int n) {
+  return lexer_next_token_batch(&default_lexer, out, n);
+}
+
+// The input does not need to be NUL-terminated: once position reaches length
+// the lexer sees a 0 character, which every scanning loop treats as the end.
+void lexer_init(Lexer *lexer, const char *input, size_t length) {
+  lexer->input = input;
+  lexer->length = length;
+  lexer->position = 0;
+  lexer->read_position = 0;
+  lexer->ch = 0;
+  lexer->base = 0;
+  lexer->token_start = 0;
+  lexer->line_map = NULL;
+  lexer->symbols = default_symbol_table();
+  symbol_cache_init(&lexer->symbol_cache);
+  lexer->fd = -1;
+  lexer->buffer = NULL;
+  lexer->capacity = 0;
+  lexer->at_eof = 1;
+  lexer->batch_start = SIZE_MAX;
+
+  read_char(lexer);
+}
+
+// Streaming mode: input is read from fd into a buffer of buffer_size bytes
+// that is refilled as the lexer reaches its end. Only the token being
+// scanned is kept across a refill, so the buffer grows only when a single
+// token is longer than buffer_size.
+void lexer_init_fd(Lexer *lexer, int fd, size_t buffer_size) {
+  if (buffer_size == 0) {
+    buffer_size = 1;
+  }
+
+  lexer->buffer = ALLOCATE(char, buffer_size);
+  lexer->capacity = buffer_size;
+  lexer->input = lexer->buffer;
+  lexer->length = 0;
+  lexer->position = 0;
+  lexer->read_position = 0;
+  lexer->ch = 0;
+  lexer->base = 0;
+  lexer->token_start = 0;
+  lexer->line_map = NULL;
+  lexer->symbols = default_symbol_table();
+  symbol_cache_init(&lexer->symbol_cache);
+  lexer->fd = fd;
+  lexer->at_eof = 0;
+  lexer->batch_start = SIZE_MAX;
+
+  read_char(lexer);
+}
+
+void lexer_set_line_map(Lexer *lexer, LineMap *map) {
+  // The first refill happened during init; index what it read.
+  size_t end = lexer->base + lexer->length;
+  if (map->indexed >= lexer->base && map->indexed < end) {
+    size_t from = map->indexed - lexer->base;
+    line_map_feed(map, lexer->input + from, lexer->length - from);
+  }
+  lexer->line_map = map;
+}
+
+void lexer_free(Lexer *lexer) {
+  FREE_ARRAY(char, lexer->buffer, lexer->capacity);
+  lexer->buffer = NULL;
+  lexer->capacity = 0;
+}
+
+// Moves the bytes from token_start, or from the start of the batch being
+// lexed, on to the front of the buffer and reads more input behind them.
+// Every position is rebased, so callers must not hold pointers into the
+// buffer across a call. Returns 0 once the input is exhausted; read errors
+// also end the input.
+static int refill(Lexer *lexer) {
+  if (lexer->at_eof) {
+    return 0;
+  }
+
+  size_t keep = lexer->token_start;
+  if (lexer->batch_start - lexer->base < keep) {
+    keep = lexer->batch_start - lexer->base;
+  }
+  memmove(lexer->buffer, lexer->buffer + keep, lexer->length - keep);
+  lexer->base += keep;
+  lexer->length -= keep;
+  lexer->position -= keep;
+  lexer->read_position -= keep;
+  lexer->token_start -= keep;
+
+  if (lexer->length == lexer->capacity) {
+    size_t old_capacity = lexer->capacity;
+    lexer->capacity = GROW_CAPACITY(old_capacity);
+    lexer->buffer =
+        GROW_ARRAY(char, lexer->buffer, old_capacity, lexer->capacity);
+  }
+  lexer->input = lexer->buffer;
+
+  ssize_t count;
+  do {
+    count = read(lexer->fd, lexer->buffer + lexer->length,
+                 lexer->capacity - lexer->length);
+  } while (count < 0 && errno == EINTR);
+
+  if (count <= 0) {
+    lexer->at_eof = 1;
+    return 0;
+  }
 
-  read_char();
+  if (lexer->line_map != NULL) {
+    line_map_feed(lexer->line_map, lexer->buffer + lexer->length,
+                  (size_t)count);
+  }
+  lexer->length += (size_t)count;
+  return 1;
 }
 
-static void read_char() {
-  if (lexer.read_position >= (int)strlen(lexer.input)) {
-    lexer.ch = 0;
+static void read_char(Lexer *lexer) {
+  if (lexer->read_position >= lexer->length && !refill(lexer)) {
+    lexer->ch = 0;
   } else {
-    lexer.ch = lexer.input[lexer.read_position];
+    lexer->ch = lexer->input[lexer->read_position];
   }
-  lexer.position = lexer.read_position;
-  lexer.read_position++;
+  lexer->position = lexer->read_position;
+  lexer->read_position++;
 }
 
-static char peek_char() {
-  if (lexer.read_position >= (int)strlen(lexer.input)) {
+static char peek_char(Lexer *lexer) {
+  if (lexer->read_position >= lexer->length && !refill(lexer)) {
     return 0;
   } else {
-    return lexer.input[lexer.read_position];
+    return lexer->input[lexer->read_position];
   }
 }
 
-static void skip_whitespace() {
-  while (lexer.ch == ' ' || lexer.ch == '\t' || lexer.ch == '\n' ||
-         lexer.ch == '\r') {
-    if (lexer.ch == '\n') {
-      lexer.line++;
-    }
-    read_char();
+// Jumps to an absolute position, as if read_char() had been called until
+// that position became current.
+static void advance_to(Lexer *lexer, size_t position) {
+  lexer->read_position = position;
+  read_char(lexer);
+}
+
+static CharClass classify(char ch) {
+  return (CharClass)char_class[(unsigned char)ch];
+}
+
+static int is_whitespace(char ch) { return classify(ch) == CHAR_WHITESPACE; }
+
+static int is_identifier_char(char ch) {
+  CharClass char_class = classify(ch);
+  return char_class == CHAR_LETTER || char_class == CHAR_DIGIT;
+}
+
+static void skip_whitespace(Lexer *lexer) {
+  if (!is_whitespace(lexer->ch)) {
+    return;
+  }
+
+  // Most runs are a single separator; only longer ones are worth handing
+  // to the vectorized scanner.
+  lexer->token_start = lexer->position;
+  if (!is_whitespace(peek_char(lexer))) {
+    read_char(lexer);
+    return;
   }
+
+  // Outside a batch, scanned whitespace is never kept across a refill, so a
+  // streaming lexer can skip runs longer than its buffer. The loop only
+  // repeats when a refill brought in more whitespace.
+  do {
+    size_t end =
+        scan_whitespace(lexer->input, lexer->position, lexer->length);
+    lexer->token_start = end;
+    advance_to(lexer, end);
+  } while (is_whitespace(lexer->ch));
 }
 
-Token make_token(TokenType type, const char *start, int length, int line) {
+Token make_token(TokenType type, const char *start, int length,
+                 size_t offset) {
   Token token;
   token.type = type;
-  token.literal = sdsnewlen(start, length);
-  token.line = line;
+  token.symbol = SYMBOL_NONE;
+  token.value = 0;
+  token.overflow = 0;
+  token.start = start;
+  token.length = length;
+  token.offset = offset;
   return token;
 }
 
-static int is_letter(char ch) {
-  return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+sds token_literal_materialize(Token token) {
+  return sdsnewlen(token.start, token.length);
 }
 
-static int is_digit(char ch) { return ch >= '0' && ch <= '9'; }
+int token_literal_equals(Token token, const char *text) {
+  return strncmp(token.start, text, token.length) == 0 &&
+         text[token.length] == '\0';
+}
+
+const char *token_type_to_string(TokenType type) {
+  if (type < 0 || type >= TOKEN_COUNT) {
+    return "UNKNOWN";
+  }
+  return token_names[type];
+}
 
+// keyword_table and KEYWORD_HASH are generated by keywords-gen: every
+// keyword lands in its own slot, so one hash and one compare classify an
+// identifier.
 static TokenType lookup_ident(const char *start, int length) {
-  if (length == 2 && strncmp(start, "fn", 2) == 0)
-    return TOKEN_FUNCTION;
-  if (length == 2 && strncmp(start, "if", 2) == 0)
-    return TOKEN_IF;
-  if (length == 3 && strncmp(start, "let", 3) == 0)
-    return TOKEN_LET;
-  if (length == 4 && strncmp(start, "true", 4) == 0)
-    return TOKEN_TRUE;
-  if (length == 4 && strncmp(start, "else", 4) == 0)
-    return TOKEN_ELSE;
-  if (length == 5 && strncmp(start, "false", 5) == 0)
-    return TOKEN_FALSE;
-  if (length == 6 && strncmp(start, "return", 6) == 0)
-    return TOKEN_RETURN;
+  const Keyword *keyword = &keyword_table[KEYWORD_HASH(start, length)];
+  if (keyword->length == length &&
+      memcmp(keyword->name, start, (size_t)length) == 0) {
+    return keyword->type;
+  }
   return TOKEN_IDENT;
 }
 
-static Token read_identifier() {
-  const char *start = lexer.input + lexer.position;
-  int line = lexer.line;
+// Token text is located through token_start rather than a pointer taken
+// up front: in streaming mode the buffer may move while the token is
+// scanned.
+// The token's offset is where it starts in the whole input, counting any
+// skipped prefix such as a string's opening quote.
+static Token token_from_start(Lexer *lexer, TokenType type, size_t skip) {
+  const char *start = lexer->input + lexer->token_start + skip;
+  int length = (int)(lexer->position - lexer->token_start - skip);
+  return make_token(type, start, length, lexer->base + lexer->token_start);
+}
 
-  while (is_letter(lexer.ch) || is_digit(lexer.ch)) {
-    read_char();
-  }
+static Token read_identifier(Lexer *lexer) {
+  lexer->token_start = lexer->position;
 
-  int length = (lexer.input + lexer.position) - start;
-  TokenType type = lookup_ident(start, length);
+  do {
+    advance_to(lexer, scan_identifier(lexer->input, lexer->position + 1,
+                                      lexer->length));
+  } while (is_identifier_char(lexer->ch));
 
-  return make_token(type, start, length, line);
+  Token token = token_from_start(lexer, TOKEN_IDENT, 0);
+  token.type = lookup_ident(token.start, token.length);
+  if (token.type == TOKEN_IDENT && lexer->symbols != NULL) {
+    token.symbol = symbol_cache_intern(&lexer->symbol_cache, lexer->symbols,
+                                       token.start, token.length);
+  }
+  return token;
 }
 
-static Token read_number() {
-  const char *start = lexer.input + lexer.position;
-  int line = lexer.line;
+static Token read_number(Lexer *lexer) {
+  lexer->token_start = lexer->position;
 
-  while (is_digit(lexer.ch)) {
-    read_char();
-  }
+  do {
+    advance_to(lexer,
+               scan_digits(lexer->input, lexer->position + 1, lexer->length));
+  } while (classify(lexer->ch) == CHAR_DIGIT);
 
-  int length = (lexer.input + lexer.position) - start;
-  return make_token(TOKEN_INT, start, length, line);
+  // The digits were just scanned, so decoding them again is cheap and
+  // spares the parser a second pass over the source.
+  Token token = token_from_start(lexer, TOKEN_INT, 0);
+  token.overflow =
+      !scan_decimal(token.start, (size_t)token.length, &token.value);
+  if (token.overflow) {
+    token.value = 0;
+  }
+  return token;
 }
 
-static Token read_string() {
-  const char *start = lexer.input + lexer.position + 1;
-  int line = lexer.line;
+static Token read_string(Lexer *lexer) {
+  lexer->token_start = lexer->position;
 
-  read_char();
-  while (lexer.ch != '"' && lexer.ch != 0) {
-    if (lexer.ch == '\n') {
-      lexer.line++;
-    }
-    read_char();
+  read_char(lexer);
+  while (lexer->ch != '"' && lexer->ch != 0) {
+    read_char(lexer);
   }
 
-  int length = (lexer.input + lexer.position) - start;
+  // Skip the opening quote; the closing one is not part of the literal.
+  Token token = token_from_start(lexer, TOKEN_STRING, 1);
 
-  if (lexer.ch == '"') {
-    read_char();
+  if (lexer->ch == '"') {
+    read_char(lexer);
+    token.start = lexer->input + lexer->token_start + 1;
   }
 
-  return make_token(TOKEN_STRING, start, length, line);
+  return token;
 }
 
-Token next_token() {
-  Token token;
+static Token read_operator(Lexer *lexer) {
+  unsigned char first = (unsigned char)lexer->ch;
+  TokenType type = one_char_token[first];
+  lexer->token_start = lexer->position;
 
-  skip_whitespace();
-
-  switch (lexer.ch) {
-  case '=':
-    if (peek_char() == '=') {
-      const char *start = lexer.input + lexer.position;
-      int line = lexer.line;
-      read_char();
-      token = make_token(TOKEN_EQ, start, 2, line);
-    } else {
-      token =
-          make_token(TOKEN_ASSIGN, lexer.input + lexer.position, 1, lexer.line);
-    }
-    break;
-  case '+':
-    token = make_token(TOKEN_PLUS, lexer.input + lexer.position, 1, lexer.line);
-    break;
-  case '-':
-    token =
-        make_token(TOKEN_MINUS, lexer.input + lexer.position, 1, lexer.line);
-    break;
-  case '!':
-    if (peek_char() == '=') {
-      const char *start = lexer.input + lexer.position;
-      int line = lexer.line;
-      read_char();
-      token = make_token(TOKEN_NOT_EQ, start, 2, line);
-    } else {
-      token =
-          make_token(TOKEN_BANG, lexer.input + lexer.position, 1, lexer.line);
-    }
-    break;
-  case '*':
-    token =
-        make_token(TOKEN_ASTERISK, lexer.input + lexer.position, 1, lexer.line);
-    break;
-  case '/':
-    token =
-        make_token(TOKEN_SLASH, lexer.input + lexer.position, 1, lexer.line);
-    break;
-  case '<':
-    token = make_token(TOKEN_LT, lexer.input + lexer.position, 1, lexer.line);
-    break;
-  case '>':
-    token = make_token(TOKEN_GT, lexer.input + lexer.position, 1, lexer.line);
-    break;
-  case ',':
-    token =
-        make_token(TOKEN_COMMA, lexer.input + lexer.position, 1, lexer.line);
-    break;
-  case ';':
-    token = make_token(TOKEN_SEMICOLON, lexer.input + lexer.position, 1,
-                       lexer.line);
-    break;
-  case '(':
-    token =
-        make_token(TOKEN_LPAREN, lexer.input + lexer.position, 1, lexer.line);
-    break;
-  case ')':
-    token =
-        make_token(TOKEN_RPAREN, lexer.input + lexer.position, 1, lexer.line);
-    break;
-  case '{':
-    token =
-        make_token(TOKEN_LBRACE, lexer.input + lexer.position, 1, lexer.line);
-    break;
-  case '}':
-    token =
-        make_token(TOKEN_RBRACE, lexer.input + lexer.position, 1, lexer.line);
-    break;
-  case '[':
-    token =
-        make_token(TOKEN_LBRACKET, lexer.input + lexer.position, 1, lexer.line);
-    break;
-  case ']':
-    token =
-        make_token(TOKEN_RBRACKET, lexer.input + lexer.position, 1, lexer.line);
-    break;
-  case '"':
-    return read_string();
-  case 0:
-    token = make_token(TOKEN_EOF, lexer.input + lexer.position, 0, lexer.line);
-    break;
+  if (two_char_second[first] != 0 &&
+      peek_char(lexer) == two_char_second[first]) {
+    read_char(lexer);
+    type = two_char_token[first];
+  }
+
+  read_char(lexer);
+  return token_from_start(lexer, type, 0);
+}
+
+Token lexer_next_token(Lexer *lexer) {
+  skip_whitespace(lexer);
+
+  switch (classify(lexer->ch)) {
+  case CHAR_OPERATOR:
+    return read_operator(lexer);
+  case CHAR_LETTER:
+    return read_identifier(lexer);
+  case CHAR_DIGIT:
+    return read_number(lexer);
+  case CHAR_QUOTE:
+    return read_string(lexer);
+  case CHAR_END:
+    return make_token(TOKEN_EOF, lexer->input + lexer->position, 0,
+                      lexer->base + lexer->position);
   default:
-    if (is_letter(lexer.ch)) {
-      return read_identifier();
-    } else if (is_digit(lexer.ch)) {
-      return read_number();
-    } else {
-      token = make_token(TOKEN_ILLEGAL, lexer.input + lexer.position, 1,
-                         lexer.line);
-    }
-    break;
+    lexer->token_start = lexer->position;
+    read_char(lexer);
+    return token_from_start(lexer, TOKEN_ILLEGAL, 0);
   }
+}
 
-  read_char();
-  return token;
+// A streaming refill keeps the batch's bytes but may move them, so the
+// tokens already in the batch are pointed at their new place.
+int lexer_next_token_batch(Lexer *lexer, Token *out, int n) {
+  int count = 0;
+  while (count < n) {
+    const char *input = lexer->input;
+    size_t base = lexer->base;
+    out[count] = lexer_next_token(lexer);
+    if (count == 0) {
+      lexer->batch_start = out[0].offset;
+    } else if (lexer->input != input || lexer->base != base) {
+      for (int i = 0; i < count; i++) {
+        size_t at = base + (size_t)(out[i].start - input);
+        out[i].start = lexer->input + (at - lexer->base);
+      }
+    }
+    if (out[count++].type == TOKEN_EOF) {
+      break;
+    }
+  }
+  lexer->batch_start = SIZE_MAX;
+  return count;
 }
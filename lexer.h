@@ -1,64 +1,169 @@
 #ifndef lexer_h
 #define lexer_h
 
-#import "sds.h"
+#include <stddef.h>
+#include <stdint.h>
+#include "intern.h"
+#include "linemap.h"
+#include "sds.h"
+
+// Every token type with its display name. The enum, the name table used by
+// token_type_to_string() and the REPL are all generated from this list.
+#define TOKEN_TYPES(X) \
+    X(TOKEN_ILLEGAL, "ILLEGAL") \
+    X(TOKEN_EOF, "EOF") \
+    \
+    X(TOKEN_IDENT, "IDENT") \
+    X(TOKEN_INT, "INT") \
+    X(TOKEN_STRING, "STRING") \
+    \
+    X(TOKEN_ASSIGN, "=") \
+    X(TOKEN_PLUS, "+") \
+    X(TOKEN_MINUS, "-") \
+    X(TOKEN_BANG, "!") \
+    X(TOKEN_ASTERISK, "*") \
+    X(TOKEN_SLASH, "/") \
+    \
+    X(TOKEN_LT, "<") \
+    X(TOKEN_GT, ">") \
+    \
+    X(TOKEN_EQ, "==") \
+    X(TOKEN_NOT_EQ, "!=") \
+    \
+    X(TOKEN_COMMA, ",") \
+    X(TOKEN_SEMICOLON, ";") \
+    \
+    X(TOKEN_LPAREN, "(") \
+    X(TOKEN_RPAREN, ")") \
+    X(TOKEN_LBRACE, "{") \
+    X(TOKEN_RBRACE, "}") \
+    X(TOKEN_LBRACKET, "[") \
+    X(TOKEN_RBRACKET, "]") \
+    \
+    X(TOKEN_FUNCTION, "FUNCTION") \
+    X(TOKEN_LET, "LET") \
+    X(TOKEN_TRUE, "TRUE") \
+    X(TOKEN_FALSE, "FALSE") \
+    X(TOKEN_IF, "IF") \
+    X(TOKEN_ELSE, "ELSE") \
+    X(TOKEN_RETURN, "RETURN")
+
+// Operator spellings, one entry per leading character:
+// X(first, one_char_type, second, two_char_type). When the character after
+// first is second, the lexer produces two_char_type; a second of 0 means
+// the operator is always a single character. The lexer's character-class
+// and transition tables are generated from this list.
+#define OPERATORS(X) \
+    X('=', TOKEN_ASSIGN, '=', TOKEN_EQ) \
+    X('!', TOKEN_BANG, '=', TOKEN_NOT_EQ) \
+    X('+', TOKEN_PLUS, 0, TOKEN_ILLEGAL) \
+    X('-', TOKEN_MINUS, 0, TOKEN_ILLEGAL) \
+    X('*', TOKEN_ASTERISK, 0, TOKEN_ILLEGAL) \
+    X('/', TOKEN_SLASH, 0, TOKEN_ILLEGAL) \
+    X('<', TOKEN_LT, 0, TOKEN_ILLEGAL) \
+    X('>', TOKEN_GT, 0, TOKEN_ILLEGAL) \
+    X(',', TOKEN_COMMA, 0, TOKEN_ILLEGAL) \
+    X(';', TOKEN_SEMICOLON, 0, TOKEN_ILLEGAL) \
+    X('(', TOKEN_LPAREN, 0, TOKEN_ILLEGAL) \
+    X(')', TOKEN_RPAREN, 0, TOKEN_ILLEGAL) \
+    X('{', TOKEN_LBRACE, 0, TOKEN_ILLEGAL) \
+    X('}', TOKEN_RBRACE, 0, TOKEN_ILLEGAL) \
+    X('[', TOKEN_LBRACKET, 0, TOKEN_ILLEGAL) \
+    X(']', TOKEN_RBRACKET, 0, TOKEN_ILLEGAL)
 
 typedef enum {
-    TOKEN_ILLEGAL,
-    TOKEN_EOF,
-    
-    TOKEN_IDENT,
-    TOKEN_INT,
-    TOKEN_STRING,
-    
-    TOKEN_ASSIGN,
-    TOKEN_PLUS,
-    TOKEN_MINUS,
-    TOKEN_BANG,
-    TOKEN_ASTERISK,
-    TOKEN_SLASH,
-    
-    TOKEN_LT,
-    TOKEN_GT,
-    
-    TOKEN_EQ,
-    TOKEN_NOT_EQ,
-    
-    TOKEN_COMMA,
-    TOKEN_SEMICOLON,
-    
-    TOKEN_LPAREN,
-    TOKEN_RPAREN,
-    TOKEN_LBRACE,
-    TOKEN_RBRACE,
-    TOKEN_LBRACKET,
-    TOKEN_RBRACKET,
-    
-    TOKEN_FUNCTION,
-    TOKEN_LET,
-    TOKEN_TRUE,
-    TOKEN_FALSE,
-    TOKEN_IF,
-    TOKEN_ELSE,
-    TOKEN_RETURN,
+#define TOKEN_ENUM(type, name) type,
+    TOKEN_TYPES(TOKEN_ENUM)
+#undef TOKEN_ENUM
+    TOKEN_COUNT
 } TokenType;
 
+// Reserved words. keywords-gen builds a perfect hash over this list at
+// compile time (see keywords.h), so adding an entry here is all it takes.
+#define KEYWORDS(X) \
+    X("fn", TOKEN_FUNCTION) \
+    X("let", TOKEN_LET) \
+    X("true", TOKEN_TRUE) \
+    X("false", TOKEN_FALSE) \
+    X("if", TOKEN_IF) \
+    X("else", TOKEN_ELSE) \
+    X("return", TOKEN_RETURN)
+
+// A token does not own its text: start/length is a view into the source
+// buffer, which must outlive the token. Use token_literal_materialize() to
+// get an owned copy. Identifiers also carry their interned symbol, which
+// stays valid after the source is gone; every other token has SYMBOL_NONE.
+// Integers are decoded while lexing: value holds the number, or overflow is
+// set if it does not fit in 64 bits. Both are 0 for other tokens.
 typedef struct {
     TokenType type;
-    sds literal;
-    int line;
+    Symbol symbol;
+    const char* start;
+    int length;
+    int overflow;
+    uint64_t value;
+    // Byte offset of the token in the whole input; resolve it to a line
+    // and column with a LineMap when a position is needed.
+    size_t offset;
 } Token;
 
 typedef struct {
     const char* input;
-    int position;
-    int read_position;
+    size_t length;
+    size_t position;
+    size_t read_position;
     char ch;
-    int line;
+    // Offset of input[0] in the whole input; only moves in streaming mode.
+    size_t base;
+    size_t token_start;
+    // Table identifiers are interned into; NULL skips interning.
+    SymbolTable* symbols;
+    SymbolCache symbol_cache;
+    // Streaming mode only: input is refilled from fd into buffer, and
+    // every refill is indexed into line_map if one is set.
+    LineMap* line_map;
+    int fd;
+    char* buffer;
+    size_t capacity;
+    int at_eof;
+    // While a batch is lexed, the offset of its first token in the whole
+    // input; refills keep the bytes from there on. SIZE_MAX otherwise.
+    size_t batch_start;
 } Lexer;
 
+#define LEXER_STREAM_BUFFER (64 * 1024)
+
+// Context API: every call works on an explicit Lexer, so independent
+// lexers can run concurrently. Lexers intern into default_symbol_table();
+// set symbols after init to use another table or none.
+void lexer_init(Lexer* lexer, const char* input, size_t length);
+Token lexer_next_token(Lexer* lexer);
+// Lexes up to n tokens into out and returns how many were written. A batch
+// ends early after the EOF token; later batches contain just EOF again.
+// In streaming mode every token of a batch stays valid until the next call,
+// so the buffer grows to hold a batch's text if it must.
+int lexer_next_token_batch(Lexer* lexer, Token* out, int n);
+
+// Streaming mode reads from fd in chunks of buffer_size bytes, so memory use
+// stays bounded however large the input is. A token's text is only valid
+// until the next call to lexer_next_token(). lexer_free() releases the
+// buffer; it is a no-op for in-memory lexers.
+void lexer_init_fd(Lexer* lexer, int fd, size_t buffer_size);
+// Has a streaming lexer index its input into map (created with a NULL
+// input) as it reads, so positions can be resolved after the bytes are
+// gone. Call it right after lexer_init_fd().
+void lexer_set_line_map(Lexer* lexer, LineMap* map);
+void lexer_free(Lexer* lexer);
+
+// Convenience wrappers around a single file-static Lexer.
 void init_lexer(const char* input);
+void init_lexer_len(const char* input, size_t length);
+void init_lexer_fd(int fd);
 Token next_token();
-Token make_token(TokenType type, const char *start, int length, int line);
+int next_token_batch(Token* out, int n);
+Token make_token(TokenType type, const char* start, int length, size_t offset);
+const char* token_type_to_string(TokenType type);
+sds token_literal_materialize(Token token);
+int token_literal_equals(Token token, const char *text);
 
 #endif
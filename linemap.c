@@ -0,0 +1,82 @@
+#include "linemap.h"
+#include "memory.h"
+#include <string.h>
+
+static void add_line(LineMap *map, size_t start) {
+  if (map->count >= map->capacity) {
+    size_t old_capacity = map->capacity;
+    map->capacity = GROW_CAPACITY(old_capacity);
+    map->starts =
+        GROW_ARRAY(size_t, map->starts, old_capacity, map->capacity);
+  }
+
+  map->starts[map->count] = start;
+  map->count++;
+}
+
+void line_map_init(LineMap *map, const char *input, size_t length) {
+  map->input = input;
+  map->length = length;
+  map->starts = NULL;
+  map->count = 0;
+  map->capacity = 0;
+  map->indexed = 0;
+
+  add_line(map, 0);
+}
+
+void line_map_free(LineMap *map) {
+  FREE_ARRAY(size_t, map->starts, map->capacity);
+  map->starts = NULL;
+  map->count = 0;
+  map->capacity = 0;
+}
+
+// memchr() is vectorized by the C library, so runs without a newline are
+// skipped many bytes at a time.
+void line_map_feed(LineMap *map, const char *bytes, size_t length) {
+  const char *at = bytes;
+  const char *end = bytes + length;
+
+  while ((at = memchr(at, '\n', (size_t)(end - at))) != NULL) {
+    at++;
+    add_line(map, map->indexed + (size_t)(at - bytes));
+  }
+  map->indexed += length;
+}
+
+Position line_map_position(LineMap *map, size_t offset) {
+  // Only index as far as needed: errors tend to come in source order, so
+  // most lookups extend the index by a little or not at all.
+  if (map->input != NULL && offset >= map->indexed &&
+      map->indexed < map->length) {
+    size_t to = offset < map->length ? offset + 1 : map->length;
+    line_map_feed(map, map->input + map->indexed, to - map->indexed);
+  }
+
+  // Find the last line that starts at or before offset.
+  size_t low = 0;
+  size_t high = map->count;
+  while (high - low > 1) {
+    size_t middle = low + (high - low) / 2;
+    if (map->starts[middle] <= offset) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+
+  Position position;
+  position.line = (int)low + 1;
+  position.column = (int)(offset - map->starts[low]) + 1;
+  return position;
+}
+
+void line_map_truncate(LineMap *map, size_t offset) {
+  while (map->count > 1 && map->starts[map->count - 1] > offset) {
+    map->count--;
+  }
+  if (map->indexed > offset) {
+    map->indexed = offset;
+  }
+}
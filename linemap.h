@@ -0,0 +1,38 @@
+#ifndef linemap_h
+#define linemap_h
+
+#include <stddef.h>
+
+// 1-based line and column of a byte offset. Columns count bytes.
+typedef struct {
+    int line;
+    int column;
+} Position;
+
+// Maps byte offsets to positions. Tokens only record their offset; the
+// newline index is built the first time a position is asked for, so code
+// that never reports a position never pays for it.
+typedef struct {
+    const char* input;
+    size_t length;
+    // starts[i] is the offset at which line i + 1 begins.
+    size_t* starts;
+    size_t count;
+    size_t capacity;
+    // Bytes scanned for newlines so far.
+    size_t indexed;
+} LineMap;
+
+// input may be NULL when the bytes are not kept around (streaming lexers);
+// such a map only knows what line_map_feed() has given it.
+void line_map_init(LineMap* map, const char* input, size_t length);
+void line_map_free(LineMap* map);
+// Indexes the next length bytes of the input, which start at offset
+// map->indexed.
+void line_map_feed(LineMap* map, const char* bytes, size_t length);
+Position line_map_position(LineMap* map, size_t offset);
+// Forgets everything from offset on, for when the input changes there;
+// lines that start at or before offset are kept.
+void line_map_truncate(LineMap* map, size_t offset);
+
+#endif
@@ -1,8 +1,85 @@
+#include "ast.h"
+#include "cache.h"
+#include "memory.h"
+#include "parser.h"
 #include "repl.h"
+#include "sds.h"
+#include "source.h"
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+static int run_file(const char *path) {
+  Source source;
+  if (source_open(&source, path) < 0) {
+    fprintf(stderr, "Could not read \"%s\": %s\n", path, strerror(errno));
+    return 74;
+  }
+
+  // With MONKEY_CACHE_DIR set, an unchanged script is loaded from the
+  // cache instead of being parsed again.
+  const char *cache = getenv("MONKEY_CACHE_DIR");
+  Node *program = NULL;
+  if (cache != NULL) {
+    program = cache_load(cache, source.data, source.length);
+  }
+
+  // The parser works directly on the mapped bytes; tokens are views into
+  // them, so the source stays open until we are done with the program.
+  int error_count = 0;
+  if (program == NULL) {
+    Parser parser;
+    parser_init(&parser, source.data, source.length);
+    program = parser_parse_program(&parser);
+
+    ParseError *errors = parser_get_errors(&parser, &error_count);
+    if (cache != NULL && error_count == 0 &&
+        cache_store(cache, source.data, source.length, program) < 0) {
+      fprintf(stderr, "Could not write to cache \"%s\": %s\n", cache,
+              strerror(errno));
+    }
+    for (int i = 0; i < error_count; i++) {
+      Position position = parser_error_position(&parser, &errors[i]);
+      sds message = parse_error_message(&errors[i]);
+      fprintf(stderr, "%s:%d:%d: %s\n", path, position.line,
+              position.column, message);
+      sdsfree(message);
+    }
+    parser_free(&parser);
+  }
+
+  if (error_count == 0) {
+    sds output = node_to_string(program);
+    printf("%s\n", output);
+    sdsfree(output);
+  }
+
+  program_free(program);
+  source_close(&source);
+  return error_count == 0 ? 0 : 65;
+}
+
+#ifdef MEMORY_STATS
+static void dump_memory_stats(void) { memory_stats_dump(stderr); }
+#endif
+
+int main(int argc, char *argv[]) {
+#ifdef MEMORY_STATS
+  // With MONKEY_MEMORY_STATS set, a build that counts allocations lists
+  // them by call site on exit.
+  if (getenv("MONKEY_MEMORY_STATS") != NULL) {
+    atexit(dump_memory_stats);
+  }
+#endif
+  if (argc == 2) {
+    return run_file(argv[1]);
+  }
+  if (argc > 2) {
+    fprintf(stderr, "Usage: monkey [path]\n");
+    return 64;
+  }
 
-int main() {
   printf("Hello! This is the Monkey programming language!\n");
   printf("Feel free to type in commands\n");
 
@@ -1,9 +1,10 @@
 #include "memory.h"
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
-void *reallocate(void *pointer, size_t old_size, size_t new_size) {
-  (void)old_size;
-
+static void *libc_resize(void *pointer, size_t new_size) {
   if (new_size == 0) {
     free(pointer);
     return NULL;
@@ -15,3 +16,313 @@ void *reallocate(void *pointer, size_t old_size, size_t new_size) {
 
   return result;
 }
+
+#ifdef MEMORY_POOL
+
+// Blocks of up to the largest class size come from a free list per size
+// class, refilled a slab at a time; larger ones go to realloc(). Callers
+// always pass reallocate() a block's old size, so blocks carry no header:
+// the old size says which class a block came from. Slabs are kept for the
+// life of the process.
+#define SLAB_SIZE 4096
+
+static const size_t class_sizes[] = {16,  32,  48,  64,  96,  128,
+                                     192, 256, 384, 512, 768, 1024};
+
+#define CLASS_COUNT (int)(sizeof(class_sizes) / sizeof(class_sizes[0]))
+#define LARGE CLASS_COUNT
+
+typedef struct FreeBlock {
+  struct FreeBlock *next;
+} FreeBlock;
+
+typedef struct Slab {
+  struct Slab *next;
+} Slab;
+
+#define SLAB_HEADER sizeof(union { Slab slab; long double align; })
+
+typedef struct {
+  FreeBlock *free;
+  // The part of the newest slab no block has been cut from yet.
+  char *next;
+  char *end;
+  // Every slab, so they stay reachable for leak checkers.
+  Slab *slabs;
+  pthread_mutex_t lock;
+} SizeClass;
+
+#define CLASS_INIT {NULL, NULL, NULL, NULL, PTHREAD_MUTEX_INITIALIZER}
+
+static SizeClass classes[CLASS_COUNT] = {
+    CLASS_INIT, CLASS_INIT, CLASS_INIT, CLASS_INIT, CLASS_INIT, CLASS_INIT,
+    CLASS_INIT, CLASS_INIT, CLASS_INIT, CLASS_INIT, CLASS_INIT, CLASS_INIT,
+};
+
+static int size_class(size_t size) {
+  for (int i = 0; i < CLASS_COUNT; i++) {
+    if (size <= class_sizes[i]) {
+      return i;
+    }
+  }
+  return LARGE;
+}
+
+static void *pool_alloc(int index) {
+  SizeClass *pool = &classes[index];
+  size_t size = class_sizes[index];
+
+  pthread_mutex_lock(&pool->lock);
+  void *block = pool->free;
+  if (block != NULL) {
+    pool->free = pool->free->next;
+  } else {
+    if (pool->next == pool->end) {
+      // As many whole blocks as fit in a page, and nothing left over.
+      size_t slab_size = SLAB_HEADER + (SLAB_SIZE - SLAB_HEADER) / size * size;
+      Slab *slab = libc_resize(NULL, slab_size);
+      slab->next = pool->slabs;
+      pool->slabs = slab;
+      pool->next = (char *)slab + SLAB_HEADER;
+      pool->end = (char *)slab + slab_size;
+    }
+    block = pool->next;
+    pool->next += size;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return block;
+}
+
+static void pool_free(int index, void *pointer) {
+  SizeClass *pool = &classes[index];
+  FreeBlock *block = pointer;
+
+  pthread_mutex_lock(&pool->lock);
+  block->next = pool->free;
+  pool->free = block;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static void *resize(void *pointer, size_t old_size, size_t new_size) {
+  int old_class = pointer == NULL ? -1 : size_class(old_size);
+  int new_class = new_size == 0 ? -1 : size_class(new_size);
+  if (old_class == new_class && old_class != LARGE) {
+    return pointer;
+  }
+  if (old_class == LARGE && new_class == LARGE) {
+    return libc_resize(pointer, new_size);
+  }
+
+  void *result = NULL;
+  if (new_class == LARGE) {
+    result = libc_resize(NULL, new_size);
+  } else if (new_class >= 0) {
+    result = pool_alloc(new_class);
+  }
+  if (pointer == NULL) {
+    return result;
+  }
+
+  if (result != NULL) {
+    memcpy(result, pointer, old_size < new_size ? old_size : new_size);
+  }
+  if (old_class == LARGE) {
+    free(pointer);
+  } else {
+    pool_free(old_class, pointer);
+  }
+  return result;
+}
+#else
+static void *resize(void *pointer, size_t old_size, size_t new_size) {
+  (void)old_size;
+  return libc_resize(pointer, new_size);
+}
+#endif
+
+#ifdef MEMORY_STATS
+
+// Call sites are kept in an open-addressed table; once it is full, new
+// sites share one catch-all entry.
+#define SITE_CAPACITY 1024
+
+typedef struct {
+  const char *file;
+  int line;
+  size_t allocations;
+  size_t reallocations;
+  size_t frees;
+  size_t bytes;
+} Site;
+
+// Put in front of counted blocks; the union keeps the block aligned.
+typedef union {
+  size_t size;
+  long double align_double;
+  void *align_pointer;
+} CountedHeader;
+
+static MemoryStats stats;
+static Site sites[SITE_CAPACITY];
+static int site_count;
+static Site other = {"(other)", 0, 0, 0, 0, 0};
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The same file can be named by distinct string literals from different
+// translation units, so sites are keyed by the file's text.
+static Site *find_site(const char *file, int line) {
+  uint32_t hash = 2166136261u ^ (uint32_t)line;
+  for (const char *c = file; *c != '\0'; c++) {
+    hash = (hash ^ (unsigned char)*c) * 16777619u;
+  }
+
+  for (uint32_t i = hash % SITE_CAPACITY;; i = (i + 1) % SITE_CAPACITY) {
+    Site *site = &sites[i];
+    if (site->file == NULL) {
+      if (site_count >= SITE_CAPACITY - 1) {
+        return &other;
+      }
+      site->file = file;
+      site->line = line;
+      site_count++;
+      return site;
+    }
+    if (site->line == line &&
+        (site->file == file || strcmp(site->file, file) == 0)) {
+      return site;
+    }
+  }
+}
+
+static void count(void *pointer, size_t old_size, size_t new_size,
+                  const char *file, int line) {
+  if (pointer == NULL && new_size == 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&stats_lock);
+  Site *site = find_site(file, line);
+  if (new_size == 0) {
+    stats.frees++;
+    site->frees++;
+  } else if (pointer == NULL) {
+    stats.allocations++;
+    stats.bytes += new_size;
+    site->allocations++;
+    site->bytes += new_size;
+  } else {
+    size_t grown = new_size > old_size ? new_size - old_size : 0;
+    stats.reallocations++;
+    stats.bytes += grown;
+    site->reallocations++;
+    site->bytes += grown;
+  }
+
+  stats.live_bytes += new_size;
+  stats.live_bytes -= old_size < stats.live_bytes ? old_size
+                                                  : stats.live_bytes;
+  if (stats.live_bytes > stats.peak_bytes) {
+    stats.peak_bytes = stats.live_bytes;
+  }
+  pthread_mutex_unlock(&stats_lock);
+}
+
+MemoryStats memory_stats(void) {
+  pthread_mutex_lock(&stats_lock);
+  MemoryStats result = stats;
+  pthread_mutex_unlock(&stats_lock);
+  return result;
+}
+
+void memory_stats_reset(void) {
+  pthread_mutex_lock(&stats_lock);
+  size_t live_bytes = stats.live_bytes;
+  stats = (MemoryStats){0, 0, 0, 0, live_bytes, live_bytes};
+  memset(sites, 0, sizeof(sites));
+  site_count = 0;
+  other = (Site){"(other)", 0, 0, 0, 0, 0};
+  pthread_mutex_unlock(&stats_lock);
+}
+
+static int compare_sites(const void *a, const void *b) {
+  const Site *left = a;
+  const Site *right = b;
+  if (left->bytes != right->bytes) {
+    return left->bytes < right->bytes ? 1 : -1;
+  }
+  int by_file = strcmp(left->file, right->file);
+  return by_file != 0 ? by_file : left->line - right->line;
+}
+
+void memory_stats_dump(FILE *output) {
+  pthread_mutex_lock(&stats_lock);
+  Site *sorted = malloc(sizeof(Site) * (size_t)(site_count + 1));
+  int used = 0;
+  for (int i = 0; i < SITE_CAPACITY; i++) {
+    if (sites[i].file != NULL) {
+      sorted[used++] = sites[i];
+    }
+  }
+  if (other.allocations + other.reallocations + other.frees > 0) {
+    sorted[used++] = other;
+  }
+  MemoryStats totals = stats;
+  pthread_mutex_unlock(&stats_lock);
+
+  qsort(sorted, (size_t)used, sizeof(Site), compare_sites);
+  fprintf(output,
+          "%zu allocations, %zu reallocations, %zu frees, %zu bytes\n"
+          "%zu bytes live, %zu at peak\n",
+          totals.allocations, totals.reallocations, totals.frees,
+          totals.bytes, totals.live_bytes, totals.peak_bytes);
+  fprintf(output, "%12s %10s %10s %10s  %s\n", "bytes", "allocs", "reallocs",
+          "frees", "site");
+  for (int i = 0; i < used; i++) {
+    fprintf(output, "%12zu %10zu %10zu %10zu  %s:%d\n", sorted[i].bytes,
+            sorted[i].allocations, sorted[i].reallocations, sorted[i].frees,
+            sorted[i].file, sorted[i].line);
+  }
+  free(sorted);
+}
+
+void *counted_malloc(size_t size, const char *file, int line) {
+  return counted_realloc(NULL, size, file, line);
+}
+
+void *counted_realloc(void *pointer, size_t size, const char *file,
+                      int line) {
+  CountedHeader *header = NULL;
+  size_t old_size = 0;
+  if (pointer != NULL) {
+    header = (CountedHeader *)pointer - 1;
+    old_size = header->size;
+  }
+
+  count(pointer, old_size, size, file, line);
+  header = realloc(header, sizeof(CountedHeader) + size);
+  if (header == NULL) {
+    return NULL;
+  }
+  header->size = size;
+  return header + 1;
+}
+
+void counted_free(void *pointer, const char *file, int line) {
+  if (pointer == NULL) {
+    return;
+  }
+  CountedHeader *header = (CountedHeader *)pointer - 1;
+  count(pointer, header->size, 0, file, line);
+  free(header);
+}
+
+void *reallocate_at(void *pointer, size_t old_size, size_t new_size,
+                    const char *file, int line) {
+  count(pointer, old_size, new_size, file, line);
+  return resize(pointer, old_size, new_size);
+}
+#else
+void *reallocate(void *pointer, size_t old_size, size_t new_size) {
+  return resize(pointer, old_size, new_size);
+}
+#endif
@@ -18,6 +18,50 @@
 
 #define FREE(type, pointer) reallocate(pointer, sizeof(type), 0)
 
+// old_size must be the size the block was last given. Built with
+// MEMORY_POOL, blocks of up to 1 KB come from size-class free lists that
+// rely on it, rather than from libc.
 void* reallocate(void* pointer, size_t old_size, size_t new_size);
 
+#ifdef MEMORY_STATS
+#include <stdio.h>
+
+// Built with MEMORY_STATS, every reallocate() and every sds allocation is
+// counted, both in total and per call site: reallocate() becomes a macro
+// that passes on the file and line it is called from, so ALLOCATE(),
+// GROW_ARRAY() and the rest name their callers. The counters are shared by
+// all threads.
+typedef struct {
+    // Calls that created a block, resized one and freed one.
+    size_t allocations;
+    size_t reallocations;
+    size_t frees;
+    // Bytes asked for by allocations and by growing reallocations.
+    size_t bytes;
+    // Bytes allocated now, and the most there have been since the last
+    // reset. These rely on callers passing reallocate() the true old size.
+    size_t live_bytes;
+    size_t peak_bytes;
+} MemoryStats;
+
+MemoryStats memory_stats(void);
+// Zeroes the counters, and the call sites' too, but not the live bytes;
+// the peak restarts from them.
+void memory_stats_reset(void);
+// Writes the totals and then every call site, most bytes first.
+void memory_stats_dump(FILE* output);
+
+void* reallocate_at(void* pointer, size_t old_size, size_t new_size,
+                    const char* file, int line);
+#define reallocate(pointer, old_size, new_size) \
+    reallocate_at((pointer), (old_size), (new_size), __FILE__, __LINE__)
+
+// The allocator sdsalloc.h gives sds in MEMORY_STATS builds. Each block
+// carries its size in front, since sds does not pass old sizes.
+void* counted_malloc(size_t size, const char* file, int line);
+void* counted_realloc(void* pointer, size_t size, const char* file,
+                      int line);
+void counted_free(void* pointer, const char* file, int line);
+#endif
+
 #endif
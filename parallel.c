@@ -0,0 +1,257 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "parallel.h"
+#include "memory.h"
+#include <pthread.h>
+#include <unistd.h>
+
+// More slices than threads, so a thread that finishes early takes another
+// slice rather than idling while the slowest one finishes.
+#define SLICES_PER_THREAD 4
+
+typedef struct {
+  // Indices in the token array of the slice's first token and of the
+  // first token after it.
+  size_t start;
+  size_t end;
+  // Where parsing stopped; end unless the split was wrong.
+  size_t stop;
+  Arena arena;
+  // The slice's statements in order, NULL for those with errors, and how
+  // many errors had been reported after each.
+  Node **statements;
+  int *error_ends;
+  int count;
+  int capacity;
+  ParseError *errors;
+  int error_capacity;
+} Slice;
+
+typedef struct {
+  const Parser *parser;
+  Slice *slices;
+  int slice_count;
+  // The next slice no thread has taken yet.
+  int next;
+  pthread_mutex_t lock;
+} Pool;
+
+static void add_slice_statement(Slice *slice, Node *statement,
+                                int error_end) {
+  if (slice->count >= slice->capacity) {
+    int old_capacity = slice->capacity;
+    slice->capacity = GROW_CAPACITY(old_capacity);
+    slice->statements = GROW_ARRAY(Node *, slice->statements, old_capacity,
+                                   slice->capacity);
+    slice->error_ends =
+        GROW_ARRAY(int, slice->error_ends, old_capacity, slice->capacity);
+  }
+
+  slice->statements[slice->count] = statement;
+  slice->error_ends[slice->count] = error_end;
+  slice->count++;
+}
+
+// Parses statements from the slice's start until one ends at or past its
+// end. The parser sees the tokens after the slice too, so a statement
+// parses exactly as it would in a sequential parse.
+static void parse_slice(const Parser *parent, Slice *slice) {
+  Parser parser;
+  parser_init_tokens(&parser, parent->source + slice->start,
+                     parent->source_count - slice->start, parent->lines.input,
+                     parent->lines.length);
+  parser.arena = &slice->arena;
+  parser.max_depth = parent->max_depth;
+  parser.max_errors = parent->max_errors;
+  parser.lazy_bodies = parent->lazy_bodies;
+
+  size_t length = slice->end - slice->start;
+  while (parser_token_index(&parser) < length &&
+         parser_peek(&parser, 0)->type != TOKEN_EOF) {
+    Node *statement = parser_parse_statement(&parser);
+    add_slice_statement(slice, statement, parser.error_count);
+  }
+  slice->stop = slice->start + parser_token_index(&parser);
+
+  // The errors are kept until the slices are joined.
+  slice->errors = parser.errors;
+  slice->error_capacity = parser.error_capacity;
+  parser.errors = NULL;
+  parser.error_capacity = 0;
+  parser_free(&parser);
+}
+
+static void *parse_thread(void *argument) {
+  Pool *pool = argument;
+
+  while (1) {
+    pthread_mutex_lock(&pool->lock);
+    int next = pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (next >= pool->slice_count) {
+      return NULL;
+    }
+    parse_slice(pool->parser, &pool->slices[next]);
+  }
+}
+
+// Cuts the tokens from start up to last, the TOKEN_EOF, into at most
+// slice_count slices of about equal length, each ending just after a
+// semicolon at depth 0. Returns how many slices there are.
+static int split(const Token *tokens, size_t start, size_t last,
+                 Slice *slices, int slice_count) {
+  size_t target = (last - start) / (size_t)slice_count + 1;
+  size_t slice_start = start;
+  int count = 0;
+  int depth = 0;
+
+  for (size_t i = start; i < last && count < slice_count - 1; i++) {
+    switch (tokens[i].type) {
+    case TOKEN_LPAREN:
+    case TOKEN_LBRACKET:
+    case TOKEN_LBRACE:
+      depth++;
+      break;
+    case TOKEN_RPAREN:
+    case TOKEN_RBRACKET:
+    case TOKEN_RBRACE:
+      depth--;
+      break;
+    case TOKEN_SEMICOLON:
+      if (depth == 0 && i + 1 - slice_start >= target) {
+        slices[count].start = slice_start;
+        slices[count].end = i + 1;
+        count++;
+        slice_start = i + 1;
+      }
+      break;
+    default:
+      break;
+    }
+    // Past an unmatched closer the depth says nothing about where
+    // statements start, so everything after goes in the last slice.
+    if (depth < 0) {
+      break;
+    }
+  }
+
+  slices[count].start = slice_start;
+  slices[count].end = last;
+  return count + 1;
+}
+
+// Appends the slice's statements and errors to the program and parser,
+// stopping like parser_parse_program() once max_errors are reported.
+// Returns 0 if it stopped early.
+static int join_slice(Parser *parser, Program *program, Slice *slice) {
+  arena_adopt(program->arena, &slice->arena);
+
+  int error_start = 0;
+  for (int i = 0; i < slice->count; i++) {
+    if (parser->error_count >= parser->max_errors) {
+      return 0;
+    }
+    if (slice->statements[i] != NULL) {
+      add_statement(program, slice->statements[i]);
+    }
+    for (int j = error_start; j < slice->error_ends[i]; j++) {
+      parser_add_error(parser, slice->errors[j]);
+    }
+    error_start = slice->error_ends[i];
+  }
+  return 1;
+}
+
+static void free_slice(Slice *slice) {
+  arena_free(&slice->arena);
+  FREE_ARRAY(Node *, slice->statements, slice->capacity);
+  FREE_ARRAY(int, slice->error_ends, slice->capacity);
+  FREE_ARRAY(ParseError, slice->errors, slice->error_capacity);
+}
+
+static int pick_thread_count(size_t tokens) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t by_size = tokens / PARSE_MIN_SLICE;
+  int count = cpus > 0 ? (int)cpus : 1;
+
+  if (by_size < (size_t)count) {
+    count = by_size > 0 ? (int)by_size : 1;
+  }
+  return count;
+}
+
+Node *parse_parallel(Parser *parser, int thread_count) {
+  size_t start = parser_token_index(parser);
+  size_t last = parser->source_count - 1;
+  if (thread_count <= 0) {
+    thread_count = pick_thread_count(last - start);
+  }
+
+  int slice_capacity = thread_count > 1 ? thread_count * SLICES_PER_THREAD : 1;
+  Slice *slices = ALLOCATE(Slice, slice_capacity);
+  int slice_count =
+      split(parser->source, start, last, slices, slice_capacity);
+  for (int i = 0; i < slice_count; i++) {
+    arena_init(&slices[i].arena);
+    slices[i].stop = slices[i].start;
+    slices[i].statements = NULL;
+    slices[i].error_ends = NULL;
+    slices[i].count = 0;
+    slices[i].capacity = 0;
+    slices[i].errors = NULL;
+    slices[i].error_capacity = 0;
+  }
+
+  Pool pool;
+  pool.parser = parser;
+  pool.slices = slices;
+  pool.slice_count = slice_count;
+  pool.next = 0;
+  pthread_mutex_init(&pool.lock, NULL);
+
+  // This thread is one of the workers; if a thread cannot be started, the
+  // others take its share.
+  pthread_t *threads = ALLOCATE(pthread_t, thread_count);
+  int started = 1;
+  for (int i = 1; i < thread_count; i++) {
+    if (pthread_create(&threads[i], NULL, parse_thread, &pool)) {
+      break;
+    }
+    started++;
+  }
+  parse_thread(&pool);
+  for (int i = 1; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  pthread_mutex_destroy(&pool.lock);
+  FREE_ARRAY(pthread_t, threads, thread_count);
+
+  // Join in order while each slice starts where the one before stopped.
+  Node *program_node = new_program_node();
+  Program *program = AS_PROGRAM(program_node);
+  size_t resume = start;
+  int complete = 1;
+  for (int i = 0; i < slice_count && slices[i].start == resume; i++) {
+    complete = join_slice(parser, program, &slices[i]);
+    if (!complete) {
+      break;
+    }
+    resume = slices[i].stop;
+  }
+  for (int i = 0; i < slice_count; i++) {
+    free_slice(&slices[i]);
+  }
+  FREE_ARRAY(Slice, slices, slice_capacity);
+
+  parser->arena = program->arena;
+  parser_seek(parser, complete ? resume : last);
+  while (parser_peek(parser, 0)->type != TOKEN_EOF &&
+         parser->error_count < parser->max_errors) {
+    Node *statement = parser_parse_statement(parser);
+    if (statement) {
+      add_statement(program, statement);
+    }
+  }
+  return program_node;
+}
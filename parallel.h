@@ -0,0 +1,26 @@
+#ifndef parallel_h
+#define parallel_h
+
+#include "parser.h"
+
+// Parses the rest of a token-array parser's input (see parser_init_tokens()
+// and tokenize_parallel()) into a program, like parser_parse_program(), on
+// thread_count threads. A first pass over the tokens splits them after
+// top-level semicolons, outside any parentheses, brackets or braces; the
+// slices are then parsed concurrently, each into an arena of its own, and
+// their statements joined in order into one program, whose arena takes
+// over the slices' chunks. The parser's settings apply to every slice, and
+// errors are added to it in order.
+//
+// On malformed input a split can land inside a statement. That shows when
+// the slice before it does not stop exactly at the split, and the rest is
+// then parsed on this thread, so the program and errors are always those
+// of a sequential parse.
+//
+// A thread_count of 0 picks one thread per online CPU, but never slices
+// smaller than PARSE_MIN_SLICE tokens.
+Node* parse_parallel(Parser* parser, int thread_count);
+
+#define PARSE_MIN_SLICE 16384
+
+#endif
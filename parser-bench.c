@@ -0,0 +1,261 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "parallel.h"
+#include "parser.h"
+#include "sds.h"
+#include "tokenize.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Expression-dense inputs: nearly every token is an operator, an operand
+// or a bracket, so the time goes to the Pratt loop and node creation
+// rather than to statement boundaries.
+static const struct {
+  const char *name;
+  const char *snippet;
+} inputs[] = {
+    {"arithmetic", "let v = -a * (b + c) / d - e * f + !g == h < i * 2;\n"},
+    {"calls", "f(g(a, b), h(c, [d, e][0]), i(j(k(l))));\n"},
+    {"functions", "let f = fn(a, b) { if (a > b) { return a; } else "
+                  "{ return add(a, b * 2); } };\n"},
+    {"arrays", "[[1, 2, 3][x], [4, 5][y + 1], m[i][j] * [6][0]];\n"},
+};
+
+static sds make_input(const char *snippet, size_t size) {
+  sds input = sdsempty();
+  while (sdslen(input) < size) {
+    input = sdscat(input, snippet);
+  }
+  return input;
+}
+
+// One statement nested count levels deep: open count times, then middle,
+// then close count times.
+static sds make_deep(const char *open, const char *middle, const char *close,
+                     int count) {
+  sds input = sdsempty();
+  for (int i = 0; i < count; i++) {
+    input = sdscat(input, open);
+  }
+  input = sdscat(input, middle);
+  for (int i = 0; i < count; i++) {
+    input = sdscat(input, close);
+  }
+  return sdscat(input, ";\n");
+}
+
+// One statement with count items in a single list or operator chain.
+static sds make_wide(const char *open, const char *item,
+                     const char *separator, const char *close, int count) {
+  sds input = sdsnew(open);
+  for (int i = 0; i < count; i++) {
+    input = sdscat(input, i > 0 ? separator : "");
+    input = sdscat(input, item);
+  }
+  input = sdscat(input, close);
+  return sdscat(input, ";\n");
+}
+
+// Inputs that stress the parser's stacks rather than its throughput on
+// ordinary code: deep ones nest thousands of levels, wide ones put tens of
+// thousands of items in one list or chain.
+static const struct {
+  const char *name;
+  const char *open;
+  const char *middle;
+  const char *close;
+} deep[] = {
+    {"parens", "(", "x", ")"},
+    {"prefixes", "-!", "x", ""},
+    {"ifs", "if (a) { ", "b", " }"},
+    {"calls", "f(", "x", ")"},
+};
+
+static const struct {
+  const char *name;
+  const char *open;
+  const char *item;
+  const char *separator;
+  const char *close;
+} wide[] = {
+    {"arguments", "f(", "a", ", ", ")"},
+    {"elements", "[", "1", ", ", "]"},
+    {"operators", "", "a", " + ", ""},
+    {"blocks", "if (a) { ", "b", "; ", " }"},
+};
+
+// A script that is mostly function definitions, for comparing eager and
+// lazy body parsing.
+static const char *definitions =
+    "let f = fn(a, b) { let c = a * b + 1; if (c > 10) { return [c, a][0]; }"
+    " else { return g(c, a - b, fn(x) { x * x }); } };\n";
+
+static void bench_input(const char *name, sds input, int lazy_bodies) {
+  size_t length = sdslen(input);
+
+  int rounds = 5;
+  double best = 0;
+  int statements = 0;
+  for (int i = 0; i < rounds; i++) {
+    double start = now_ns();
+    Parser parser;
+    parser_init(&parser, input, length);
+    parser.lazy_bodies = lazy_bodies;
+    Node *program = parser_parse_program(&parser);
+    double elapsed = now_ns() - start;
+
+    int error_count;
+    parser_get_errors(&parser, &error_count);
+    if (error_count > 0) {
+      fprintf(stderr, "%s: %d parse errors\n", name, error_count);
+      exit(1);
+    }
+    statements = AS_PROGRAM(program)->statement_count;
+    if (i == 0 || elapsed < best) {
+      best = elapsed;
+    }
+
+    program_free(program);
+    parser_free(&parser);
+  }
+
+  printf("%-10s %10zu bytes  %8.2f ms  %7.1f MB/s  %7.1f ns/statement\n",
+         name, length, best / 1e6, (double)length / (best / 1e9) / 1e6,
+         best / statements);
+  fflush(stdout);
+}
+
+// Every statement here has an error.
+static const char *malformed = "let = 1; let x 5 return (; fn(a 1) { ) } ]\n";
+
+static void bench_errors(const char *name, sds input, int max_errors) {
+  size_t length = sdslen(input);
+
+  int rounds = 5;
+  double best = 0;
+  int error_count = 0;
+  for (int i = 0; i < rounds; i++) {
+    double start = now_ns();
+    Parser parser;
+    parser_init(&parser, input, length);
+    parser.max_errors = max_errors;
+    Node *program = parser_parse_program(&parser);
+    double elapsed = now_ns() - start;
+
+    parser_get_errors(&parser, &error_count);
+    if (i == 0 || elapsed < best) {
+      best = elapsed;
+    }
+
+    program_free(program);
+    parser_free(&parser);
+  }
+
+  printf("%-10s %10zu bytes  %8.2f ms  %7.1f MB/s  %8d errors\n", name,
+         length, best / 1e6, (double)length / (best / 1e9) / 1e6,
+         error_count);
+  fflush(stdout);
+}
+
+// Scaling of parse_parallel() from one thread up to at least eight, or
+// one per CPU on larger machines, on tokens lexed beforehand.
+static void bench_parallel(size_t size) {
+  sds input = sdsempty();
+  while (sdslen(input) < size) {
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+      input = sdscat(input, inputs[i].snippet);
+    }
+  }
+  size_t length = sdslen(input);
+  TokenArray tokens;
+  tokenize_parallel(input, length, 0, &tokens);
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int max_threads = cpus > 8 ? (int)cpus : 8;
+  double single = 0;
+
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    double best = 0;
+    for (int i = 0; i < 3; i++) {
+      double start = now_ns();
+      Parser parser;
+      parser_init_tokens(&parser, tokens.tokens, tokens.count, input, length);
+      Node *program = parse_parallel(&parser, threads);
+      double elapsed = now_ns() - start;
+
+      if (i == 0 || elapsed < best) {
+        best = elapsed;
+      }
+      program_free(program);
+      parser_free(&parser);
+    }
+
+    if (threads == 1) {
+      single = best;
+    }
+    printf("%2d threads %10zu bytes  %8.2f ms  %7.1f MB/s  %5.2fx\n", threads,
+           length, best / 1e6, (double)length / (best / 1e9) / 1e6,
+           single / best);
+    fflush(stdout);
+  }
+
+  token_array_free(&tokens);
+  sdsfree(input);
+}
+
+int main() {
+  size_t sizes[] = {1000000, 10000000};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    for (size_t j = 0; j < sizeof(inputs) / sizeof(inputs[0]); j++) {
+      sds input = make_input(inputs[j].snippet, sizes[i]);
+      bench_input(inputs[j].name, input, 0);
+      sdsfree(input);
+    }
+  }
+
+  printf("\ndeep, 4000 levels\n");
+  for (size_t i = 0; i < sizeof(deep) / sizeof(deep[0]); i++) {
+    sds statement = make_deep(deep[i].open, deep[i].middle, deep[i].close,
+                              4000);
+    sds input = make_input(statement, sizes[1]);
+    bench_input(deep[i].name, input, 0);
+    sdsfree(input);
+    sdsfree(statement);
+  }
+
+  printf("\nwide, 50000 items\n");
+  for (size_t i = 0; i < sizeof(wide) / sizeof(wide[0]); i++) {
+    sds statement = make_wide(wide[i].open, wide[i].item, wide[i].separator,
+                              wide[i].close, 50000);
+    sds input = make_input(statement, sizes[1]);
+    bench_input(wide[i].name, input, 0);
+    sdsfree(input);
+    sdsfree(statement);
+  }
+
+  printf("\nfunction bodies\n");
+  sds input = make_input(definitions, sizes[1]);
+  bench_input("eager", input, 0);
+  bench_input("lazy", input, 1);
+  sdsfree(input);
+
+  printf("\nmalformed\n");
+  input = make_input(malformed, sizes[1]);
+  bench_errors("all", input, INT_MAX);
+  bench_errors("capped", input, PARSER_MAX_ERRORS);
+  sdsfree(input);
+
+  printf("\nparallel, pre-lexed\n");
+  bench_parallel(50000000);
+  return 0;
+}
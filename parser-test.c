@@ -1,6 +1,10 @@
 #include "ast.h"
+#include "corpus.h"
 #include "lexer.h"
+#include "parallel.h"
 #include "parser.h"
+#include "sds.h"
+#include "tokenize.h"
 #include <setjmp.h>
 #include <stdarg.h>
 #include <stddef.h>
@@ -9,6 +13,12 @@
 
 #include <cmocka.h>
 
+static void assert_message(const ParseError *error, const char *expected) {
+  sds message = parse_error_message(error);
+  assert_string_equal(message, expected);
+  sdsfree(message);
+}
+
 static void checkParseErrors() {
   int error_count;
   ParseError *errors = get_errors(&error_count);
@@ -21,7 +31,9 @@ static void checkParseErrors() {
           error_count == 1 ? "error" : "errors");
 
   for (int i = 0; i < error_count; i++) {
-    fprintf(stderr, "\t%s\n", errors[i].message);
+    sds message = parse_error_message(&errors[i]);
+    fprintf(stderr, "\t%s\n", message);
+    sdsfree(message);
   }
 
   fail_msg("Parser encountered errors (see stderr for details)");
@@ -39,9 +51,10 @@ static int testLetStatement(Node *stmt, const char *name) {
     return 0;
   }
 
-  sds actual_name = let_stmt->name->token.literal;
-  if (strcmp(actual_name, name) != 0) {
-    printf("Let statement name not '%s'. got=%s\n", name, actual_name);
+  Token actual_name = let_stmt->name->token;
+  if (let_stmt->name->token.symbol != intern(name, (int)strlen(name))) {
+    printf("Let statement name not '%s'. got=%.*s\n", name, actual_name.length,
+           actual_name.start);
     return 0;
   }
 
@@ -154,9 +167,11 @@ static void test_identifier_expression(void **state) {
   }
 
   Identifier *ident = AS_IDENTIFIER(ident_stmt);
-  if (strcmp(ident->token.literal, "foobar") != 0) {
-    fail_msg("Ident value not %s, got %s", "foobar", ident->token.literal);
+  if (!token_literal_equals(ident->token, "foobar")) {
+    fail_msg("Ident value not %s, got %.*s", "foobar", ident->token.length,
+             ident->token.start);
   }
+  assert_int_equal(ident->token.symbol, intern("foobar", 6));
 }
 
 static void test_integer_literal(void **state) {
@@ -194,14 +209,777 @@ static void test_integer_literal(void **state) {
   }
 
   IntegerLiteral *integer_literal = AS_INTEGER_LITERAL(integer_stmt);
-  if (strcmp(integer_literal->token.literal, "5") != 0) {
-    fail_msg("Integer value not %s, got %s", "5",
-             integer_literal->token.literal);
+  if (!token_literal_equals(integer_literal->token, "5")) {
+    fail_msg("Integer value not %s, got %.*s", "5",
+             integer_literal->token.length, integer_literal->token.start);
+  }
+
+  assert_int_equal(integer_literal->value, 5);
+}
+
+static void test_integer_overflow(void **state) {
+  (void)state;
+
+  init_parser("18446744073709551616;");
+  parse_program();
+
+  int error_count;
+  ParseError *errors = get_errors(&error_count);
+  assert_int_equal(error_count, 1);
+  assert_message(&errors[0], "could not parse as integer");
+}
+
+static void test_error_positions(void **state) {
+  (void)state;
+
+  const char *input = "let x = 5;\n"
+                      "let = 10;\n"
+                      "  let y 7;";
+  Parser parser;
+  parser_init(&parser, input, strlen(input));
+  parser_parse_program(&parser);
+
+  int error_count;
+  ParseError *errors = parser_get_errors(&parser, &error_count);
+  assert_true(error_count >= 2);
+
+  // Both errors are about the token after the one parser_expect_peek() was
+  // looking from: "=" on line 2 and "7" on line 3.
+  Position first = parser_error_position(&parser, &errors[0]);
+  assert_int_equal(first.line, 2);
+  assert_int_equal(first.column, 5);
+
+  Position second = parser_error_position(&parser, &errors[1]);
+  assert_int_equal(second.line, 3);
+  assert_int_equal(second.column, 9);
+
+  parser_free(&parser);
+}
+
+static void test_independent_parsers(void **state) {
+  (void)state;
+
+  const char *first_input = "let x = 5;\nlet y = 10;";
+  const char *second_input = "return 5;";
+
+  Parser first;
+  Parser second;
+  parser_init(&first, first_input, strlen(first_input));
+  parser_init(&second, second_input, strlen(second_input));
+
+  Node *second_program = parser_parse_program(&second);
+  Node *first_program = parser_parse_program(&first);
+
+  int error_count;
+  parser_get_errors(&first, &error_count);
+  assert_int_equal(error_count, 0);
+  parser_get_errors(&second, &error_count);
+  assert_int_equal(error_count, 0);
+
+  assert_int_equal(AS_PROGRAM(first_program)->statement_count, 2);
+  assert_int_equal(AS_PROGRAM(second_program)->statement_count, 1);
+  assert_true(IS_RETURN_STATEMENT(AS_PROGRAM(second_program)->statements[0]));
+  assert_true(testLetStatement(AS_PROGRAM(first_program)->statements[1], "y"));
+
+  program_free(first_program);
+  program_free(second_program);
+  parser_free(&first);
+  parser_free(&second);
+}
+
+// Parses input with the default parser, failing on any error.
+static Program *parse_checked(const char *input) {
+  init_parser(input);
+  Node *program_node = parse_program();
+  checkParseErrors();
+  return AS_PROGRAM(program_node);
+}
+
+static Node *single_expression(Program *program) {
+  assert_int_equal(program->statement_count, 1);
+  Node *stmt = program->statements[0];
+  assert_true(IS_EXPRESSION_STATEMENT(stmt));
+  return AS_EXPRESSION_STATEMENT(stmt)->expression;
+}
+
+static void assert_prints(Node *node, const char *expected) {
+  sds actual = node_to_string(node);
+  if (strcmp(actual, expected) != 0) {
+    fail_msg("expected %s, got %s", expected, actual);
+  }
+  sdsfree(actual);
+}
+
+static void test_let_values(void **state) {
+  (void)state;
+
+  const char *input = "let x = 5;\n"
+                      "let y = true;\n"
+                      "let foobar = y;";
+  const char *expected_values[] = {"5", "true", "y"};
+
+  Program *program = parse_checked(input);
+  assert_int_equal(program->statement_count, 3);
+  for (int i = 0; i < 3; i++) {
+    assert_prints(AS_LET_STATEMENT(program->statements[i])->value,
+                  expected_values[i]);
+  }
+
+  program = parse_checked("return 10; return; return x + 1;");
+  assert_int_equal(program->statement_count, 3);
+  assert_prints(AS_RETURN_STATEMENT(program->statements[0])->return_value,
+                "10");
+  assert_null(AS_RETURN_STATEMENT(program->statements[1])->return_value);
+  assert_prints(program->statements[2], "return (x + 1);");
+}
+
+static void test_prefix_and_infix_expressions(void **state) {
+  (void)state;
+
+  Node *expression = single_expression(parse_checked("-15;"));
+  assert_true(IS_PREFIX_EXPRESSION(expression));
+  PrefixExpression *prefix = AS_PREFIX_EXPRESSION(expression);
+  assert_int_equal(prefix->token.type, TOKEN_MINUS);
+  assert_true(AS_INTEGER_LITERAL(prefix->right)->value == 15);
+
+  expression = single_expression(parse_checked("a != false"));
+  assert_true(IS_INFIX_EXPRESSION(expression));
+  InfixExpression *infix = AS_INFIX_EXPRESSION(expression);
+  assert_int_equal(infix->token.type, TOKEN_NOT_EQ);
+  assert_true(IS_IDENTIFIER(infix->left));
+  assert_true(IS_BOOLEAN_LITERAL(infix->right));
+  assert_int_equal(AS_BOOLEAN_LITERAL(infix->right)->value, 0);
+
+  expression = single_expression(parse_checked("\"hello world\";"));
+  assert_true(IS_STRING_LITERAL(expression));
+  assert_true(
+      token_literal_equals(AS_STRING_LITERAL(expression)->token,
+                           "hello world"));
+}
+
+static void test_operator_precedence(void **state) {
+  (void)state;
+
+  const char *tests[][2] = {
+      {"-a * b", "((-a) * b)"},
+      {"!-a", "(!(-a))"},
+      {"a + b + c", "((a + b) + c)"},
+      {"a + b - c", "((a + b) - c)"},
+      {"a * b * c", "((a * b) * c)"},
+      {"a * b / c", "((a * b) / c)"},
+      {"a + b / c", "(a + (b / c))"},
+      {"a + b * c + d / e - f", "(((a + (b * c)) + (d / e)) - f)"},
+      {"3 + 4; -5 * 5", "(3 + 4)((-5) * 5)"},
+      {"5 > 4 == 3 < 4", "((5 > 4) == (3 < 4))"},
+      {"5 < 4 != 3 > 4", "((5 < 4) != (3 > 4))"},
+      {"3 + 4 * 5 == 3 * 1 + 4 * 5",
+       "((3 + (4 * 5)) == ((3 * 1) + (4 * 5)))"},
+      {"true", "true"},
+      {"3 > 5 == false", "((3 > 5) == false)"},
+      {"1 + (2 + 3) + 4", "((1 + (2 + 3)) + 4)"},
+      {"(5 + 5) * 2", "((5 + 5) * 2)"},
+      {"-(5 + 5)", "(-(5 + 5))"},
+      {"!(true == true)", "(!(true == true))"},
+      {"a + add(b * c) + d", "((a + add((b * c))) + d)"},
+      {"add(a, b, 1, 2 * 3, 4 + 5, add(6, 7 * 8))",
+       "add(a, b, 1, (2 * 3), (4 + 5), add(6, (7 * 8)))"},
+      {"add(a + b + c * d / f + g)", "add((((a + b) + ((c * d) / f)) + g))"},
+      {"a * [1, 2, 3, 4][b * c] * d", "((a * ([1, 2, 3, 4][(b * c)])) * d)"},
+      {"add(a * b[2], b[1], 2 * [1, 2][1])",
+       "add((a * (b[2])), (b[1]), (2 * ([1, 2][1])))"},
+      {"fn(x, y) { x + y; }(2, 3)", "fn(x, y) (x + y)(2, 3)"},
+      {"if (x < y) { x } else { y }", "if(x < y) xelse y"},
+  };
+
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+    init_parser(tests[i][0]);
+    Node *program = parse_program();
+    checkParseErrors();
+    assert_prints(program, tests[i][1]);
+    program_free(program);
   }
+}
+
+static void test_if_expression(void **state) {
+  (void)state;
+
+  Node *expression =
+      single_expression(parse_checked("if (x < y) { x } else { y; z }"));
+  assert_true(IS_IF_EXPRESSION(expression));
+  IfExpression *if_expression = AS_IF_EXPRESSION(expression);
+  assert_prints(if_expression->condition, "(x < y)");
+
+  BlockStatement *consequence =
+      AS_BLOCK_STATEMENT(if_expression->consequence);
+  assert_int_equal(consequence->statements.count, 1);
+  assert_prints(consequence->statements.items[0], "x");
+
+  BlockStatement *alternative =
+      AS_BLOCK_STATEMENT(if_expression->alternative);
+  assert_int_equal(alternative->statements.count, 2);
+  assert_prints(alternative->statements.items[1], "z");
+
+  expression = single_expression(parse_checked("if (x) { }"));
+  assert_int_equal(
+      AS_BLOCK_STATEMENT(AS_IF_EXPRESSION(expression)->consequence)
+          ->statements.count,
+      0);
+  assert_null(AS_IF_EXPRESSION(expression)->alternative);
+}
+
+static void test_function_literal(void **state) {
+  (void)state;
+
+  const char *tests[][2] = {
+      {"fn() {};", ""},
+      {"fn(x) {};", "x"},
+      {"fn(x, y, z) { return x; };", "x y z"},
+  };
+
+  for (int i = 0; i < 3; i++) {
+    Node *expression = single_expression(parse_checked(tests[i][0]));
+    assert_true(IS_FUNCTION_LITERAL(expression));
+    FunctionLiteral *function = AS_FUNCTION_LITERAL(expression);
+
+    sds names = sdsempty();
+    for (int j = 0; j < function->parameters.count; j++) {
+      assert_true(IS_IDENTIFIER(function->parameters.items[j]));
+      names = sdscatprintf(names, "%s%.*s", j > 0 ? " " : "",
+                           AS_IDENTIFIER(function->parameters.items[j])
+                               ->token.length,
+                           AS_IDENTIFIER(function->parameters.items[j])
+                               ->token.start);
+    }
+    assert_string_equal(names, tests[i][1]);
+    sdsfree(names);
+  }
+
+  Node *expression = single_expression(parse_checked("fn(x, y) { x + y; }"));
+  BlockStatement *body =
+      AS_BLOCK_STATEMENT(AS_FUNCTION_LITERAL(expression)->body);
+  assert_int_equal(body->statements.count, 1);
+  assert_prints(body->statements.items[0], "(x + y)");
+}
+
+static void test_call_and_index_expressions(void **state) {
+  (void)state;
+
+  Node *expression = single_expression(parse_checked("add(1, 2 * 3, 4 + 5);"));
+  assert_true(IS_CALL_EXPRESSION(expression));
+  CallExpression *call = AS_CALL_EXPRESSION(expression);
+  assert_prints(call->function, "add");
+  assert_int_equal(call->arguments.count, 3);
+  assert_prints(call->arguments.items[1], "(2 * 3)");
+
+  expression = single_expression(parse_checked("[1, 2 * 2, 3 + 3]"));
+  assert_true(IS_ARRAY_LITERAL(expression));
+  assert_int_equal(AS_ARRAY_LITERAL(expression)->elements.count, 3);
+
+  expression = single_expression(parse_checked("[]"));
+  assert_int_equal(AS_ARRAY_LITERAL(expression)->elements.count, 0);
+
+  expression = single_expression(parse_checked("myArray[1 + 1]"));
+  assert_true(IS_INDEX_EXPRESSION(expression));
+  assert_prints(AS_INDEX_EXPRESSION(expression)->left, "myArray");
+  assert_prints(AS_INDEX_EXPRESSION(expression)->index, "(1 + 1)");
+}
+
+static void test_expression_errors(void **state) {
+  (void)state;
+
+  const char *tests[][2] = {
+      {"let x = ;", "no prefix parse function for ; found"},
+      {"if (x { y }", "expected next token to be ), got { instead"},
+      {"fn(x, 1) { x }", "expected next token to be IDENT, got INT instead"},
+      {"add(1, 2", "expected next token to be ), got EOF instead"},
+      {"if (x) { y", "expected }, got EOF instead"},
+  };
+
+  for (int i = 0; i < 5; i++) {
+    init_parser(tests[i][0]);
+    Node *program = parse_program();
 
-  if (integer_literal->value != 5) {
-    fail_msg("Integer value not %d, got %d", 5, integer_literal->value);
+    int error_count;
+    ParseError *errors = get_errors(&error_count);
+    assert_int_equal(error_count, 1);
+    assert_message(&errors[0], tests[i][1]);
+    assert_int_equal(AS_PROGRAM(program)->statement_count, 0);
+    program_free(program);
   }
+
+  // The rest of a broken statement is skipped, and parsing picks up after
+  // its semicolon.
+  init_parser("let x = * 2 + 3; let y = 1;");
+  Node *program = parse_program();
+  int error_count;
+  get_errors(&error_count);
+  assert_int_equal(error_count, 1);
+  assert_prints(program, "let y = 1;");
+  program_free(program);
+}
+
+static void test_error_recovery(void **state) {
+  (void)state;
+
+  // Each input has one error, after which parsing resumes at the next
+  // statement boundary outside the broken statement's blocks.
+  const char *tests[][2] = {
+      {"let = 1; let x = 2;", "let x = 2;"},
+      {"let x 5 let y = 6;", "let y = 6;"},
+      {"x + let y = 1;", "let y = 1;"},
+      {"return (1; return 2;", "return 2;"},
+      {"if (x) { let = 1; return 2; } let z = 3;", "let z = 3;"},
+      {"fn() { if (x) { ) } }; y", "y"},
+      {"} x;", "x"},
+  };
+  for (int i = 0; i < 7; i++) {
+    init_parser(tests[i][0]);
+    Node *program = parse_program();
+    int error_count;
+    get_errors(&error_count);
+    assert_int_equal(error_count, 1);
+    assert_prints(program, tests[i][1]);
+    program_free(program);
+  }
+
+  // Errors are plain records until a message is asked for.
+  init_parser("let x 5;");
+  Node *program = parse_program();
+  int error_count;
+  ParseError *errors = get_errors(&error_count);
+  assert_int_equal(error_count, 1);
+  assert_int_equal(errors[0].code, PARSE_ERROR_UNEXPECTED_TOKEN);
+  assert_int_equal(errors[0].expected, TOKEN_ASSIGN);
+  assert_int_equal(errors[0].got, TOKEN_INT);
+  assert_int_equal(errors[0].offset, 6);
+  assert_int_equal(errors[0].length, 1);
+  program_free(program);
+}
+
+static void test_error_limit(void **state) {
+  (void)state;
+
+  sds input = sdsempty();
+  for (int i = 0; i < 1000; i++) {
+    input = sdscat(input, "let = 1;\n");
+  }
+  input = sdscat(input, "x;");
+
+  // Parsing stops at the limit, without reaching the last statement.
+  Parser parser;
+  parser_init(&parser, input, sdslen(input));
+  parser.max_errors = 10;
+  Node *program = parser_parse_program(&parser);
+  int error_count;
+  parser_get_errors(&parser, &error_count);
+  assert_int_equal(error_count, 10);
+  assert_int_equal(AS_PROGRAM(program)->statement_count, 0);
+  program_free(program);
+  parser_free(&parser);
+
+  parser_init(&parser, input, sdslen(input));
+  program = parser_parse_program(&parser);
+  parser_get_errors(&parser, &error_count);
+  assert_int_equal(error_count, PARSER_MAX_ERRORS);
+  program_free(program);
+  parser_free(&parser);
+  sdsfree(input);
+}
+
+// Parses input with a fresh parser limited to max_depth levels, returning
+// the number of errors and the first one's message in message.
+static int parse_nested(const char *input, int max_depth, sds *message) {
+  Parser parser;
+  parser_init(&parser, input, strlen(input));
+  parser.max_depth = max_depth;
+  Node *program = parser_parse_program(&parser);
+
+  int error_count;
+  ParseError *errors = parser_get_errors(&parser, &error_count);
+  *message = error_count > 0 ? parse_error_message(&errors[0]) : sdsempty();
+  assert_int_equal(parser.depth, 0);
+  program_free(program);
+  parser_free(&parser);
+  return error_count;
+}
+
+static void test_nesting_limit(void **state) {
+  (void)state;
+
+  // Nesting well past what a recursive parser's C stack could take, within
+  // the default limit.
+  int depth = 4000;
+  sds input = sdsempty();
+  for (int i = 0; i < depth; i++) {
+    input = sdscat(input, "-(");
+  }
+  input = sdscat(input, "x");
+  for (int i = 0; i < depth; i++) {
+    input = sdscat(input, ")");
+  }
+  Program *program = parse_checked(input);
+  Node *expression = single_expression(program);
+  for (int i = 0; i < depth; i++) {
+    assert_true(IS_PREFIX_EXPRESSION(expression));
+    expression = AS_PREFIX_EXPRESSION(expression)->right;
+  }
+  assert_true(IS_IDENTIFIER(expression));
+  sdsfree(input);
+
+  // Far deeper than the limit fails with an error rather than a crash, and
+  // the parser carries on after it.
+  input = sdsempty();
+  for (int i = 0; i < 1000000; i++) {
+    input = sdscat(input, "[");
+  }
+  input = sdscat(input, ";\nlet x = 1;");
+  sds message;
+  assert_int_equal(parse_nested(input, PARSER_MAX_DEPTH, &message), 1);
+  assert_string_equal(message, "expressions and blocks nested too deeply");
+  sdsfree(message);
+  sdsfree(input);
+
+  // Blocks count as well as expressions.
+  const char *tests[][2] = {
+      {"f(g(x));", ""},
+      {"f(g(h(x)));", "expressions and blocks nested too deeply"},
+      {"if (a) { b }", ""},
+      {"if (a) { if (b) { c } }", "expressions and blocks nested too deeply"},
+      {"fn() { fn() { x } }", "expressions and blocks nested too deeply"},
+  };
+  for (int i = 0; i < 5; i++) {
+    int error_count = parse_nested(tests[i][0], 3, &message);
+    assert_int_equal(error_count, tests[i][1][0] != '\0');
+    assert_string_equal(message, tests[i][1]);
+    sdsfree(message);
+  }
+}
+
+static void count_visit(Token *token, void *context) {
+  (void)token;
+  (*(int *)context)++;
+}
+
+// Left-associative chains open no nesting, so the depth limit does not
+// bound their height; printing and visiting them must not recurse.
+static void test_long_chains(void **state) {
+  (void)state;
+
+  int terms = 100000;
+  assert_true(terms > PARSER_MAX_DEPTH);
+  sds input = sdsnew("let x = 1");
+  for (int i = 1; i < terms; i++) {
+    input = sdscat(input, " + 1");
+  }
+  input = sdscat(input, ";");
+
+  Parser parser;
+  parser_init(&parser, input, sdslen(input));
+  Node *program = parser_parse_program(&parser);
+  int error_count;
+  parser_get_errors(&parser, &error_count);
+  assert_int_equal(error_count, 0);
+
+  Node *expression =
+      AS_LET_STATEMENT(AS_PROGRAM(program)->statements[0])->value;
+  int height = 0;
+  while (IS_INFIX_EXPRESSION(expression)) {
+    expression = AS_INFIX_EXPRESSION(expression)->left;
+    height++;
+  }
+  assert_int_equal(height, terms - 1);
+
+  // "let x = " and ";", a "1" per term and "( + )" per operator.
+  sds output = node_to_string(program);
+  assert_int_equal(sdslen(output), 9 + terms + 5 * (terms - 1));
+  assert_memory_equal(output, "let x = ((((", 12);
+  assert_memory_equal(output + 8 + terms - 1, "1 + 1) + 1)", 11);
+  assert_string_equal(output + sdslen(output) - 6, " + 1);");
+  sdsfree(output);
+
+  // let, x, a 1 per term and an operator between each two.
+  int tokens = 0;
+  node_visit_tokens(program, count_visit, &tokens);
+  assert_int_equal(tokens, 2 + terms + terms - 1);
+
+  program_free(program);
+  parser_free(&parser);
+  sdsfree(input);
+}
+
+static Node *function_body(Node *expression) {
+  assert_true(IS_FUNCTION_LITERAL(expression));
+  return AS_FUNCTION_LITERAL(expression)->body;
+}
+
+static void test_lazy_bodies(void **state) {
+  (void)state;
+
+  const char *input = "let add = fn(a, b) { let c = a + b; fn(x) { x * c } };"
+                      "add(1, 2);";
+  Parser parser;
+  parser_init(&parser, input, strlen(input));
+  parser.lazy_bodies = 1;
+  Node *program = parser_parse_program(&parser);
+  int error_count;
+  parser_get_errors(&parser, &error_count);
+  assert_int_equal(error_count, 0);
+
+  // A skipped body prints as its source.
+  Node *outer = AS_LET_STATEMENT(AS_PROGRAM(program)->statements[0])->value;
+  Node *body = function_body(outer);
+  assert_true(AS_BLOCK_STATEMENT(body)->unparsed);
+  assert_int_equal(AS_BLOCK_STATEMENT(body)->statements.count, 0);
+  assert_prints(outer, "fn(a, b) { let c = a + b; fn(x) { x * c } }");
+
+  // Parsing it leaves the function inside it skipped in turn.
+  Arena *arena = AS_PROGRAM(program)->arena;
+  assert_int_equal(parser_parse_body(&parser, body, arena), 0);
+  assert_false(AS_BLOCK_STATEMENT(body)->unparsed);
+  NodeList statements = AS_BLOCK_STATEMENT(body)->statements;
+  assert_int_equal(statements.count, 2);
+  Node *inner = AS_EXPRESSION_STATEMENT(statements.items[1])->expression;
+  assert_true(AS_BLOCK_STATEMENT(function_body(inner))->unparsed);
+  assert_int_equal(parser_parse_body(&parser, function_body(inner), arena),
+                   0);
+  // Offsets in a body are still into the whole input.
+  assert_int_equal(AS_LET_STATEMENT(statements.items[0])->name->token.offset,
+                   strstr(input, "c =") - input);
+
+  // Once every body is parsed, the tree is the one an eager parse gives.
+  init_parser(input);
+  Node *eager = parse_program();
+  sds expected = node_to_string(eager);
+  assert_prints(program, expected);
+  sdsfree(expected);
+  program_free(eager);
+  program_free(program);
+  parser_free(&parser);
+}
+
+static void test_lazy_body_errors(void **state) {
+  (void)state;
+
+  // Errors inside a body wait until it is parsed.
+  const char *input = "let f = fn() {\n  let = 1;\n};\nf();";
+  Parser parser;
+  parser_init(&parser, input, strlen(input));
+  parser.lazy_bodies = 1;
+  Node *program = parser_parse_program(&parser);
+  int error_count;
+  ParseError *errors = parser_get_errors(&parser, &error_count);
+  assert_int_equal(error_count, 0);
+  assert_int_equal(AS_PROGRAM(program)->statement_count, 2);
+
+  Node *body = function_body(
+      AS_LET_STATEMENT(AS_PROGRAM(program)->statements[0])->value);
+  assert_int_equal(
+      parser_parse_body(&parser, body, AS_PROGRAM(program)->arena), 1);
+  assert_true(AS_BLOCK_STATEMENT(body)->unparsed);
+  errors = parser_get_errors(&parser, &error_count);
+  assert_int_equal(error_count, 1);
+  assert_message(&errors[0], "expected next token to be IDENT, got = instead");
+  Position position = parser_error_position(&parser, &errors[0]);
+  assert_int_equal(position.line, 2);
+  assert_int_equal(position.column, 7);
+  program_free(program);
+  parser_free(&parser);
+
+  // The caller's error limit applies inside the body too.
+  input = "let f = fn() { let = 1; let = 2; let = 3; let = 4; };";
+  parser_init(&parser, input, strlen(input));
+  parser.lazy_bodies = 1;
+  parser.max_errors = 2;
+  program = parser_parse_program(&parser);
+  body = function_body(
+      AS_LET_STATEMENT(AS_PROGRAM(program)->statements[0])->value);
+  assert_int_equal(
+      parser_parse_body(&parser, body, AS_PROGRAM(program)->arena), 2);
+  parser_get_errors(&parser, &error_count);
+  assert_int_equal(error_count, 2);
+  program_free(program);
+  parser_free(&parser);
+
+  // Errors the caller already has count against that limit: the body only
+  // finds as many as there is room for, and once the caller is full the
+  // next body is not parsed at all.
+  input = "let = 0; let f = fn() { let = 1; let = 2; let = 3; };\n"
+          "let g = fn() { let = 4; };";
+  parser_init(&parser, input, strlen(input));
+  parser.lazy_bodies = 1;
+  parser.max_errors = 2;
+  program = parser_parse_program(&parser);
+  parser_get_errors(&parser, &error_count);
+  assert_int_equal(error_count, 1);
+  body = function_body(
+      AS_LET_STATEMENT(AS_PROGRAM(program)->statements[0])->value);
+  assert_int_equal(
+      parser_parse_body(&parser, body, AS_PROGRAM(program)->arena), 1);
+  errors = parser_get_errors(&parser, &error_count);
+  assert_int_equal(error_count, 2);
+  assert_int_equal(errors[1].offset, strstr(input, "= 1") - input);
+  body = function_body(
+      AS_LET_STATEMENT(AS_PROGRAM(program)->statements[1])->value);
+  assert_int_equal(
+      parser_parse_body(&parser, body, AS_PROGRAM(program)->arena), 0);
+  assert_true(AS_BLOCK_STATEMENT(body)->unparsed);
+  parser_get_errors(&parser, &error_count);
+  assert_int_equal(error_count, 2);
+  program_free(program);
+  parser_free(&parser);
+
+  // Unbalanced braces are found while skipping.
+  input = "fn() { if (x) { y }";
+  parser_init(&parser, input, strlen(input));
+  parser.lazy_bodies = 1;
+  program = parser_parse_program(&parser);
+  errors = parser_get_errors(&parser, &error_count);
+  assert_int_equal(error_count, 1);
+  assert_message(&errors[0], "expected }, got EOF instead");
+  program_free(program);
+  parser_free(&parser);
+}
+
+// Parses tokens sequentially, then in parallel on 1 to 16 threads, and
+// checks that every parse gives the same program and errors.
+static void assert_parallel_matches(const char *input, int max_errors) {
+  size_t length = strlen(input);
+  TokenArray tokens;
+  tokenize_parallel(input, length, 1, &tokens);
+
+  Parser parser;
+  parser_init_tokens(&parser, tokens.tokens, tokens.count, input, length);
+  parser.max_errors = max_errors;
+  Node *program = parser_parse_program(&parser);
+  sds expected = node_to_string(program);
+  int expected_count;
+  ParseError *expected_errors = parser_get_errors(&parser, &expected_count);
+
+  for (int threads = 1; threads <= 16; threads++) {
+    Parser parallel;
+    parser_init_tokens(&parallel, tokens.tokens, tokens.count, input, length);
+    parallel.max_errors = max_errors;
+    Node *parallel_program = parse_parallel(&parallel, threads);
+    assert_int_equal(parser_peek(&parallel, 0)->type, TOKEN_EOF);
+    assert_int_equal(AS_PROGRAM(parallel_program)->statement_count,
+                     AS_PROGRAM(program)->statement_count);
+    assert_prints(parallel_program, expected);
+
+    int count;
+    ParseError *errors = parser_get_errors(&parallel, &count);
+    assert_int_equal(count, expected_count);
+    for (int i = 0; i < count; i++) {
+      assert_int_equal(errors[i].code, expected_errors[i].code);
+      assert_int_equal(errors[i].offset, expected_errors[i].offset);
+    }
+
+    program_free(parallel_program);
+    parser_free(&parallel);
+  }
+
+  sdsfree(expected);
+  program_free(program);
+  parser_free(&parser);
+  token_array_free(&tokens);
+}
+
+static void test_parallel(void **state) {
+  (void)state;
+
+  const char *snippets[] = {
+      "let add = fn(a, b) { let c = a + b; return c * 2; };\n",
+      "if (add(1, [2, 3][0]) > 4) { \"yes\"; x; } else { !true; };\n",
+      "let f = fn() { fn(x) { x; y; } };\n",
+      "foo(1, 2); -3;\n",
+      "let = 5; let y 7; x + ;\n",
+      "fn() { if (x) { ) } };\n",
+  };
+  sds valid = sdsempty();
+  sds mixed = sdsempty();
+  for (int i = 0; i < 200; i++) {
+    valid = sdscat(valid, snippets[i % 4]);
+    mixed = sdscat(mixed, snippets[i % 6]);
+  }
+
+  assert_parallel_matches(valid, PARSER_MAX_ERRORS);
+  assert_parallel_matches(mixed, PARSER_MAX_ERRORS);
+  assert_parallel_matches(mixed, 1000);
+  assert_parallel_matches(mixed, 7);
+  // Past an unbalanced bracket there is nowhere safe to split.
+  sds unbalanced = sdscatsds(sdsnew("x); "), mixed);
+  assert_parallel_matches(unbalanced, 1000);
+  sdsfree(unbalanced);
+  assert_parallel_matches("", PARSER_MAX_ERRORS);
+
+  sdsfree(valid);
+  sdsfree(mixed);
+}
+
+static void test_corpus(void **state) {
+  (void)state;
+
+  for (int kind = 0; kind < CORPUS_KIND_COUNT; kind++) {
+    sds input = corpus_generate((CorpusKind)kind, 50000, 7);
+    sds again = corpus_generate((CorpusKind)kind, 50000, 7);
+    assert_true(sdslen(input) >= 50000);
+    assert_int_equal(sdslen(input), sdslen(again));
+    assert_memory_equal(input, again, sdslen(input));
+
+    Parser parser;
+    parser_init(&parser, input, sdslen(input));
+    Node *program = parser_parse_program(&parser);
+    int error_count;
+    parser_get_errors(&parser, &error_count);
+    assert_int_equal(error_count, 0);
+    assert_true(AS_PROGRAM(program)->statement_count > 0);
+
+    program_free(program);
+    parser_free(&parser);
+    sdsfree(input);
+    sdsfree(again);
+  }
+
+  sds one = corpus_generate(CORPUS_EXPRESSIONS, 1000, 1);
+  sds other = corpus_generate(CORPUS_EXPRESSIONS, 1000, 2);
+  assert_true(strcmp(one, other) != 0);
+  sdsfree(one);
+  sdsfree(other);
+}
+
+static void test_lookahead(void **state) {
+  (void)state;
+
+  // More tokens than fit in the ring buffer, so peeking has to wrap.
+  sds input = sdsempty();
+  for (int i = 0; i < PARSER_LOOKAHEAD * 3; i++) {
+    input = sdscatprintf(input, "%d ", i);
+  }
+
+  Parser parser;
+  parser_init(&parser, input, sdslen(input));
+
+  for (int i = 0; i < PARSER_LOOKAHEAD * 3; i++) {
+    int distance = i % PARSER_LOOKAHEAD;
+    const Token *ahead = parser_peek(&parser, distance);
+    int expected = i + distance;
+
+    if (expected < PARSER_LOOKAHEAD * 3) {
+      char text[16];
+      snprintf(text, sizeof(text), "%d", expected);
+      assert_int_equal(ahead->type, TOKEN_INT);
+      assert_true(token_literal_equals(*ahead, text));
+    } else {
+      assert_int_equal(ahead->type, TOKEN_EOF);
+    }
+
+    parser_next_token(&parser);
+  }
+
+  assert_int_equal(parser_peek(&parser, 0)->type, TOKEN_EOF);
+  assert_null(parser_peek(&parser, PARSER_LOOKAHEAD));
+
+  parser_free(&parser);
+  sdsfree(input);
 }
 
 int main(void) {
@@ -210,6 +988,25 @@ int main(void) {
       cmocka_unit_test(test_return_statements),
       cmocka_unit_test(test_identifier_expression),
       cmocka_unit_test(test_integer_literal),
+      cmocka_unit_test(test_integer_overflow),
+      cmocka_unit_test(test_error_positions),
+      cmocka_unit_test(test_independent_parsers),
+      cmocka_unit_test(test_let_values),
+      cmocka_unit_test(test_prefix_and_infix_expressions),
+      cmocka_unit_test(test_operator_precedence),
+      cmocka_unit_test(test_if_expression),
+      cmocka_unit_test(test_function_literal),
+      cmocka_unit_test(test_call_and_index_expressions),
+      cmocka_unit_test(test_expression_errors),
+      cmocka_unit_test(test_error_recovery),
+      cmocka_unit_test(test_error_limit),
+      cmocka_unit_test(test_nesting_limit),
+      cmocka_unit_test(test_long_chains),
+      cmocka_unit_test(test_lazy_bodies),
+      cmocka_unit_test(test_lazy_body_errors),
+      cmocka_unit_test(test_parallel),
+      cmocka_unit_test(test_corpus),
+      cmocka_unit_test(test_lookahead),
   };
 
   return cmocka_run_group_tests(tests, NULL, NULL);
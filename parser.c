@@ -3,190 +3,965 @@
 #include "lexer.h"
 #include "memory.h"
 #include "sds.h"
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static Parser parser;
+static Parser default_parser;
+
+// The parser does not recurse: whatever is waiting for a nested
+// expression, block or statement to finish is pushed as a frame, and
+// resumed with the finished node once it is.
+typedef enum {
+  // An expression's operand is being parsed; on resuming, infix operators
+  // that bind tighter than precedence extend it.
+  FRAME_OPERAND,
+  // A block's statements are being parsed.
+  FRAME_BLOCK,
+  FRAME_LET,
+  FRAME_RETURN,
+  FRAME_EXPRESSION_STATEMENT,
+  FRAME_PREFIX,
+  FRAME_INFIX,
+  FRAME_GROUPED,
+  FRAME_INDEX,
+  // Items of a call's arguments or an array literal.
+  FRAME_LIST,
+  FRAME_IF_CONDITION,
+  FRAME_IF_CONSEQUENCE,
+  FRAME_IF_ALTERNATIVE,
+  FRAME_FUNCTION,
+  FRAME_KIND_COUNT,
+} FrameKind;
+
+struct ParseFrame {
+  FrameKind kind;
+  Precedence precedence;
+  // Where the frame's list starts on the item stack.
+  int base;
+  Token token;
+  // What the frame has parsed so far: a let's name, an infix or index
+  // expression's left side, a call's function, an if's condition and
+  // consequence.
+  Node *left;
+  Node *right;
+};
+
+// What the parse loop does next.
+typedef enum {
+  // Parse a statement at the current token.
+  STEP_STATEMENT,
+  // Parse the operand of the FRAME_OPERAND on top at the current token.
+  STEP_PREFIX,
+  // A node is finished: resume the frame on top with it.
+  STEP_RESUME,
+  STEP_ERROR,
+} Step;
+
+typedef Step (*PrefixParseFn)(Parser *parser, Node **result);
+typedef Step (*InfixParseFn)(Parser *parser, Node *left, Node **result);
+typedef Step (*ResumeFn)(Parser *parser, ParseFrame *frame, Node **result);
+
+static PrefixParseFn prefix_parse_fns[TOKEN_COUNT];
+static InfixParseFn infix_parse_fns[TOKEN_COUNT];
+static const Precedence precedences[TOKEN_COUNT];
+static const ResumeFn resume_fns[FRAME_KIND_COUNT];
+static void fill_tokens(Parser *parser, int needed);
 
-static Node *parse_statement();
-static Node *parse_let_statement();
-static Node *parse_return_statement();
-static Node *parse_expression_statement();
+void init_parser(const char *input) {
+  parser_free(&default_parser);
+  parser_init(&default_parser, input, strlen(input));
+}
 
-typedef Node *(*PrefixParseFn)();
-typedef Node *(*InfixParseFn)(Node *expression);
+Node *parse_program() { return parser_parse_program(&default_parser); }
 
-static PrefixParseFn get_prefix_fn(TokenType token_type);
+void parse_next_token() { parser_next_token(&default_parser); }
 
-void init_parser(const char *input) {
-  init_lexer(input);
+int expect_peek(TokenType type) {
+  return parser_expect_peek(&default_parser, type);
+}
 
-  parser.errors = ALLOCATE(ParseError, 8);
-  parser.error_count = 0;
-  parser.error_capacity = 8;
+void peek_error(TokenType type) { parser_peek_error(&default_parser, type); }
 
-  parse_next_token();
-  parse_next_token();
+ParseError *get_errors(int *count) {
+  return parser_get_errors(&default_parser, count);
 }
 
-void parse_next_token() {
-  parser.current_token = parser.peek_token;
-  parser.peek_token = next_token();
+static void init_state(Parser *parser, const char *input, size_t length) {
+  parser->errors = ALLOCATE(ParseError, 8);
+  parser->error_count = 0;
+  parser->error_capacity = 8;
+  line_map_init(&parser->lines, input, length);
+  parser->arena = NULL;
+  parser->items = NULL;
+  parser->item_count = 0;
+  parser->item_capacity = 0;
+  parser->frames = NULL;
+  parser->frame_count = 0;
+  parser->frame_capacity = 0;
+  parser->depth = 0;
+  parser->max_errors = PARSER_MAX_ERRORS;
+  parser->max_depth = PARSER_MAX_DEPTH;
+  parser->lazy_bodies = 0;
+
+  parser->head = 0;
+  parser->token_count = 0;
+  fill_tokens(parser, 2);
 }
 
-int expect_peek(TokenType type) {
-  if (parser.peek_token.type == type) {
-    parse_next_token();
+void parser_init(Parser *parser, const char *input, size_t length) {
+  lexer_init(&parser->lexer, input, length);
+  parser->source = NULL;
+  parser->source_count = 0;
+  parser->source_next = 0;
+  init_state(parser, input, length);
+}
+
+void parser_init_tokens(Parser *parser, const Token *tokens, size_t count,
+                        const char *input, size_t length) {
+  lexer_init(&parser->lexer, input, 0);
+  parser->source = tokens;
+  parser->source_count = count;
+  parser->source_next = 0;
+  init_state(parser, input, length);
+}
+
+// Copies up to n tokens from the source array, with the same contract as
+// lexer_next_token_batch(): the batch ends after TOKEN_EOF, which is
+// repeated once the array is used up.
+static int source_token_batch(Parser *parser, Token *out, int n) {
+  const Token *source = parser->source;
+  size_t last = parser->source_count - 1;
+
+  for (int i = 0; i < n; i++) {
+    size_t next = parser->source_next < last ? parser->source_next : last;
+    out[i] = source[next];
+    parser->source_next++;
+    if (out[i].type == TOKEN_EOF) {
+      return i + 1;
+    }
+  }
+  return n;
+}
+
+// Tops the ring buffer up until at least needed tokens are buffered,
+// lexing as many tokens per batch as there is contiguous free space.
+static void fill_tokens(Parser *parser, int needed) {
+  while (parser->token_count < needed) {
+    int tail = (parser->head + parser->token_count) & (PARSER_LOOKAHEAD - 1);
+    int space = PARSER_LOOKAHEAD - parser->token_count;
+    int contiguous = PARSER_LOOKAHEAD - tail;
+    int batch = space < contiguous ? space : contiguous;
+
+    if (parser->source != NULL) {
+      parser->token_count +=
+          source_token_batch(parser, &parser->tokens[tail], batch);
+    } else {
+      parser->token_count += lexer_next_token_batch(
+          &parser->lexer, &parser->tokens[tail], batch);
+    }
+  }
+}
+
+size_t parser_token_index(Parser *parser) {
+  return parser->source_next - (size_t)parser->token_count;
+}
+
+void parser_seek(Parser *parser, size_t index) {
+  parser->source_next = index;
+  parser->head = 0;
+  parser->token_count = 0;
+  fill_tokens(parser, 2);
+}
+
+const Token *parser_peek(Parser *parser, int distance) {
+  if (distance < 0 || distance >= PARSER_LOOKAHEAD) {
+    return NULL;
+  }
+
+  fill_tokens(parser, distance + 1);
+  return &parser->tokens[(parser->head + distance) & (PARSER_LOOKAHEAD - 1)];
+}
+
+static Token *current_token(Parser *parser) {
+  return &parser->tokens[parser->head];
+}
+
+static Token *peek_token(Parser *parser) {
+  fill_tokens(parser, 2);
+  return &parser->tokens[(parser->head + 1) & (PARSER_LOOKAHEAD - 1)];
+}
+
+void parser_next_token(Parser *parser) {
+  fill_tokens(parser, 2);
+  parser->head = (parser->head + 1) & (PARSER_LOOKAHEAD - 1);
+  parser->token_count--;
+}
+
+int parser_expect_peek(Parser *parser, TokenType type) {
+  if (peek_token(parser)->type == type) {
+    parser_next_token(parser);
     return 1;
   } else {
-    peek_error(type);
+    parser_peek_error(parser, type);
     return 0;
   }
 }
 
-void peek_error(TokenType type) {
-  if (parser.error_count >= parser.error_capacity) {
-    int old_capacity = parser.error_capacity;
-    parser.error_capacity = GROW_CAPACITY(old_capacity);
-    parser.errors = GROW_ARRAY(ParseError, parser.errors, old_capacity,
-                               parser.error_capacity);
+void parser_add_error(Parser *parser, ParseError error) {
+  if (parser->error_count >= parser->max_errors) {
+    return;
+  }
+  if (parser->error_count >= parser->error_capacity) {
+    int old_capacity = parser->error_capacity;
+    parser->error_capacity = GROW_CAPACITY(old_capacity);
+    parser->errors = GROW_ARRAY(ParseError, parser->errors, old_capacity,
+                                parser->error_capacity);
   }
+  parser->errors[parser->error_count++] = error;
+}
 
-  ParseError *error = &parser.errors[parser.error_count];
-  error->message = ALLOCATE(char, 256);
+// Reports an error about token.
+static void token_error(Parser *parser, ParseErrorCode code,
+                        TokenType expected, const Token *token) {
+  ParseError error;
+  error.code = code;
+  error.expected = expected;
+  error.got = token->type;
+  error.length = token->length;
+  error.offset = token->offset;
+  parser_add_error(parser, error);
+}
 
-  snprintf(error->message, 256, "expected next token to be %s, got %s instead",
-           token_type_to_string(type),
-           token_type_to_string(parser.peek_token.type));
+void parser_peek_error(Parser *parser, TokenType type) {
+  token_error(parser, PARSE_ERROR_UNEXPECTED_TOKEN, type, peek_token(parser));
+}
 
-  parser.error_count++;
+// Reports an error about the current token.
+static void current_error(Parser *parser, ParseErrorCode code) {
+  token_error(parser, code, TOKEN_ILLEGAL, current_token(parser));
 }
 
-void error_message(const char *message) {
-  if (parser.error_count >= parser.error_capacity) {
-    int old_capacity = parser.error_capacity;
-    parser.error_capacity = GROW_CAPACITY(old_capacity);
-    parser.errors = GROW_ARRAY(ParseError, parser.errors, old_capacity,
-                               parser.error_capacity);
+sds parse_error_message(const ParseError *error) {
+  switch (error->code) {
+  case PARSE_ERROR_UNEXPECTED_TOKEN:
+    return sdscatprintf(sdsempty(),
+                        "expected next token to be %s, got %s instead",
+                        token_type_to_string(error->expected),
+                        token_type_to_string(error->got));
+  case PARSE_ERROR_NO_PREFIX:
+    return sdscatprintf(sdsempty(), "no prefix parse function for %s found",
+                        token_type_to_string(error->got));
+  case PARSE_ERROR_INTEGER_OVERFLOW:
+    return sdsnew("could not parse as integer");
+  case PARSE_ERROR_UNCLOSED_BLOCK:
+    return sdsnew("expected }, got EOF instead");
+  case PARSE_ERROR_TOO_DEEP:
+    return sdsnew("expressions and blocks nested too deeply");
   }
+  return sdsnew("unknown error");
+}
 
-  ParseError *error = &parser.errors[parser.error_count];
-  error->message = message;
+ParseError *parser_get_errors(Parser *parser, int *count) {
+  *count = parser->error_count;
+  return parser->errors;
+}
 
-  parser.error_count++;
+Position parser_error_position(Parser *parser, const ParseError *error) {
+  return line_map_position(&parser->lines, error->offset);
 }
 
-ParseError *get_errors(int *count) {
-  *count = parser.error_count;
-  return parser.errors;
+void parser_free(Parser *parser) {
+  FREE_ARRAY(ParseError, parser->errors, parser->error_capacity);
+  parser->errors = NULL;
+  parser->error_count = 0;
+  parser->error_capacity = 0;
+  FREE_ARRAY(Node *, parser->items, parser->item_capacity);
+  parser->items = NULL;
+  parser->item_count = 0;
+  parser->item_capacity = 0;
+  FREE_ARRAY(ParseFrame, parser->frames, parser->frame_capacity);
+  parser->frames = NULL;
+  parser->frame_count = 0;
+  parser->frame_capacity = 0;
+  line_map_free(&parser->lines);
 }
 
-Node *parse_program() {
+Node *parser_parse_program(Parser *parser) {
   Node *program_node = new_program_node();
+  parser->arena = AS_PROGRAM(program_node)->arena;
 
-  while (parser.current_token.type != TOKEN_EOF) {
-    Node *statement = parse_statement();
+  while (current_token(parser)->type != TOKEN_EOF &&
+         parser->error_count < parser->max_errors) {
+    Node *statement = parser_parse_statement(parser);
     if (statement) {
       add_statement(AS_PROGRAM(program_node), statement);
     }
-    parse_next_token();
   }
 
   return program_node;
 }
 
-static Node *parse_statement() {
-  switch (parser.current_token.type) {
-  case TOKEN_LET:
-    return parse_let_statement();
+static Node *parse(Parser *parser, int *open_blocks);
+
+// Panic-mode recovery: skips what is left of a statement with an error,
+// so one mistake is reported once rather than once per token after it.
+// Skipping stops before a "let" or "return" other than the statement's
+// own first token, or after a ";" or a stray "}", but only outside the
+// blocks that were open at the error and any opened while skipping.
+static void synchronize(Parser *parser, size_t start, int open_blocks) {
+  while (1) {
+    const Token *token = current_token(parser);
+    switch (token->type) {
+    case TOKEN_EOF:
+      return;
+    case TOKEN_LET:
+    case TOKEN_RETURN:
+      if (open_blocks == 0 && token->offset != start) {
+        return;
+      }
+      break;
+    case TOKEN_LBRACE:
+      open_blocks++;
+      break;
+    case TOKEN_RBRACE:
+      if (open_blocks == 0) {
+        parser_next_token(parser);
+        return;
+      }
+      open_blocks--;
+      break;
+    case TOKEN_SEMICOLON:
+      if (open_blocks == 0) {
+        parser_next_token(parser);
+        return;
+      }
+      break;
+    default:
+      break;
+    }
+    parser_next_token(parser);
+  }
+}
+
+Node *parser_parse_statement(Parser *parser) {
+  if (current_token(parser)->type == TOKEN_EOF) {
+    return NULL;
+  }
+
+  size_t start = current_token(parser)->offset;
+  int item_count = parser->item_count;
+  int open_blocks = 0;
+  Node *statement = parse(parser, &open_blocks);
+  if (statement == NULL) {
+    parser->item_count = item_count;
+    synchronize(parser, start, open_blocks);
+    return NULL;
+  }
+  parser_next_token(parser);
+  return statement;
+}
+
+static void push_item(Parser *parser, Node *item) {
+  if (parser->item_count >= parser->item_capacity) {
+    int old_capacity = parser->item_capacity;
+    parser->item_capacity = GROW_CAPACITY(old_capacity);
+    parser->items = GROW_ARRAY(Node *, parser->items, old_capacity,
+                               parser->item_capacity);
+  }
+  parser->items[parser->item_count++] = item;
+}
+
+// Moves the items pushed since base into a list of their own.
+static NodeList pop_list(Parser *parser, int base) {
+  NodeList list = new_node_list(parser->arena, parser->item_count - base);
+  if (list.count > 0) {
+    memcpy(list.items, parser->items + base, sizeof(Node *) * list.count);
+  }
+  parser->item_count = base;
+  return list;
+}
+
+int parser_parse_body(Parser *parser, Node *body, Arena *arena) {
+  BlockStatement *block = AS_BLOCK_STATEMENT(body);
+  // The body may only find as many errors as parser has room left for.
+  int max_errors = parser->max_errors - parser->error_count;
+  if (!block->unparsed || max_errors <= 0) {
+    return 0;
+  }
+
+  // Lex only what is between the braces, with offsets into the whole input.
+  Parser inner;
+  const char *text = block->token.start + 1;
+  size_t length = (size_t)block->token.length - 2;
+  lexer_init(&inner.lexer, text, length);
+  inner.lexer.base = block->token.offset + 1;
+  inner.source = NULL;
+  inner.source_count = 0;
+  inner.source_next = 0;
+  init_state(&inner, text, length);
+  inner.arena = arena;
+  inner.max_depth = parser->max_depth;
+  inner.max_errors = max_errors;
+  inner.lazy_bodies = 1;
+
+  while (current_token(&inner)->type != TOKEN_EOF &&
+         inner.error_count < inner.max_errors) {
+    Node *statement = parser_parse_statement(&inner);
+    if (statement) {
+      push_item(&inner, statement);
+    }
+  }
+
+  if (inner.error_count == 0) {
+    block->statements = pop_list(&inner, 0);
+    block->token.length = 1;
+    block->unparsed = 0;
+  }
+  int before = parser->error_count;
+  for (int i = 0; i < inner.error_count; i++) {
+    parser_add_error(parser, inner.errors[i]);
+  }
+  parser_free(&inner);
+  return parser->error_count - before;
+}
+
+// Frames that open a level of nesting, which is what max_depth limits.
+static int nests(FrameKind kind) {
+  return kind == FRAME_OPERAND || kind == FRAME_BLOCK;
+}
+
+static int push_frame(Parser *parser, FrameKind kind, const Token *token) {
+  if (nests(kind)) {
+    if (parser->depth >= parser->max_depth) {
+      current_error(parser, PARSE_ERROR_TOO_DEEP);
+      return 0;
+    }
+    parser->depth++;
+  }
+
+  if (parser->frame_count >= parser->frame_capacity) {
+    int old_capacity = parser->frame_capacity;
+    parser->frame_capacity = GROW_CAPACITY(old_capacity);
+    parser->frames = GROW_ARRAY(ParseFrame, parser->frames, old_capacity,
+                                parser->frame_capacity);
+  }
+
+  ParseFrame *frame = &parser->frames[parser->frame_count++];
+  frame->kind = kind;
+  frame->precedence = LOWEST;
+  frame->base = parser->item_count;
+  if (token != NULL) {
+    frame->token = *token;
+  }
+  frame->left = NULL;
+  frame->right = NULL;
+  return 1;
+}
+
+static ParseFrame *top_frame(Parser *parser) {
+  return &parser->frames[parser->frame_count - 1];
+}
+
+static ParseFrame pop_frame(Parser *parser) {
+  ParseFrame frame = parser->frames[--parser->frame_count];
+  if (nests(frame.kind)) {
+    parser->depth--;
+  }
+  return frame;
+}
+
+// Puts a frame popped for resuming back, to wait for another node.
+static void repush_frame(Parser *parser, const ParseFrame *frame) {
+  parser->frames[parser->frame_count++] = *frame;
+  if (nests(frame->kind)) {
+    parser->depth++;
+  }
+}
+
+// Starts an expression at the current token that stops before any infix
+// operator binding no tighter than precedence.
+static Step begin_expression(Parser *parser, Precedence precedence) {
+  if (!push_frame(parser, FRAME_OPERAND, NULL)) {
+    return STEP_ERROR;
+  }
+  top_frame(parser)->precedence = precedence;
+  return STEP_PREFIX;
+}
+
+// With a FRAME_BLOCK on top, finishes the block if the current token
+// closes it, and otherwise parses its next statement.
+static Step continue_block(Parser *parser, Node **result) {
+  switch (current_token(parser)->type) {
+  case TOKEN_RBRACE: {
+    ParseFrame frame = pop_frame(parser);
+    *result = new_block_statement_node(parser->arena, frame.token,
+                                       pop_list(parser, frame.base));
+    return STEP_RESUME;
+  }
+  case TOKEN_EOF:
+    token_error(parser, PARSE_ERROR_UNCLOSED_BLOCK, TOKEN_RBRACE,
+                current_token(parser));
+    return STEP_ERROR;
+  default:
+    return STEP_STATEMENT;
+  }
+}
+
+// Starts the block at the "{" that is the current token. Once finished,
+// its "}" is the current token.
+static Step begin_block(Parser *parser, Node **result) {
+  if (!push_frame(parser, FRAME_BLOCK, current_token(parser))) {
+    return STEP_ERROR;
+  }
+  parser_next_token(parser);
+  return continue_block(parser, result);
+}
+
+static Step resume_block(Parser *parser, ParseFrame *frame, Node **result) {
+  push_item(parser, *result);
+  parser_next_token(parser);
+  repush_frame(parser, frame);
+  return continue_block(parser, result);
+}
+
+static Step begin_statement(Parser *parser, Node **result) {
+  Token token = *current_token(parser);
+
+  switch (token.type) {
+  case TOKEN_LET: {
+    if (!parser_expect_peek(parser, TOKEN_IDENT)) {
+      return STEP_ERROR;
+    }
+    Node *name = new_identifier_node(parser->arena, *current_token(parser));
+    if (!parser_expect_peek(parser, TOKEN_ASSIGN) ||
+        !push_frame(parser, FRAME_LET, &token)) {
+      return STEP_ERROR;
+    }
+    top_frame(parser)->left = name;
+    parser_next_token(parser);
+    return begin_expression(parser, LOWEST);
+  }
   case TOKEN_RETURN:
-    return parse_return_statement();
+    parser_next_token(parser);
+    // A bare "return;" has no value.
+    if (current_token(parser)->type == TOKEN_SEMICOLON) {
+      *result = new_return_statement_node(parser->arena, token);
+      return STEP_RESUME;
+    }
+    if (!push_frame(parser, FRAME_RETURN, &token)) {
+      return STEP_ERROR;
+    }
+    return begin_expression(parser, LOWEST);
   default:
-    return parse_expression_statement();
+    if (!push_frame(parser, FRAME_EXPRESSION_STATEMENT, &token)) {
+      return STEP_ERROR;
+    }
+    return begin_expression(parser, LOWEST);
   }
 }
 
-static Node *parse_let_statement() {
-  Node *stmt_node = new_let_statement_node(parser.current_token);
-  if (!expect_peek(TOKEN_IDENT)) {
-    FREE(Node, stmt_node);
-    return NULL;
+// A statement's optional semicolon becomes its last token.
+static void skip_semicolon(Parser *parser) {
+  if (peek_token(parser)->type == TOKEN_SEMICOLON) {
+    parser_next_token(parser);
   }
+}
 
-  Node *ident_node = new_identifier_node(parser.current_token);
+static Step resume_let(Parser *parser, ParseFrame *frame, Node **result) {
+  skip_semicolon(parser);
+  Node *node = new_let_statement_node(parser->arena, frame->token);
+  LetStatement *stmt = AS_LET_STATEMENT(node);
+  stmt->name = AS_IDENTIFIER(frame->left);
+  stmt->value = *result;
+  *result = node;
+  return STEP_RESUME;
+}
 
-  LetStatement *stmt = AS_LET_STATEMENT(stmt_node);
-  stmt->name = AS_IDENTIFIER(ident_node);
+static Step resume_return(Parser *parser, ParseFrame *frame, Node **result) {
+  skip_semicolon(parser);
+  Node *node = new_return_statement_node(parser->arena, frame->token);
+  AS_RETURN_STATEMENT(node)->return_value = *result;
+  *result = node;
+  return STEP_RESUME;
+}
 
-  if (!expect_peek(TOKEN_ASSIGN)) {
-    FREE(Node, ident_node);
-    FREE(Node, stmt_node);
-    return NULL;
+static Step resume_expression_statement(Parser *parser, ParseFrame *frame,
+                                        Node **result) {
+  skip_semicolon(parser);
+  *result = new_expression_node(parser->arena, frame->token, *result);
+  return STEP_RESUME;
+}
+
+// Pratt parsing: the operand on the frame is extended by infix operators
+// for as long as the next token binds tighter than the frame's precedence.
+static Step resume_operand(Parser *parser, ParseFrame *frame, Node **result) {
+  TokenType next = peek_token(parser)->type;
+  if (frame->precedence >= precedences[next]) {
+    return STEP_RESUME;
   }
 
-  while (parser.current_token.type != TOKEN_SEMICOLON &&
-         parser.current_token.type != TOKEN_EOF) {
-    parse_next_token();
+  repush_frame(parser, frame);
+  parser_next_token(parser);
+  return infix_parse_fns[next](parser, *result, result);
+}
+
+// Parses the statement at the current token, leaving its last token
+// current. Returns NULL after an error, with how many blocks were open in
+// open_blocks.
+static Node *parse(Parser *parser, int *open_blocks) {
+  int floor = parser->frame_count;
+  Node *result = NULL;
+  Step step = STEP_STATEMENT;
+
+  while (1) {
+    switch (step) {
+    case STEP_STATEMENT:
+      step = begin_statement(parser, &result);
+      break;
+    case STEP_PREFIX: {
+      PrefixParseFn prefix = prefix_parse_fns[current_token(parser)->type];
+      if (prefix == NULL) {
+        current_error(parser, PARSE_ERROR_NO_PREFIX);
+        step = STEP_ERROR;
+      } else {
+        step = prefix(parser, &result);
+      }
+      break;
+    }
+    case STEP_RESUME:
+      if (parser->frame_count == floor) {
+        return result;
+      } else {
+        ParseFrame frame = pop_frame(parser);
+        step = resume_fns[frame.kind](parser, &frame, &result);
+      }
+      break;
+    case STEP_ERROR:
+      *open_blocks = 0;
+      while (parser->frame_count > floor) {
+        *open_blocks += pop_frame(parser).kind == FRAME_BLOCK;
+      }
+      return NULL;
+    }
   }
+}
 
-  return stmt_node;
+static Step parse_identifier(Parser *parser, Node **result) {
+  *result = new_identifier_node(parser->arena, *current_token(parser));
+  return STEP_RESUME;
 }
 
-static Node *parse_return_statement() {
-  Node *return_statement = new_return_statement_node(parser.current_token);
+static Step parse_integer(Parser *parser, Node **result) {
+  Token *token = current_token(parser);
 
-  while (parser.current_token.type != TOKEN_SEMICOLON &&
-         parser.current_token.type != TOKEN_EOF) {
-    parse_next_token();
+  // The lexer has already decoded the digits.
+  if (token->overflow) {
+    current_error(parser, PARSE_ERROR_INTEGER_OVERFLOW);
+    return STEP_ERROR;
   }
+  *result = new_integer_literal(parser->arena, *token, token->value);
+  return STEP_RESUME;
+}
 
-  return return_statement;
+static Step parse_boolean(Parser *parser, Node **result) {
+  *result = new_boolean_literal(parser->arena, *current_token(parser));
+  return STEP_RESUME;
 }
 
-static Node *parse_expression(Precedence precedence) {
-  PrefixParseFn prefix = get_prefix_fn(parser.current_token.type);
-  if (prefix == NULL) {
-    return NULL;
+static Step parse_string(Parser *parser, Node **result) {
+  *result = new_string_literal(parser->arena, *current_token(parser));
+  return STEP_RESUME;
+}
+
+static Step parse_prefix_expression(Parser *parser, Node **result) {
+  (void)result;
+  if (!push_frame(parser, FRAME_PREFIX, current_token(parser))) {
+    return STEP_ERROR;
+  }
+  parser_next_token(parser);
+  return begin_expression(parser, PREFIX);
+}
+
+static Step resume_prefix(Parser *parser, ParseFrame *frame, Node **result) {
+  *result = new_prefix_expression_node(parser->arena, frame->token, *result);
+  return STEP_RESUME;
+}
+
+static Step parse_grouped_expression(Parser *parser, Node **result) {
+  (void)result;
+  if (!push_frame(parser, FRAME_GROUPED, NULL)) {
+    return STEP_ERROR;
   }
+  parser_next_token(parser);
+  return begin_expression(parser, LOWEST);
+}
 
-  return prefix();
+static Step resume_grouped(Parser *parser, ParseFrame *frame, Node **result) {
+  (void)frame;
+  (void)result;
+  return parser_expect_peek(parser, TOKEN_RPAREN) ? STEP_RESUME : STEP_ERROR;
 }
 
-static Node *parse_expression_statement() {
-  Node *expression_node =
-      new_expression_node(parser.current_token, parse_expression(LOWEST));
+static Step parse_if_expression(Parser *parser, Node **result) {
+  (void)result;
+  Token token = *current_token(parser);
+  if (!parser_expect_peek(parser, TOKEN_LPAREN) ||
+      !push_frame(parser, FRAME_IF_CONDITION, &token)) {
+    return STEP_ERROR;
+  }
+  parser_next_token(parser);
+  return begin_expression(parser, LOWEST);
+}
 
-  if (parser.peek_token.type == TOKEN_SEMICOLON) {
-    parse_next_token();
+static Step resume_if_condition(Parser *parser, ParseFrame *frame,
+                                Node **result) {
+  if (!parser_expect_peek(parser, TOKEN_RPAREN) ||
+      !parser_expect_peek(parser, TOKEN_LBRACE) ||
+      !push_frame(parser, FRAME_IF_CONSEQUENCE, &frame->token)) {
+    return STEP_ERROR;
   }
+  top_frame(parser)->left = *result;
+  return begin_block(parser, result);
+}
 
-  return expression_node;
+static Step resume_if_consequence(Parser *parser, ParseFrame *frame,
+                                  Node **result) {
+  if (peek_token(parser)->type != TOKEN_ELSE) {
+    *result = new_if_expression_node(parser->arena, frame->token,
+                                     frame->left, *result, NULL);
+    return STEP_RESUME;
+  }
+
+  parser_next_token(parser);
+  if (!parser_expect_peek(parser, TOKEN_LBRACE) ||
+      !push_frame(parser, FRAME_IF_ALTERNATIVE, &frame->token)) {
+    return STEP_ERROR;
+  }
+  top_frame(parser)->left = frame->left;
+  top_frame(parser)->right = *result;
+  return begin_block(parser, result);
 }
 
-static Node *parse_identifier() {
-  return new_identifier_node(parser.current_token);
+static Step resume_if_alternative(Parser *parser, ParseFrame *frame,
+                                  Node **result) {
+  *result = new_if_expression_node(parser->arena, frame->token, frame->left,
+                                   frame->right, *result);
+  return STEP_RESUME;
 }
 
-static Node *parse_integer() {
-  Node *integer_node = new_integer_literal(parser.current_token, -1);
-  IntegerLiteral *literal = AS_INTEGER_LITERAL(integer_node);
-  char *endptr;
+// Moves from the "{" that is the current token to its matching "}", and
+// makes the unparsed block spanning them.
+static Step skip_body(Parser *parser, Node **result) {
+  Token open = *current_token(parser);
+  int depth = 1;
+  while (depth > 0) {
+    parser_next_token(parser);
+    switch (current_token(parser)->type) {
+    case TOKEN_LBRACE:
+      depth++;
+      break;
+    case TOKEN_RBRACE:
+      depth--;
+      break;
+    case TOKEN_EOF:
+      token_error(parser, PARSE_ERROR_UNCLOSED_BLOCK, TOKEN_RBRACE,
+                current_token(parser));
+      return STEP_ERROR;
+    default:
+      break;
+    }
+  }
 
-  uint64_t value = strtoull(parser.current_token.literal, &endptr, 10);
+  open.length = (int)(current_token(parser)->offset + 1 - open.offset);
+  *result = new_block_statement_node(parser->arena, open,
+                                     new_node_list(parser->arena, 0));
+  AS_BLOCK_STATEMENT(*result)->unparsed = 1;
+  return STEP_RESUME;
+}
 
-  if (parser.current_token.literal == endptr || *endptr != '\0') {
-    error_message(sdsnew("could not parse as integer"));
-    return NULL;
+static Step parse_function_literal(Parser *parser, Node **result) {
+  Token token = *current_token(parser);
+  if (!parser_expect_peek(parser, TOKEN_LPAREN)) {
+    return STEP_ERROR;
+  }
+
+  int base = parser->item_count;
+  while (peek_token(parser)->type != TOKEN_RPAREN) {
+    if (parser->item_count > base &&
+        !parser_expect_peek(parser, TOKEN_COMMA)) {
+      return STEP_ERROR;
+    }
+    if (!parser_expect_peek(parser, TOKEN_IDENT)) {
+      return STEP_ERROR;
+    }
+    push_item(parser,
+              new_identifier_node(parser->arena, *current_token(parser)));
+  }
+  // The frame's base is taken before the parameters, so the body's
+  // statements go on the item stack above them.
+  if (!parser_expect_peek(parser, TOKEN_RPAREN) ||
+      !parser_expect_peek(parser, TOKEN_LBRACE) ||
+      !push_frame(parser, FRAME_FUNCTION, &token)) {
+    return STEP_ERROR;
+  }
+  top_frame(parser)->base = base;
+  if (parser->lazy_bodies) {
+    return skip_body(parser, result);
+  }
+  return begin_block(parser, result);
+}
+
+static Step resume_function(Parser *parser, ParseFrame *frame,
+                            Node **result) {
+  *result = new_function_literal(parser->arena, frame->token,
+                                 pop_list(parser, frame->base), *result);
+  return STEP_RESUME;
+}
+
+// Starts the items of a call or array literal, whose opening token is
+// current; function is NULL for arrays.
+static Step begin_list(Parser *parser, Node *function, TokenType end,
+                       Node **result) {
+  Token token = *current_token(parser);
+  if (peek_token(parser)->type == end) {
+    parser_next_token(parser);
+    NodeList empty = new_node_list(parser->arena, 0);
+    *result = function != NULL
+                  ? new_call_expression_node(parser->arena, token, function,
+                                             empty)
+                  : new_array_literal(parser->arena, token, empty);
+    return STEP_RESUME;
   }
-  literal->value = value;
 
-  return integer_node;
+  if (!push_frame(parser, FRAME_LIST, &token)) {
+    return STEP_ERROR;
+  }
+  top_frame(parser)->left = function;
+  parser_next_token(parser);
+  return begin_expression(parser, LOWEST);
 }
 
-static PrefixParseFn prefix_parse_fns[] = {
-    [TOKEN_IDENT] = parse_identifier, [TOKEN_INT] = parse_integer};
+static Step resume_list(Parser *parser, ParseFrame *frame, Node **result) {
+  push_item(parser, *result);
+  if (peek_token(parser)->type == TOKEN_COMMA) {
+    parser_next_token(parser);
+    parser_next_token(parser);
+    repush_frame(parser, frame);
+    return begin_expression(parser, LOWEST);
+  }
 
-static PrefixParseFn get_prefix_fn(TokenType token_type) {
-  return prefix_parse_fns[token_type];
+  int call = frame->token.type == TOKEN_LPAREN;
+  if (!parser_expect_peek(parser, call ? TOKEN_RPAREN : TOKEN_RBRACKET)) {
+    return STEP_ERROR;
+  }
+  NodeList items = pop_list(parser, frame->base);
+  *result = call ? new_call_expression_node(parser->arena, frame->token,
+                                            frame->left, items)
+                 : new_array_literal(parser->arena, frame->token, items);
+  return STEP_RESUME;
 }
+
+static Step parse_array_literal(Parser *parser, Node **result) {
+  return begin_list(parser, NULL, TOKEN_RBRACKET, result);
+}
+
+static Step parse_call_expression(Parser *parser, Node *function,
+                                  Node **result) {
+  return begin_list(parser, function, TOKEN_RPAREN, result);
+}
+
+static Step parse_infix_expression(Parser *parser, Node *left,
+                                   Node **result) {
+  (void)result;
+  Token token = *current_token(parser);
+  if (!push_frame(parser, FRAME_INFIX, &token)) {
+    return STEP_ERROR;
+  }
+  top_frame(parser)->left = left;
+  parser_next_token(parser);
+  return begin_expression(parser, precedences[token.type]);
+}
+
+static Step resume_infix(Parser *parser, ParseFrame *frame, Node **result) {
+  *result = new_infix_expression_node(parser->arena, frame->token,
+                                      frame->left, *result);
+  return STEP_RESUME;
+}
+
+static Step parse_index_expression(Parser *parser, Node *left,
+                                   Node **result) {
+  (void)result;
+  if (!push_frame(parser, FRAME_INDEX, current_token(parser))) {
+    return STEP_ERROR;
+  }
+  top_frame(parser)->left = left;
+  parser_next_token(parser);
+  return begin_expression(parser, LOWEST);
+}
+
+static Step resume_index(Parser *parser, ParseFrame *frame, Node **result) {
+  if (!parser_expect_peek(parser, TOKEN_RBRACKET)) {
+    return STEP_ERROR;
+  }
+  *result = new_index_expression_node(parser->arena, frame->token,
+                                      frame->left, *result);
+  return STEP_RESUME;
+}
+
+// Indexed by the type of the token an expression starts with.
+static PrefixParseFn prefix_parse_fns[TOKEN_COUNT] = {
+    [TOKEN_IDENT] = parse_identifier,
+    [TOKEN_INT] = parse_integer,
+    [TOKEN_STRING] = parse_string,
+    [TOKEN_TRUE] = parse_boolean,
+    [TOKEN_FALSE] = parse_boolean,
+    [TOKEN_BANG] = parse_prefix_expression,
+    [TOKEN_MINUS] = parse_prefix_expression,
+    [TOKEN_LPAREN] = parse_grouped_expression,
+    [TOKEN_IF] = parse_if_expression,
+    [TOKEN_FUNCTION] = parse_function_literal,
+    [TOKEN_LBRACKET] = parse_array_literal,
+};
+
+// Indexed by the type of the operator token. Every token with a
+// precedence above LOWEST has a handler.
+static InfixParseFn infix_parse_fns[TOKEN_COUNT] = {
+    [TOKEN_PLUS] = parse_infix_expression,
+    [TOKEN_MINUS] = parse_infix_expression,
+    [TOKEN_ASTERISK] = parse_infix_expression,
+    [TOKEN_SLASH] = parse_infix_expression,
+    [TOKEN_EQ] = parse_infix_expression,
+    [TOKEN_NOT_EQ] = parse_infix_expression,
+    [TOKEN_LT] = parse_infix_expression,
+    [TOKEN_GT] = parse_infix_expression,
+    [TOKEN_LPAREN] = parse_call_expression,
+    [TOKEN_LBRACKET] = parse_index_expression,
+};
+
+// How tightly each token binds as an infix operator; LOWEST, the zero
+// value, for tokens that are not one.
+static const Precedence precedences[TOKEN_COUNT] = {
+    [TOKEN_EQ] = EQUALS,        [TOKEN_NOT_EQ] = EQUALS,
+    [TOKEN_LT] = LESS_GREATER,  [TOKEN_GT] = LESS_GREATER,
+    [TOKEN_PLUS] = SUM,         [TOKEN_MINUS] = SUM,
+    [TOKEN_ASTERISK] = PRODUCT, [TOKEN_SLASH] = PRODUCT,
+    [TOKEN_LPAREN] = CALL,      [TOKEN_LBRACKET] = INDEX,
+};
+
+// Indexed by FrameKind.
+static const ResumeFn resume_fns[FRAME_KIND_COUNT] = {
+    [FRAME_OPERAND] = resume_operand,
+    [FRAME_BLOCK] = resume_block,
+    [FRAME_LET] = resume_let,
+    [FRAME_RETURN] = resume_return,
+    [FRAME_EXPRESSION_STATEMENT] = resume_expression_statement,
+    [FRAME_PREFIX] = resume_prefix,
+    [FRAME_INFIX] = resume_infix,
+    [FRAME_GROUPED] = resume_grouped,
+    [FRAME_INDEX] = resume_index,
+    [FRAME_LIST] = resume_list,
+    [FRAME_IF_CONDITION] = resume_if_condition,
+    [FRAME_IF_CONSEQUENCE] = resume_if_consequence,
+    [FRAME_IF_ALTERNATIVE] = resume_if_alternative,
+    [FRAME_FUNCTION] = resume_function,
+};
@@ -3,17 +3,91 @@
 
 #include "lexer.h"
 #include "ast.h"
+#include "linemap.h"
 
+typedef enum {
+    // expected is the token the parser needed next, got the one it found.
+    PARSE_ERROR_UNEXPECTED_TOKEN,
+    // got cannot start an expression.
+    PARSE_ERROR_NO_PREFIX,
+    PARSE_ERROR_INTEGER_OVERFLOW,
+    // The input ended inside a block.
+    PARSE_ERROR_UNCLOSED_BLOCK,
+    // Expressions and blocks are nested deeper than Parser.max_depth.
+    PARSE_ERROR_TOO_DEEP,
+} ParseErrorCode;
+
+// A diagnostic as plain data, so reporting one costs no allocation and the
+// message is only built if parse_error_message() asks for it. offset and
+// length span the token the error is about; see parser_error_position().
 typedef struct {
-    const char* message;
+    ParseErrorCode code;
+    TokenType expected;
+    TokenType got;
+    int length;
+    size_t offset;
 } ParseError;
 
+// Size of the parser's token ring buffer; must be a power of two. The
+// parser can look up to PARSER_LOOKAHEAD - 1 tokens past the current one.
+#define PARSER_LOOKAHEAD 64
+
+// Default for Parser.max_depth.
+#define PARSER_MAX_DEPTH 10000
+
+// Default for Parser.max_errors.
+#define PARSER_MAX_ERRORS 100
+
+typedef struct ParseFrame ParseFrame;
+
 typedef struct {
-    Token current_token;
-    Token peek_token;
+    Lexer lexer;
+    // When source is set, tokens come from this array instead of the lexer.
+    // It must end with TOKEN_EOF; source_next is the next one to buffer.
+    const Token* source;
+    size_t source_count;
+    size_t source_next;
+    // Pre-lexed tokens: tokens[head] is the current token, followed by
+    // token_count - 1 more, wrapping around the end of the array.
+    Token tokens[PARSER_LOOKAHEAD];
+    int head;
+    int token_count;
     ParseError* errors;
     int error_count;
     int error_capacity;
+    // Errors past this many are dropped, and parser_parse_program() stops
+    // once it is reached, so malformed input costs bounded time and memory.
+    // Set after init to change it.
+    int max_errors;
+    // Only indexed if an error's position is asked for.
+    LineMap lines;
+    // Where nodes are allocated. parser_parse_program() points it at the
+    // new program's arena; callers of parser_parse_statement() set it.
+    Arena* arena;
+    // Items of the lists being parsed (block statements, parameters,
+    // arguments, array elements), innermost list last. A finished list is
+    // copied into the arena at its final size and popped.
+    Node** items;
+    int item_count;
+    int item_capacity;
+    // What is waiting on the nested construct being parsed, innermost
+    // last; the parser keeps this stack instead of recursing, so deep
+    // nesting costs heap rather than C stack.
+    ParseFrame* frames;
+    int frame_count;
+    int frame_capacity;
+    // Levels of expression and block nesting open, and how many are
+    // allowed before parsing fails with an error. Set max_depth after init
+    // to change it. It bounds nesting, not the height of the tree: a chain
+    // such as 1 + 1 + ... + 1 opens no levels, so code that walks finished
+    // trees keeps a stack of its own rather than recursing.
+    int depth;
+    int max_depth;
+    // Set after init to skip function bodies by matching braces, leaving
+    // them as unparsed blocks for parser_parse_body(); errors inside a
+    // body are only found once it is parsed. Needs the whole input in
+    // memory, so not for parsers reading a file descriptor.
+    int lazy_bodies;
 } Parser;
 
 typedef enum {
@@ -23,9 +97,58 @@ typedef enum {
     SUM,
     PRODUCT,
     PREFIX,
-    CALL
+    CALL,
+    INDEX
 } Precedence;
 
+// Context API: a Parser owns its Lexer and error list, so separate parsers
+// can run on separate threads.
+void parser_init(Parser* parser, const char* input, size_t length);
+// Parses an already lexed token array (see tokenize.h) instead of lexing
+// input; input is still needed to resolve error positions. The tokens must
+// outlive the parser.
+void parser_init_tokens(Parser* parser, const Token* tokens, size_t count,
+                        const char* input, size_t length);
+Node* parser_parse_program(Parser* parser);
+// Parses the top-level statement at the current token, allocating from
+// parser->arena, and moves past it. Returns NULL if the statement had
+// errors or there was nothing to parse; after an error the rest of the
+// statement is skipped: up to a "let" or "return", or past a ";" or a stray
+// "}", outside any block the error was in. parser_parse_program() is this
+// in a loop until TOKEN_EOF or max_errors.
+Node* parser_parse_statement(Parser* parser);
+// Parses body, an unparsed block (see BlockStatement), in place, allocating
+// from arena, which should be the arena of the program it belongs to.
+// Function bodies inside it are skipped in turn. Errors are added to
+// parser, which needs the same input as the one that skipped the body but
+// may be another, and leave the body unparsed; parsing stops once parser
+// holds max_errors, counting the errors it had before. Returns how many
+// errors were added, which is 0 if parser was already full, in which case
+// the body is left unparsed.
+int parser_parse_body(Parser* parser, Node* body, Arena* arena);
+// Only for token-array parsers: the index in the array of the current
+// token.
+size_t parser_token_index(Parser* parser);
+// Only for token-array parsers: makes the token at index current.
+void parser_seek(Parser* parser, size_t index);
+void parser_next_token(Parser* parser);
+// Returns the token distance places after the current one (0 is the
+// current token) without consuming anything, or NULL if distance is not
+// below PARSER_LOOKAHEAD.
+const Token* parser_peek(Parser* parser, int distance);
+int parser_expect_peek(Parser* parser, TokenType type);
+void parser_peek_error(Parser* parser, TokenType type);
+// Records error, unless max_errors have been already.
+void parser_add_error(Parser* parser, ParseError error);
+ParseError* parser_get_errors(Parser* parser, int* count);
+// The error's text, such as "expected next token to be ), got ; instead".
+sds parse_error_message(const ParseError* error);
+Position parser_error_position(Parser* parser, const ParseError* error);
+// Releases the error list, list stack and line index; the program is not
+// touched.
+void parser_free(Parser* parser);
+
+// Convenience wrappers around a single file-static Parser.
 void init_parser(const char* input);
 Node* parse_program();
 void parse_next_token();
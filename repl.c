@@ -1,61 +1,55 @@
 #include "repl.h"
 #include "lexer.h"
+#include "memory.h"
+#include "sds.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define PROMPT ">> "
-#define MAX_INPUT 1024
+#define READ_CHUNK 1024
 
-static const char *token_names[] = {[TOKEN_ILLEGAL] = "ILLEGAL",
-                                    [TOKEN_EOF] = "EOF",
-                                    [TOKEN_IDENT] = "IDENT",
-                                    [TOKEN_INT] = "INT",
-                                    [TOKEN_STRING] = "STRING",
-                                    [TOKEN_ASSIGN] = "=",
-                                    [TOKEN_PLUS] = "+",
-                                    [TOKEN_MINUS] = "-",
-                                    [TOKEN_BANG] = "!",
-                                    [TOKEN_ASTERISK] = "*",
-                                    [TOKEN_SLASH] = "/",
-                                    [TOKEN_LT] = "<",
-                                    [TOKEN_GT] = ">",
-                                    [TOKEN_EQ] = "==",
-                                    [TOKEN_NOT_EQ] = "!=",
-                                    [TOKEN_COMMA] = ",",
-                                    [TOKEN_SEMICOLON] = ";",
-                                    [TOKEN_LPAREN] = "(",
-                                    [TOKEN_RPAREN] = ")",
-                                    [TOKEN_LBRACE] = "{",
-                                    [TOKEN_RBRACE] = "}",
-                                    [TOKEN_LBRACKET] = "[",
-                                    [TOKEN_RBRACKET] = "]",
-                                    [TOKEN_FUNCTION] = "FUNCTION",
-                                    [TOKEN_LET] = "LET",
-                                    [TOKEN_TRUE] = "TRUE",
-                                    [TOKEN_FALSE] = "FALSE",
-                                    [TOKEN_IF] = "IF",
-                                    [TOKEN_ELSE] = "ELSE",
-                                    [TOKEN_RETURN] = "RETURN"};
+// Reads one line of any length into line, without the trailing newline.
+// Returns 0 at end of input.
+static int read_line(FILE *input, sds *line) {
+  char chunk[READ_CHUNK];
+
+  sdsclear(*line);
+  while (fgets(chunk, sizeof(chunk), input) != NULL) {
+    size_t length = strlen(chunk);
+    if (length > 0 && chunk[length - 1] == '\n') {
+      *line = sdscatlen(*line, chunk, length - 1);
+      return 1;
+    }
+    *line = sdscatlen(*line, chunk, length);
+  }
+
+  return sdslen(*line) > 0;
+}
 
 void start_repl(FILE *input, FILE *output) {
-  char line[MAX_INPUT];
+  sds line = sdsempty();
 
   while (1) {
     fprintf(output, PROMPT);
     fflush(output);
 
-    if (fgets(line, sizeof(line), input) == NULL) {
+    if (!read_line(input, &line)) {
       break;
     }
 
-    line[strcspn(line, "\n")] = 0;
-
-    if (strlen(line) == 0) {
+    if (sdslen(line) == 0) {
+      continue;
+    }
+#ifdef MEMORY_STATS
+    // Builds that count allocations can report them on request.
+    if (strcmp(line, ":memory") == 0) {
+      memory_stats_dump(output);
       continue;
     }
+#endif
 
-    init_lexer(line);
+    init_lexer_len(line, sdslen(line));
 
     while (1) {
       Token token = next_token();
@@ -64,8 +58,10 @@ void start_repl(FILE *input, FILE *output) {
         break;
       }
 
-      fprintf(output, "{Type: %s Literal: %s}\n", token_names[token.type],
-              token.literal);
+      fprintf(output, "{Type: %s Literal: %.*s}\n",
+              token_type_to_string(token.type), token.length, token.start);
     }
   }
+
+  sdsfree(line);
 }
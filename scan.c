@@ -0,0 +1,301 @@
+#include "scan.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+typedef size_t (*RunScanner)(const char *input, size_t from, size_t length);
+
+static int is_whitespace(char ch) {
+  return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+static int is_identifier(char ch) {
+  return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+         (ch >= '0' && ch <= '9') || ch == '_';
+}
+
+static int is_digit(char ch) { return ch >= '0' && ch <= '9'; }
+
+static size_t scalar_whitespace(const char *input, size_t from,
+                                size_t length) {
+  size_t i = from;
+  while (i < length && is_whitespace(input[i])) {
+    i++;
+  }
+  return i;
+}
+
+static size_t scalar_identifier(const char *input, size_t from,
+                                size_t length) {
+  size_t i = from;
+  while (i < length && is_identifier(input[i])) {
+    i++;
+  }
+  return i;
+}
+
+static size_t scalar_digits(const char *input, size_t from, size_t length) {
+  size_t i = from;
+  while (i < length && is_digit(input[i])) {
+    i++;
+  }
+  return i;
+}
+
+// Turns eight ASCII digits into their value with three multiplies instead
+// of eight: each step combines neighbouring lanes, going from eight 1-digit
+// lanes to four 2-digit, two 4-digit and finally one 8-digit lane. The
+// first digit must be in the lowest byte, so big-endian loads are swapped.
+static uint64_t decode_eight(const char *digits) {
+  uint64_t chunk;
+  memcpy(&chunk, digits, sizeof(chunk));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  chunk = __builtin_bswap64(chunk);
+#endif
+
+  chunk -= 0x3030303030303030ull;
+  chunk = (chunk * 10 + (chunk >> 8)) & 0x00FF00FF00FF00FFull;
+  chunk = (chunk * 100 + (chunk >> 16)) & 0x0000FFFF0000FFFFull;
+  return (chunk * 10000 + (chunk >> 32)) & 0xFFFFFFFFull;
+}
+
+int scan_decimal(const char *digits, size_t length, uint64_t *value) {
+  // Leading zeros do not count towards the 20 digits a uint64_t can hold.
+  while (length > 1 && digits[0] == '0') {
+    digits++;
+    length--;
+  }
+  if (length > 20) {
+    return 0;
+  }
+
+  // Up to 19 digits always fit, so only a 20th digit needs checking.
+  size_t safe = length < 20 ? length : 19;
+  uint64_t result = 0;
+  size_t i = 0;
+
+  for (; i + 8 <= safe; i += 8) {
+    result = result * 100000000 + decode_eight(digits + i);
+  }
+  for (; i < safe; i++) {
+    result = result * 10 + (uint64_t)(digits[i] - '0');
+  }
+  if (i < length &&
+      (__builtin_mul_overflow(result, 10, &result) ||
+       __builtin_add_overflow(result, (uint64_t)(digits[i] - '0'), &result))) {
+    return 0;
+  }
+
+  *value = result;
+  return 1;
+}
+
+#ifdef SCAN_X86
+
+// Byte classification shared by the SSE2 and AVX2 scanners. SSE2 only has
+// signed byte compares, which is fine here: every character we look for is
+// ASCII, and bytes >= 0x80 compare as negative and never match a range.
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+
+SSE2 static __m128i sse2_in_range(__m128i bytes, char low, char high) {
+  return _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(low - 1)),
+                       _mm_cmplt_epi8(bytes, _mm_set1_epi8(high + 1)));
+}
+
+SSE2 static size_t sse2_whitespace(const char *input, size_t from,
+                                   size_t length) {
+  size_t i = from;
+  while (i + 16 <= length) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *)(input + i));
+    __m128i space = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+                     _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'))),
+        _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t')),
+                     _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r'))));
+
+    unsigned stop = ~(unsigned)_mm_movemask_epi8(space) & 0xFFFF;
+    if (stop) {
+      return i + __builtin_ctz(stop);
+    }
+    i += 16;
+  }
+  return scalar_whitespace(input, i, length);
+}
+
+SSE2 static size_t sse2_identifier(const char *input, size_t from,
+                                   size_t length) {
+  size_t i = from;
+  while (i + 16 <= length) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *)(input + i));
+    __m128i folded = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+    __m128i word = _mm_or_si128(
+        _mm_or_si128(sse2_in_range(folded, 'a', 'z'),
+                     sse2_in_range(bytes, '0', '9')),
+        _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_')));
+
+    unsigned stop = ~(unsigned)_mm_movemask_epi8(word) & 0xFFFF;
+    if (stop) {
+      return i + __builtin_ctz(stop);
+    }
+    i += 16;
+  }
+  return scalar_identifier(input, i, length);
+}
+
+SSE2 static size_t sse2_digits(const char *input, size_t from,
+                               size_t length) {
+  size_t i = from;
+  while (i + 16 <= length) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *)(input + i));
+    __m128i digit = sse2_in_range(bytes, '0', '9');
+
+    unsigned stop = ~(unsigned)_mm_movemask_epi8(digit) & 0xFFFF;
+    if (stop) {
+      return i + __builtin_ctz(stop);
+    }
+    i += 16;
+  }
+  return scalar_digits(input, i, length);
+}
+
+AVX2 static __m256i avx2_in_range(__m256i bytes, char low, char high) {
+  return _mm256_and_si256(
+      _mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(low - 1)),
+      _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), bytes));
+}
+
+AVX2 static size_t avx2_whitespace(const char *input, size_t from,
+                                   size_t length) {
+  size_t i = from;
+  while (i + 32 <= length) {
+    __m256i bytes = _mm256_loadu_si256((const __m256i *)(input + i));
+    __m256i space = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+                        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t')),
+                        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r'))));
+
+    unsigned stop = ~(unsigned)_mm256_movemask_epi8(space);
+    if (stop) {
+      return i + __builtin_ctz(stop);
+    }
+    i += 32;
+  }
+  return sse2_whitespace(input, i, length);
+}
+
+AVX2 static size_t avx2_identifier(const char *input, size_t from,
+                                   size_t length) {
+  size_t i = from;
+  while (i + 32 <= length) {
+    __m256i bytes = _mm256_loadu_si256((const __m256i *)(input + i));
+    __m256i folded = _mm256_or_si256(bytes, _mm256_set1_epi8(0x20));
+    __m256i word = _mm256_or_si256(
+        _mm256_or_si256(avx2_in_range(folded, 'a', 'z'),
+                        avx2_in_range(bytes, '0', '9')),
+        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_')));
+
+    unsigned stop = ~(unsigned)_mm256_movemask_epi8(word);
+    if (stop) {
+      return i + __builtin_ctz(stop);
+    }
+    i += 32;
+  }
+  return sse2_identifier(input, i, length);
+}
+
+AVX2 static size_t avx2_digits(const char *input, size_t from,
+                               size_t length) {
+  size_t i = from;
+  while (i + 32 <= length) {
+    __m256i bytes = _mm256_loadu_si256((const __m256i *)(input + i));
+    __m256i digit = avx2_in_range(bytes, '0', '9');
+
+    unsigned stop = ~(unsigned)_mm256_movemask_epi8(digit);
+    if (stop) {
+      return i + __builtin_ctz(stop);
+    }
+    i += 32;
+  }
+  return sse2_digits(input, i, length);
+}
+
+#endif
+
+static ScanLevel level = SCAN_SCALAR;
+static RunScanner whitespace_scanner = scalar_whitespace;
+static RunScanner identifier_scanner = scalar_identifier;
+static RunScanner digit_scanner = scalar_digits;
+
+static int supported(ScanLevel requested) {
+  switch (requested) {
+  case SCAN_SCALAR:
+    return 1;
+#ifdef SCAN_X86
+  case SCAN_SSE2:
+    return __builtin_cpu_supports("sse2");
+  case SCAN_AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return 0;
+  }
+}
+
+int scan_select(ScanLevel requested) {
+  if (!supported(requested)) {
+    return 0;
+  }
+
+  level = requested;
+  switch (requested) {
+#ifdef SCAN_X86
+  case SCAN_SSE2:
+    whitespace_scanner = sse2_whitespace;
+    identifier_scanner = sse2_identifier;
+    digit_scanner = sse2_digits;
+    break;
+  case SCAN_AVX2:
+    whitespace_scanner = avx2_whitespace;
+    identifier_scanner = avx2_identifier;
+    digit_scanner = avx2_digits;
+    break;
+#endif
+  default:
+    whitespace_scanner = scalar_whitespace;
+    identifier_scanner = scalar_identifier;
+    digit_scanner = scalar_digits;
+    break;
+  }
+  return 1;
+}
+
+// Runs before main(), so the dispatch pointers are never written while
+// lexers on other threads are reading them.
+__attribute__((constructor)) static void scan_init() {
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+#endif
+  if (!scan_select(SCAN_AVX2) && !scan_select(SCAN_SSE2)) {
+    scan_select(SCAN_SCALAR);
+  }
+}
+
+ScanLevel scan_level() { return level; }
+
+size_t scan_whitespace(const char *input, size_t from, size_t length) {
+  return whitespace_scanner(input, from, length);
+}
+
+size_t scan_identifier(const char *input, size_t from, size_t length) {
+  return identifier_scanner(input, from, length);
+}
+
+size_t scan_digits(const char *input, size_t from, size_t length) {
+  return digit_scanner(input, from, length);
+}
@@ -0,0 +1,29 @@
+#ifndef scan_h
+#define scan_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2,
+} ScanLevel;
+
+// Each scanner starts at from and returns the index of the first byte that
+// does not belong to the run, or length if the run reaches the end.
+size_t scan_whitespace(const char* input, size_t from, size_t length);
+size_t scan_identifier(const char* input, size_t from, size_t length);
+size_t scan_digits(const char* input, size_t from, size_t length);
+
+// Decodes length ASCII digits into *value, eight at a time. Returns 0 if
+// the number does not fit in 64 bits, leaving *value unspecified.
+int scan_decimal(const char* digits, size_t length, uint64_t* value);
+
+// The best level supported by the CPU is selected at startup. scan_select()
+// overrides it (for benchmarks and tests) and returns 0 if the CPU does not
+// support the requested level.
+ScanLevel scan_level();
+int scan_select(ScanLevel level);
+
+#endif
@@ -229,6 +229,7 @@ sds sdsMakeRoomFor(sds s, size_t addlen) {
 
   hdrlen = sdsHdrSize(type);
   assert(hdrlen + newlen + 1 > reqlen); /* Catch size_t overflow */
+  (void)reqlen; /* Only read by the assert, which NDEBUG removes */
   if (oldtype == type) {
     newsh = s_realloc(sh, hdrlen + newlen + 1);
     if (newsh == NULL)
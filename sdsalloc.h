@@ -37,6 +37,14 @@
  * the include of your alternate allocator if needed (not needed in order
  * to use the default libc allocator). */
 
+#ifdef MEMORY_STATS
+#include "memory.h"
+#define s_malloc(size) counted_malloc(size, __FILE__, __LINE__)
+#define s_realloc(pointer, size) \
+  counted_realloc(pointer, size, __FILE__, __LINE__)
+#define s_free(pointer) counted_free(pointer, __FILE__, __LINE__)
+#else
 #define s_malloc malloc
 #define s_realloc realloc
 #define s_free free
+#endif
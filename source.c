@@ -0,0 +1,102 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "source.h"
+#include "memory.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define READ_CHUNK (64 * 1024)
+
+static int map_file(Source *source, int fd, size_t length) {
+  void *data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+
+  // The lexer makes a single forward pass, so ask for aggressive readahead.
+  posix_madvise(data, length, POSIX_MADV_SEQUENTIAL);
+
+  source->data = data;
+  source->length = length;
+  source->mapped = 1;
+  source->capacity = 0;
+  return 0;
+}
+
+static int read_file(Source *source, int fd) {
+  size_t capacity = READ_CHUNK;
+  size_t length = 0;
+  char *buffer = ALLOCATE(char, capacity);
+
+  while (1) {
+    if (length == capacity) {
+      size_t old_capacity = capacity;
+      capacity = GROW_CAPACITY(old_capacity);
+      buffer = GROW_ARRAY(char, buffer, old_capacity, capacity);
+    }
+
+    ssize_t count = read(fd, buffer + length, capacity - length);
+    if (count == 0) {
+      break;
+    }
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      FREE_ARRAY(char, buffer, capacity);
+      return -1;
+    }
+    length += (size_t)count;
+  }
+
+  source->data = buffer;
+  source->length = length;
+  source->mapped = 0;
+  source->capacity = capacity;
+  return 0;
+}
+
+int source_open(Source *source, const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) < 0) {
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return -1;
+  }
+
+  // Empty files cannot be mapped, and pipes have no size to map.
+  int result = -1;
+  if (S_ISREG(info.st_mode) && info.st_size > 0) {
+    result = map_file(source, fd, (size_t)info.st_size);
+  }
+  if (result < 0) {
+    result = read_file(source, fd);
+  }
+
+  int saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+  return result;
+}
+
+void source_close(Source *source) {
+  if (source->mapped) {
+    munmap((void *)source->data, source->length);
+  } else {
+    FREE_ARRAY(char, (char *)source->data, source->capacity);
+  }
+
+  source->data = NULL;
+  source->length = 0;
+  source->mapped = 0;
+  source->capacity = 0;
+}
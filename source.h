@@ -0,0 +1,20 @@
+#ifndef source_h
+#define source_h
+
+#include <stddef.h>
+
+// A script's bytes, either mapped read-only straight from the file or, for
+// pipes and other files that cannot be mapped, read into a heap buffer.
+// data is not NUL-terminated; pass length along to the lexer.
+typedef struct {
+    const char* data;
+    size_t length;
+    int mapped;
+    size_t capacity;
+} Source;
+
+// Returns 0 on success and -1 on failure, with errno set.
+int source_open(Source* source, const char* path);
+void source_close(Source* source);
+
+#endif
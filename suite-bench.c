@@ -0,0 +1,251 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "corpus.h"
+#include "document.h"
+#include "memory.h"
+#include "parser.h"
+#include "sds.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Runs every driver over every corpus kind and reports one row each. Built
+// with MEMORY_STATS, so allocations are counted; each row runs in a child
+// process of its own, so its peak RSS is not inflated by earlier rows.
+// With --json the rows are written as a JSON array, one object per line,
+// for diffing between commits:
+//
+//   make bench-json && mv bench.json before.json
+//   ... change things ...
+//   make bench-json && diff before.json bench.json
+//
+// With --sites each row of the table is followed by its allocations by
+// call site.
+
+#define DEFAULT_SIZE 4000000
+#define ROUNDS 3
+#define SEED 1
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+typedef struct {
+  sds input;
+  // Parsed before timing, for the drivers that start from a tree.
+  Node *program;
+} Work;
+
+static void lex(Work *work) {
+  Lexer lexer;
+  lexer_init(&lexer, work->input, sdslen(work->input));
+  while (lexer_next_token(&lexer).type != TOKEN_EOF) {
+  }
+  lexer_free(&lexer);
+}
+
+static Node *parse_input(sds input) {
+  Parser parser;
+  parser_init(&parser, input, sdslen(input));
+  Node *program = parser_parse_program(&parser);
+
+  int error_count;
+  parser_get_errors(&parser, &error_count);
+  if (error_count > 0) {
+    fprintf(stderr, "corpus has %d parse errors\n", error_count);
+    exit(1);
+  }
+  parser_free(&parser);
+  return program;
+}
+
+static void parse(Work *work) { program_free(parse_input(work->input)); }
+
+static void print(Work *work) { sdsfree(node_to_string(work->program)); }
+
+#define EDITS 50
+
+// Opens the input as a document and then, at EDITS line starts spread
+// through it, inserts a statement and deletes it again, asking for the
+// program after each edit.
+static void edit(Work *work) {
+  size_t length = sdslen(work->input);
+  Document document;
+  document_init(&document, work->input, length);
+  document_program(&document);
+
+  for (int i = 0; i < EDITS; i++) {
+    const char *line = memchr(work->input + length / EDITS * (size_t)i, '\n',
+                              length - length / EDITS * (size_t)i);
+    if (line == NULL) {
+      break;
+    }
+    size_t at = (size_t)(line - work->input) + 1;
+    document_edit(&document, at, at, "x;\n", 3);
+    document_program(&document);
+    document_edit(&document, at, at + 3, "", 0);
+    document_program(&document);
+  }
+  document_free(&document);
+}
+
+static const struct {
+  const char *name;
+  void (*run)(Work *work);
+  int needs_program;
+} drivers[] = {
+    {"lex", lex, 0},
+    {"parse", parse, 0},
+    {"print", print, 1},
+    {"edit", edit, 0},
+};
+
+static size_t count_tokens(sds input) {
+  Lexer lexer;
+  lexer_init(&lexer, input, sdslen(input));
+  size_t tokens = 1;
+  while (lexer_next_token(&lexer).type != TOKEN_EOF) {
+    tokens++;
+  }
+  lexer_free(&lexer);
+  return tokens;
+}
+
+static void count_token(Token *token, void *context) {
+  (void)token;
+  (*(size_t *)context)++;
+}
+
+// Every node but the program stores exactly one token.
+static size_t count_nodes(Node *program) {
+  size_t nodes = 1;
+  node_visit_tokens(program, count_token, &nodes);
+  return nodes;
+}
+
+static void bench(CorpusKind kind, int driver, size_t size, int json,
+                  int sites) {
+  Work work;
+  work.input = corpus_generate(kind, size, SEED);
+  work.program = drivers[driver].needs_program ? parse_input(work.input)
+                                               : NULL;
+  size_t length = sdslen(work.input);
+
+  double best = 0;
+  memory_stats_reset();
+  for (int i = 0; i < ROUNDS; i++) {
+    double start = now_ns();
+    drivers[driver].run(&work);
+    double elapsed = now_ns() - start;
+    if (i == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  MemoryStats memory = memory_stats();
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  // The call sites are printed after the row, but must be taken now.
+  FILE *site_report = NULL;
+  if (sites && !json) {
+    site_report = tmpfile();
+    memory_stats_dump(site_report);
+  }
+
+  // Counted after the peak is taken, so the extra passes do not show in it.
+  size_t tokens = count_tokens(work.input);
+  if (work.program == NULL) {
+    work.program = parse_input(work.input);
+  }
+  size_t nodes = count_nodes(work.program);
+
+  double seconds = best / 1e9;
+  double mb_per_s = (double)length / seconds / 1e6;
+  double tokens_per_s = (double)tokens / seconds;
+  // Lexing builds no nodes.
+  double nodes_per_s = driver == 0 ? 0 : (double)nodes / seconds;
+  size_t allocations = memory.allocations / ROUNDS;
+  size_t bytes = memory.bytes / ROUNDS;
+
+  if (json) {
+    printf("  {\"corpus\": \"%s\", \"driver\": \"%s\", \"bytes\": %zu, "
+           "\"tokens\": %zu, \"nodes\": %zu, \"seconds\": %.6f, "
+           "\"mb_per_s\": %.1f, \"tokens_per_s\": %.0f, "
+           "\"nodes_per_s\": %.0f, \"allocations\": %zu, "
+           "\"allocated_bytes\": %zu, \"peak_heap_bytes\": %zu, "
+           "\"peak_rss_kb\": %ld}",
+           corpus_name(kind), drivers[driver].name, length, tokens, nodes,
+           seconds, mb_per_s, tokens_per_s, nodes_per_s, allocations, bytes,
+           memory.peak_bytes, usage.ru_maxrss);
+  } else {
+    printf("%-11s %-5s %8zu bytes  %7.2f ms  %7.1f MB/s  %6.1f Mtok/s  "
+           "%6.1f Mnode/s  %8zu allocs  %7ld KB\n",
+           corpus_name(kind), drivers[driver].name, length, best / 1e6,
+           mb_per_s, tokens_per_s / 1e6, nodes_per_s / 1e6, allocations,
+           usage.ru_maxrss);
+  }
+  if (site_report != NULL) {
+    rewind(site_report);
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), site_report)) > 0) {
+      fwrite(buffer, 1, read, stdout);
+    }
+    fclose(site_report);
+    printf("\n");
+  }
+  fflush(stdout);
+
+  program_free(work.program);
+  sdsfree(work.input);
+}
+
+int main(int argc, char **argv) {
+  int json = 0;
+  int sites = 0;
+  size_t size = DEFAULT_SIZE;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0) {
+      json = 1;
+    } else if (strcmp(argv[i], "--sites") == 0) {
+      sites = 1;
+    } else {
+      size = strtoul(argv[i], NULL, 10);
+    }
+  }
+
+  int driver_count = (int)(sizeof(drivers) / sizeof(drivers[0]));
+  if (json) {
+    printf("[\n");
+  }
+  for (int kind = 0; kind < CORPUS_KIND_COUNT; kind++) {
+    for (int driver = 0; driver < driver_count; driver++) {
+      if (json && (kind > 0 || driver > 0)) {
+        printf(",\n");
+      }
+      fflush(stdout);
+
+      pid_t child = fork();
+      if (child == 0) {
+        bench((CorpusKind)kind, driver, size, json, sites);
+        exit(0);
+      }
+      int status;
+      if (child < 0 || waitpid(child, &status, 0) < 0 ||
+          !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s/%s failed\n", corpus_name((CorpusKind)kind),
+                drivers[driver].name);
+        return 1;
+      }
+    }
+  }
+  if (json) {
+    printf("\n]\n");
+  }
+  return 0;
+}
@@ -0,0 +1,191 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "tokenize.h"
+#include "memory.h"
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+  const char *input;
+  size_t length;
+  // The chunk covers tokens starting in [start, end); lexing begins at
+  // from, which is start unless the chunk is being lexed again.
+  size_t start;
+  size_t end;
+  size_t from;
+  int last;
+  TokenArray tokens;
+  // Position just past the chunk's last token, i.e. where a sequential
+  // lexer would continue from.
+  size_t resume;
+} Chunk;
+
+void token_array_init(TokenArray *array) {
+  array->tokens = NULL;
+  array->count = 0;
+  array->capacity = 0;
+}
+
+void token_array_push(TokenArray *array, Token token) {
+  if (array->count >= array->capacity) {
+    size_t old_capacity = array->capacity;
+    array->capacity = GROW_CAPACITY(old_capacity);
+    array->tokens =
+        GROW_ARRAY(Token, array->tokens, old_capacity, array->capacity);
+  }
+
+  array->tokens[array->count] = token;
+  array->count++;
+}
+
+void token_array_free(TokenArray *array) {
+  FREE_ARRAY(Token, array->tokens, array->capacity);
+  token_array_init(array);
+}
+
+// Lexes the tokens that start inside the chunk. The lexer is given the
+// rest of the input, so the last token may run past the chunk's end. Its
+// base is set so token offsets are relative to the whole input.
+static void lex_chunk(Chunk *chunk) {
+  Lexer lexer;
+  lexer_init(&lexer, chunk->input + chunk->from, chunk->length - chunk->from);
+  lexer.base = chunk->from;
+
+  token_array_free(&chunk->tokens);
+  chunk->resume = chunk->from;
+
+  while (1) {
+    Token token = lexer_next_token(&lexer);
+
+    if (token.type == TOKEN_EOF) {
+      // Only the final chunk owns the EOF token; for the others, reaching
+      // EOF just means no more tokens start in the chunk.
+      if (chunk->last) {
+        token_array_push(&chunk->tokens, token);
+      }
+      break;
+    }
+    // A string belongs to the chunk its opening quote is in, which is
+    // where its offset points.
+    if (token.offset >= chunk->end) {
+      break;
+    }
+
+    token_array_push(&chunk->tokens, token);
+    chunk->resume = chunk->from + lexer.position;
+  }
+}
+
+static void *lex_chunk_thread(void *argument) {
+  lex_chunk(argument);
+  return NULL;
+}
+
+// Splits are moved forward to a whitespace byte, so a speculative lexer
+// can only be wrong when the split falls inside a string literal.
+static size_t split_point(const char *input, size_t length, size_t guess) {
+  while (guess < length && input[guess] != ' ' && input[guess] != '\t' &&
+         input[guess] != '\n' && input[guess] != '\r') {
+    guess++;
+  }
+  return guess;
+}
+
+static int pick_thread_count(size_t length) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t by_size = length / TOKENIZE_MIN_CHUNK;
+  int count = cpus > 0 ? (int)cpus : 1;
+
+  if (by_size < (size_t)count) {
+    count = by_size > 0 ? (int)by_size : 1;
+  }
+  return count;
+}
+
+void tokenize_parallel(const char *input, size_t length, int thread_count,
+                       TokenArray *out) {
+  if (thread_count <= 0) {
+    thread_count = pick_thread_count(length);
+  }
+
+  Chunk *chunks = ALLOCATE(Chunk, thread_count);
+  pthread_t *threads = ALLOCATE(pthread_t, thread_count);
+
+  size_t start = 0;
+  for (int i = 0; i < thread_count; i++) {
+    size_t end = i == thread_count - 1
+                     ? length
+                     : split_point(input, length,
+                                   length / thread_count * (size_t)(i + 1));
+    if (end < start) {
+      end = start;
+    }
+
+    chunks[i].input = input;
+    chunks[i].length = length;
+    chunks[i].start = start;
+    chunks[i].end = end;
+    chunks[i].from = start;
+    chunks[i].last = i == thread_count - 1;
+    token_array_init(&chunks[i].tokens);
+    start = end;
+  }
+
+  // Chunk 0 is lexed on this thread; its start state is always right.
+  int started = 1;
+  for (int i = 1; i < thread_count; i++) {
+    if (pthread_create(&threads[i], NULL, lex_chunk_thread, &chunks[i])) {
+      break;
+    }
+    started++;
+  }
+  lex_chunk_thread(&chunks[0]);
+  for (int i = started; i < thread_count; i++) {
+    lex_chunk_thread(&chunks[i]);
+  }
+  for (int i = 1; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  // Validate in order. A chunk's guess was right if the previous chunk's
+  // last token ended at or before the split; otherwise that token (always
+  // a string) ran into this chunk, and lexing restarts where it ended.
+  size_t resume = chunks[0].resume;
+  for (int i = 1; i < thread_count; i++) {
+    Chunk *chunk = &chunks[i];
+    if (resume > chunk->start) {
+      chunk->from = resume < chunk->end ? resume : chunk->end;
+      lex_chunk(chunk);
+    }
+    if (chunk->tokens.count > 0) {
+      resume = chunk->resume;
+    }
+  }
+
+  size_t total = 0;
+  for (int i = 0; i < thread_count; i++) {
+    total += chunks[i].tokens.count;
+  }
+
+  // Chunk 0 is already in its final form, so its array becomes the output
+  // and only the later chunks are copied in.
+  *out = chunks[0].tokens;
+  if (total > out->capacity) {
+    out->tokens = GROW_ARRAY(Token, out->tokens, out->capacity, total);
+    out->capacity = total;
+  }
+
+  for (int i = 1; i < thread_count; i++) {
+    Chunk *chunk = &chunks[i];
+    if (chunk->tokens.count > 0) {
+      memcpy(out->tokens + out->count, chunk->tokens.tokens,
+             sizeof(Token) * chunk->tokens.count);
+      out->count += chunk->tokens.count;
+    }
+    token_array_free(&chunk->tokens);
+  }
+
+  FREE_ARRAY(pthread_t, threads, thread_count);
+  FREE_ARRAY(Chunk, chunks, thread_count);
+}
@@ -0,0 +1,32 @@
+#ifndef tokenize_h
+#define tokenize_h
+
+#include <stddef.h>
+#include "lexer.h"
+
+// Every token of an input, ending with TOKEN_EOF. Tokens are views into the
+// input, which must outlive the array.
+typedef struct {
+    Token* tokens;
+    size_t count;
+    size_t capacity;
+} TokenArray;
+
+void token_array_init(TokenArray* array);
+void token_array_push(TokenArray* array, Token token);
+void token_array_free(TokenArray* array);
+
+// Lexes input into out, splitting it into thread_count chunks that are
+// lexed concurrently. Each chunk is lexed on the guess that its first byte
+// is not inside a string literal; chunks where that guess turns out wrong
+// are lexed again from the end of the previous chunk's last token. The
+// result is identical to lexing the whole input with one Lexer.
+//
+// A thread_count of 0 picks one thread per online CPU, but never chunks
+// smaller than TOKENIZE_MIN_CHUNK bytes.
+void tokenize_parallel(const char* input, size_t length, int thread_count,
+                       TokenArray* out);
+
+#define TOKENIZE_MIN_CHUNK (256 * 1024)
+
+#endif